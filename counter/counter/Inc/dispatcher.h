@@ -0,0 +1,27 @@
+/**
+  ******************************************************************************
+  * @file           : dispatcher.h
+  * @brief          : Header for dispatcher.c file.
+  *                   Timer interrupt dispatch over the enabled sources only.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __DISPATCHER_H
+#define __DISPATCHER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported functions prototypes ---------------------------------------------*/
+void DispatchTimerInterrupt(TIM_HandleTypeDef *htim);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __DISPATCHER_H */
@@ -0,0 +1,78 @@
+/**
+  ******************************************************************************
+  * @file           : glyphs.h
+  * @brief          : Glyphs of the 7-segment displays.
+  *
+  *                   GLYPH_PINS_TABLE initializes a table of the lit
+  *                   segments of every glyph from the DISPLAY_A_Pin to
+  *                   DISPLAY_G_Pin names of the project's main.h, so each
+  *                   board resolves the same glyphs onto its own pin map at
+  *                   compile time.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __GLYPHS_H
+#define __GLYPHS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "main.h"
+
+/* Exported types ------------------------------------------------------------*/
+enum Glyph
+{
+  /* Hex digits map onto their own values */
+  GLYPH_0, GLYPH_1, GLYPH_2, GLYPH_3, GLYPH_4, GLYPH_5, GLYPH_6, GLYPH_7,
+  GLYPH_8, GLYPH_9, GLYPH_A, GLYPH_B, GLYPH_C, GLYPH_D, GLYPH_E, GLYPH_F,
+  GLYPH_BLANK,
+  GLYPH_MINUS,
+  GLYPH_H,
+  GLYPH_L,
+  GLYPH_N,
+  GLYPH_O,
+  GLYPH_P,
+  GLYPH_R,
+  GLYPH_U,
+  GLYPH_COUNT
+};
+
+/* Exported macro ------------------------------------------------------------*/
+/* Initializer of a uint16_t table indexed by enum Glyph */
+#define GLYPH_PINS_TABLE \
+  { \
+    [GLYPH_0] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin, \
+    [GLYPH_1] = DISPLAY_B_Pin | DISPLAY_C_Pin, \
+    [GLYPH_2] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_G_Pin, \
+    [GLYPH_3] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_G_Pin, \
+    [GLYPH_4] = DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_5] = DISPLAY_A_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_6] = DISPLAY_A_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_7] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin, \
+    [GLYPH_8] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_9] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_A] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_B] = DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_C] = DISPLAY_A_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin, \
+    [GLYPH_D] = DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_G_Pin, \
+    [GLYPH_E] = DISPLAY_A_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_F] = DISPLAY_A_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_BLANK] = 0, \
+    [GLYPH_MINUS] = DISPLAY_G_Pin, \
+    [GLYPH_H] = DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_L] = DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin, \
+    [GLYPH_N] = DISPLAY_C_Pin | DISPLAY_E_Pin | DISPLAY_G_Pin, \
+    [GLYPH_O] = DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_G_Pin, \
+    [GLYPH_P] = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin, \
+    [GLYPH_R] = DISPLAY_E_Pin | DISPLAY_G_Pin, \
+    [GLYPH_U] = DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin \
+  }
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __GLYPHS_H */
@@ -32,16 +32,35 @@ extern "C" {
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "profiler.h"
 
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
+/* Slots of profilerStats, one per profiled handler or critical section */
+enum ProfilerSlot {
+  PROFILE_SYSTICK,
+  PROFILE_EXTI0,
+  PROFILE_EXTI1,
+  PROFILE_TIM1_UP,
+  PROFILE_TIM2,
+  PROFILE_DMA1_CHANNEL3,
+  PROFILE_BUTTON_EVENTS,
+  PROFILER_SLOTS_COUNT
+};
+_Static_assert(PROFILER_SLOTS_COUNT <= PROFILER_SLOTS_MAX_COUNT, "profilerStats has no room for every slot");
 
 /* USER CODE END ET */
 
 /* Exported constants --------------------------------------------------------*/
 /* USER CODE BEGIN EC */
+/* Display backends, DISPLAY_MODE selects one at build time */
+#define DISPLAY_BINARY 0 /* value in binary on PA0-PA11 */
+#define DISPLAY_DECIMAL 1 /* multiplexed 4-digit 7-segment display on PA0-PA10 */
+#ifndef DISPLAY_MODE
+#define DISPLAY_MODE DISPLAY_BINARY
+#endif
 
 /* USER CODE END EC */
 
@@ -59,6 +78,19 @@ void Error_Handler(void);
 
 /* Private defines -----------------------------------------------------------*/
 /* USER CODE BEGIN Private defines */
+/* Pins of the DISPLAY_DECIMAL display. Segments are lit on low level, the
+   digits, 1 the leftmost, are selected on high level */
+#define DISPLAY_A_Pin GPIO_PIN_0
+#define DISPLAY_B_Pin GPIO_PIN_1
+#define DISPLAY_C_Pin GPIO_PIN_2
+#define DISPLAY_D_Pin GPIO_PIN_3
+#define DISPLAY_E_Pin GPIO_PIN_4
+#define DISPLAY_F_Pin GPIO_PIN_5
+#define DISPLAY_G_Pin GPIO_PIN_6
+#define DISPLAY_1_Pin GPIO_PIN_7
+#define DISPLAY_2_Pin GPIO_PIN_8
+#define DISPLAY_3_Pin GPIO_PIN_9
+#define DISPLAY_4_Pin GPIO_PIN_10
 
 /* USER CODE END Private defines */
 
@@ -0,0 +1,67 @@
+/**
+  ******************************************************************************
+  * @file           : profiler.h
+  * @brief          : Header for profiler.c file.
+  *                   ISR and critical section timing on the DWT cycle counter.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PROFILER_H
+#define __PROFILER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define PROFILER_SLOTS_MAX_COUNT 8
+/* Must be a power of two */
+#define PROFILER_TRACE_LENGTH 16
+/* Longest line of FormatProfilerLine: the slot, then count, min, max and
+   average cycles of up to ten digits each, and the line end */
+#define PROFILER_LINE_LENGTH 50
+
+/* Exported types ------------------------------------------------------------*/
+struct ProfilerStats
+{
+  uint32_t count;
+  uint32_t minCycles;
+  uint32_t maxCycles;
+  uint64_t totalCycles;
+};
+
+struct ProfilerSample
+{
+  uint32_t startCycle;
+  uint32_t cycles;
+  uint8_t slot;
+};
+
+/* Exported variables --------------------------------------------------------*/
+/* Read from the debugger or dumped with FormatProfilerLine, the average is
+   totalCycles / count */
+extern struct ProfilerStats profilerStats[PROFILER_SLOTS_MAX_COUNT];
+extern struct ProfilerSample profilerTrace[PROFILER_TRACE_LENGTH];
+extern uint32_t profilerTraceHead;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void InitProfiler(void);
+void ResetProfiler(void);
+void EndProfile(const uint8_t slot, const uint32_t startCycle);
+uint8_t FormatProfilerLine(const uint8_t slot, char *line);
+
+/* Exported inline functions -------------------------------------------------*/
+static inline uint32_t BeginProfile(void)
+{
+  return DWT->CYCCNT;
+}
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PROFILER_H */
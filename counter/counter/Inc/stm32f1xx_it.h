@@ -60,6 +60,7 @@ void EXTI0_IRQHandler(void);
 void EXTI1_IRQHandler(void);
 void TIM1_UP_IRQHandler(void);
 void TIM2_IRQHandler(void);
+void DMA1_Channel3_IRQHandler(void);
 /* USER CODE BEGIN EFP */
 
 /* USER CODE END EFP */
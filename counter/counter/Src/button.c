@@ -0,0 +1,125 @@
+/**
+  ******************************************************************************
+  * @file           : button.c
+  * @brief          : Debounced push buttons with click classification.
+  *
+  *                   HandleButtonEdge is called from the EXTI callback once
+  *                   the pending bit is cleared and only timestamps the edge.
+  *                   UpdateButtons runs from SysTick: it samples a pin once
+  *                   it has been quiet for BUTTON_DEBOUNCE_TIME, classifies
+  *                   the press and publishes the events into a flag word that
+  *                   the application drains with TakeButtonEvents.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "button.h"
+#include "board.h"
+
+/* Private variables ---------------------------------------------------------*/
+struct Button *registeredButtons;
+uint8_t registeredButtonsCount;
+volatile uint32_t buttonEvents;
+
+/* Private function prototypes -----------------------------------------------*/
+void PublishButtonEvents(const uint8_t button, const uint32_t events);
+
+/* Private user code ---------------------------------------------------------*/
+void InitButtons(struct Button *buttons, uint8_t count)
+{
+  registeredButtons = buttons;
+  registeredButtonsCount = (count < BUTTONS_MAX_COUNT) ? count : BUTTONS_MAX_COUNT;
+  for (uint8_t i = 0; i < registeredButtonsCount; ++i)
+  {
+    buttons[i].isPressed = FastReadPin(buttons[i].port, buttons[i].pin) == buttons[i].pressedState;
+    buttons[i].isEdgePending = false;
+    buttons[i].isLongPressReported = buttons[i].isPressed;
+    buttons[i].clicksCount = 0;
+  }
+}
+
+void HandleButtonEdge(uint16_t GPIO_Pin)
+{
+  for (uint8_t i = 0; i < registeredButtonsCount; ++i)
+  {
+    if (registeredButtons[i].pin == GPIO_Pin)
+    {
+      registeredButtons[i].edgeTick = HAL_GetTick();
+      registeredButtons[i].isEdgePending = true;
+    }
+  }
+}
+
+void UpdateButtons(void)
+{
+  const uint32_t now = HAL_GetTick();
+  for (uint8_t i = 0; i < registeredButtonsCount; ++i)
+  {
+    struct Button *button = &registeredButtons[i];
+    if (button->isEdgePending && (now - button->edgeTick >= BUTTON_DEBOUNCE_TIME))
+    {
+      button->isEdgePending = false;
+      const bool isPressed = FastReadPin(button->port, button->pin) == button->pressedState;
+      if (isPressed && !button->isPressed)
+      {
+        button->isPressed = true;
+        button->isLongPressReported = false;
+        button->pressTick = now;
+        PublishButtonEvents(i, BUTTON_PRESSED);
+      }
+      else if (!isPressed && button->isPressed)
+      {
+        button->isPressed = false;
+        button->releaseTick = now;
+        if (!button->isLongPressReported)
+        {
+          ++button->clicksCount;
+        }
+        PublishButtonEvents(i, BUTTON_RELEASED);
+      }
+    }
+    if (button->isPressed && !button->isLongPressReported && (now - button->pressTick >= BUTTON_LONG_PRESS_TIME))
+    {
+      button->isLongPressReported = true;
+      button->clicksCount = 0;
+      PublishButtonEvents(i, BUTTON_LONG_PRESS);
+    }
+    if (!button->isPressed && (button->clicksCount > 0) && (now - button->releaseTick >= BUTTON_DOUBLE_CLICK_TIME))
+    {
+      PublishButtonEvents(i, (button->clicksCount == 1) ? BUTTON_CLICK : BUTTON_DOUBLE_CLICK);
+      button->clicksCount = 0;
+    }
+  }
+}
+
+void PublishButtonEvents(const uint8_t button, const uint32_t events)
+{
+  uint32_t value;
+  do
+  {
+    value = __LDREXW(&buttonEvents);
+  } while (__STREXW(value | (events << (8 * button)), &buttonEvents) != 0);
+}
+
+uint32_t TakeButtonEvents(void)
+{
+  uint32_t value;
+  do
+  {
+    value = __LDREXW(&buttonEvents);
+  } while (__STREXW(0, &buttonEvents) != 0);
+  return value;
+}
+
+bool AreButtonsIdle(void)
+{
+  for (uint8_t i = 0; i < registeredButtonsCount; ++i)
+  {
+    const struct Button *button = &registeredButtons[i];
+    if (button->isEdgePending || button->isPressed || (button->clicksCount > 0))
+    {
+      return false;
+    }
+  }
+  return buttonEvents == 0;
+}
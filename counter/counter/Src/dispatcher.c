@@ -0,0 +1,144 @@
+/**
+  ******************************************************************************
+  * @file           : dispatcher.c
+  * @brief          : Timer interrupt dispatch over the enabled sources only.
+  *
+  *                   DispatchTimerInterrupt stands in for HAL_TIM_IRQHandler.
+  *                   Instead of testing the eight flags of a timer in turn,
+  *                   it reads the flags that are both raised and enabled in
+  *                   one go, clears them with a single store and walks the
+  *                   set bits with CLZ through a table of event handlers.
+  *                   The events are served in the order of the HAL: the
+  *                   channels from 1 to 4, then update, break, trigger and
+  *                   commutation. The handlers call the same callbacks as
+  *                   the HAL, the ones registered in the handle when
+  *                   USE_HAL_TIM_REGISTER_CALLBACKS is set.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "dispatcher.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Event flags share their bit positions in SR and DIER, DIER bits above
+   them enable DMA requests and SR bits above them flag overcaptures */
+#define TIMER_CHANNEL_EVENTS_MASK (TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF)
+/* Break, trigger and commutation sit above the channels in that order from the top */
+#define TIMER_CONTROL_EVENTS_MASK (TIM_SR_BIF | TIM_SR_TIF | TIM_SR_COMIF)
+#define TIMER_EVENTS_MASK (TIMER_CHANNEL_EVENTS_MASK | TIM_SR_UIF | TIMER_CONTROL_EVENTS_MASK)
+
+/* Private typedef -----------------------------------------------------------*/
+typedef void (*TimerEventHandler)(TIM_HandleTypeDef *htim, const uint32_t event);
+
+/* Private function prototypes -----------------------------------------------*/
+void HandleUpdateEvent(TIM_HandleTypeDef *htim, const uint32_t event);
+void HandleCaptureCompareEvent(TIM_HandleTypeDef *htim, const uint32_t event);
+void HandleCommutationEvent(TIM_HandleTypeDef *htim, const uint32_t event);
+void HandleTriggerEvent(TIM_HandleTypeDef *htim, const uint32_t event);
+void HandleBreakEvent(TIM_HandleTypeDef *htim, const uint32_t event);
+
+/* Private constants ---------------------------------------------------------*/
+const TimerEventHandler TIMER_EVENT_HANDLERS[] =
+{
+  [TIM_SR_UIF_Pos] = HandleUpdateEvent,
+  [TIM_SR_CC1IF_Pos] = HandleCaptureCompareEvent,
+  [TIM_SR_CC2IF_Pos] = HandleCaptureCompareEvent,
+  [TIM_SR_CC3IF_Pos] = HandleCaptureCompareEvent,
+  [TIM_SR_CC4IF_Pos] = HandleCaptureCompareEvent,
+  [TIM_SR_COMIF_Pos] = HandleCommutationEvent,
+  [TIM_SR_TIF_Pos] = HandleTriggerEvent,
+  [TIM_SR_BIF_Pos] = HandleBreakEvent
+};
+
+/* Private user code ---------------------------------------------------------*/
+void DispatchTimerInterrupt(TIM_HandleTypeDef *htim)
+{
+  TIM_TypeDef *tim = htim->Instance;
+  const uint32_t events = tim->SR & tim->DIER & TIMER_EVENTS_MASK;
+  /* The flags are cleared by writing zeros, ones leave them alone */
+  tim->SR = ~events;
+  /* Lowest channel first, CLZ of the reversed bits finds the lowest one */
+  uint32_t channelEvents = events & TIMER_CHANNEL_EVENTS_MASK;
+  while (channelEvents != 0)
+  {
+    const uint32_t position = __CLZ(__RBIT(channelEvents));
+    channelEvents &= ~(1UL << position);
+    TIMER_EVENT_HANDLERS[position](htim, 1UL << position);
+  }
+  if ((events & TIM_SR_UIF) != 0)
+  {
+    TIMER_EVENT_HANDLERS[TIM_SR_UIF_Pos](htim, TIM_SR_UIF);
+  }
+  uint32_t controlEvents = events & TIMER_CONTROL_EVENTS_MASK;
+  while (controlEvents != 0)
+  {
+    const uint32_t position = 31U - __CLZ(controlEvents);
+    controlEvents &= ~(1UL << position);
+    TIMER_EVENT_HANDLERS[position](htim, 1UL << position);
+  }
+}
+
+void HandleUpdateEvent(TIM_HandleTypeDef *htim, const uint32_t event)
+{
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+  htim->PeriodElapsedCallback(htim);
+#else
+  HAL_TIM_PeriodElapsedCallback(htim);
+#endif
+}
+
+void HandleCaptureCompareEvent(TIM_HandleTypeDef *htim, const uint32_t event)
+{
+  /* CC1IF..CC4IF are one bit above HAL_TIM_ACTIVE_CHANNEL_1..4. The CCxS
+     field of channels 1 and 3 is at the bottom of CCMR1 and CCMR2, the
+     one of channels 2 and 4 eight bits up */
+  const uint32_t ccmr = ((event & (TIM_SR_CC1IF | TIM_SR_CC2IF)) != 0) ? htim->Instance->CCMR1 : htim->Instance->CCMR2;
+  const uint32_t shift = ((event & (TIM_SR_CC2IF | TIM_SR_CC4IF)) != 0) ? 8U : 0U;
+  htim->Channel = (HAL_TIM_ActiveChannel)(event >> 1);
+  if (((ccmr >> shift) & TIM_CCMR1_CC1S) != 0)
+  {
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+    htim->IC_CaptureCallback(htim);
+#else
+    HAL_TIM_IC_CaptureCallback(htim);
+#endif
+  }
+  else
+  {
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+    htim->OC_DelayElapsedCallback(htim);
+    htim->PWM_PulseFinishedCallback(htim);
+#else
+    HAL_TIM_OC_DelayElapsedCallback(htim);
+    HAL_TIM_PWM_PulseFinishedCallback(htim);
+#endif
+  }
+  htim->Channel = HAL_TIM_ACTIVE_CHANNEL_CLEARED;
+}
+
+void HandleCommutationEvent(TIM_HandleTypeDef *htim, const uint32_t event)
+{
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+  htim->CommutationCallback(htim);
+#else
+  HAL_TIMEx_CommutCallback(htim);
+#endif
+}
+
+void HandleTriggerEvent(TIM_HandleTypeDef *htim, const uint32_t event)
+{
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+  htim->TriggerCallback(htim);
+#else
+  HAL_TIM_TriggerCallback(htim);
+#endif
+}
+
+void HandleBreakEvent(TIM_HandleTypeDef *htim, const uint32_t event)
+{
+#if (USE_HAL_TIM_REGISTER_CALLBACKS == 1)
+  htim->BreakCallback(htim);
+#else
+  HAL_TIMEx_BreakCallback(htim);
+#endif
+}
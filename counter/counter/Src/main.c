@@ -20,21 +20,95 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "button.h"
+#include "storage.h"
+#include "recorder.h"
+#include "board.h"
+#include "ports.h"
+#include "clock.h"
+#include "glyphs.h"
+#include "power.h"
 #include <stdbool.h>
 
+/* Private define ------------------------------------------------------------*/
+#define DISPLAY_DIGITS_COUNT 4
+
+/* Private typedef -----------------------------------------------------------*/
+/* Auto-repeat rate once the button has been auto-repeating for hold_time ms */
+struct repeat_rate {
+  uint32_t hold_time;
+  uint16_t period;
+  uint16_t step;
+};
+
 /* Private variables ---------------------------------------------------------*/
 TIM_HandleTypeDef long_press_timer;
 TIM_HandleTypeDef increment_timer;
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+TIM_HandleTypeDef display_timer;
+DMA_HandleTypeDef display_dma;
+#endif
 
 
 uint32_t displayed_number = 0;
+/* Last value written to flash, saved again only once the counter is idle */
+uint32_t saved_number = 0;
+enum { STORAGE_DISPLAYED_NUMBER };
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+/* Largest value the four digits show */
+const uint32_t MAX_DISPLAYED_NUMBER = 9999;
+#else
 const uint32_t MAX_DISPLAYED_NUMBER = 0xD4A;
+#endif
 const uint16_t LONG_PRESS_TIME = 3000;
 const uint16_t NUMBER_INCREMENT_TIME = 1000;
-const uint16_t INCREMENT_PIN = GPIO_PIN_0,
-  RESET_PIN = GPIO_PIN_1,
-  OVERFLOW_SIGNAL_PIN = GPIO_PIN_7;
+/* Timer ticks, kept across clock profile switches */
+const uint32_t TIMER_TICK_FREQUENCY = 1000;
+const uint32_t DISPLAY_TIMER_TICK_FREQUENCY = 1000000;
+const uint16_t OVERFLOW_SIGNAL_PIN = GPIO_PIN_7;
 bool long_press_timer_reached_timeout = false;
+/* Indices match the bit groups of TakeButtonEvents */
+enum { INCREMENT_BUTTON, RESET_BUTTON, BUTTONS_COUNT };
+struct Button buttons[BUTTONS_COUNT] = {
+  { .port = GPIOB, .pin = GPIO_PIN_0, .pressedState = GPIO_PIN_RESET },
+  { .port = GPIOB, .pin = GPIO_PIN_1, .pressedState = GPIO_PIN_RESET }
+};
+const struct BusSegment DISPLAY_BUS[] = {
+  { GPIOA, GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3
+          |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7
+          |GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11, 0, 0 }
+};
+/* Display bus and overflow signal outputs, pin lists generated from
+   counter.ioc by tools/ports.py */
+const struct PortConfig PORT_A_CONFIG = PORT_CONFIG(PORT_A_OUTPUT_PINS, PORT_A_HIGH_PINS);
+const struct PortConfig PORT_B_CONFIG = PORT_CONFIG(PORT_B_OUTPUT_PINS, PORT_B_HIGH_PINS);
+const uint8_t DISPLAY_BUS_SEGMENTS_COUNT = sizeof(DISPLAY_BUS) / sizeof(DISPLAY_BUS[0]);
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+/* The DISPLAY_x_Pin map is in main.h, digits go units first */
+const uint16_t DISPLAY_SEGMENT_PINS = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin
+                                    | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
+const uint16_t DISPLAY_DIGIT_PINS[DISPLAY_DIGITS_COUNT] = { DISPLAY_4_Pin, DISPLAY_3_Pin, DISPLAY_2_Pin, DISPLAY_1_Pin };
+/* Segment pins lit for every glyph, the decimal digits map onto their own values */
+const uint16_t GLYPH_PINS[GLYPH_COUNT] = GLYPH_PINS_TABLE;
+/* displayed_number in BCD, units first, kept in step with it by carries */
+uint8_t displayed_digits[DISPLAY_DIGITS_COUNT];
+/* GPIOA BSRR words streamed by DMA on every TIM3 update, one per digit.
+   DMA reads the front frame while the back one is written */
+uint32_t display_frames[2][DISPLAY_DIGITS_COUNT];
+uint8_t front_frame = 0;
+#endif
+/* Sorted by hold_time; sweeps the binary range in about ten seconds and
+   the decimal one in about thirteen */
+const struct repeat_rate REPEAT_RATE_CURVE[] = {
+  { 0, 1000, 1 },
+  { 3000, 250, 1 },
+  { 5000, 100, 1 },
+  { 7000, 20, 5 },
+  { 9000, 10, 25 }
+};
+const uint8_t REPEAT_RATE_CURVE_LENGTH = sizeof(REPEAT_RATE_CURVE) / sizeof(REPEAT_RATE_CURVE[0]);
+uint8_t repeat_stage = 0;
+uint32_t repeat_elapsed = 0;
 
 
 /* Private function prototypes -----------------------------------------------*/
@@ -42,11 +116,32 @@ void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
 static void MX_TIM1_Init(void);
 static void MX_TIM2_Init(void);
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+static void MX_DMA_Init(void);
+static void MX_TIM3_Init(void);
+void StartDisplayRefresh(void);
+void SetDisplayDigits(uint32_t value);
+void AddToDisplayDigits(uint32_t step);
+void UpdateDisplayFrame(void);
+void SwapDisplayFrame(DMA_HandleTypeDef *hdma);
+#endif
 
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin);
+void HAL_SYSTICK_Callback(void);
+void HandleButtonEvents(uint32_t events);
 void IncrementDisplay(void);
+void AddToDisplay(uint32_t step);
 void ResetDisplay(void);
+void RestartTimerIT(TIM_HandleTypeDef *htim);
+void StartAutoRepeat(void);
+void StopAutoRepeat(void);
+void AdvanceAutoRepeat(void);
+void ShowDisplayedNumber(void);
+bool IsCounterIdle(void);
+void EnterLowPowerMode(void);
+void LoadDisplayedNumber(void);
+void SaveDisplayedNumber(void);
 
 /* Private user code ---------------------------------------------------------*/
 
@@ -60,10 +155,43 @@ int main(void)
   HAL_Init(); 
   /* Configure the system clock */
   SystemClock_Config();
+  InitProfiler();
+  InitRecorder();
+  InitStopClock();
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
   MX_TIM1_Init();
   MX_TIM2_Init();
+  RegisterScaledTimer(&long_press_timer, TIMER_TICK_FREQUENCY);
+  RegisterScaledTimer(&increment_timer, TIMER_TICK_FREQUENCY);
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+  MX_DMA_Init();
+  MX_TIM3_Init();
+  RegisterScaledTimer(&display_timer, DISPLAY_TIMER_TICK_FREQUENCY);
+  StartDisplayRefresh();
+#endif
+  InitButtons(buttons, BUTTONS_COUNT);
+  if (InitStorage() != HAL_OK) {
+    Error_Handler();
+  }
+  LoadDisplayedNumber();
+
+  while (true) {
+    const uint32_t events = TakeButtonEvents();
+    if (events != 0) {
+      /* The timer callbacks touch the same state */
+      __disable_irq();
+      const uint32_t profile_start = BeginProfile();
+      HandleButtonEvents(events);
+      EndProfile(PROFILE_BUTTON_EVENTS, profile_start);
+      __enable_irq();
+    }
+    if ((displayed_number != saved_number) && IsCounterIdle()) {
+      SaveDisplayedNumber();
+    }
+    UpdateSleepStats();
+    EnterLowPowerMode();
+  }
 }
 
 /**
@@ -72,29 +200,7 @@ int main(void)
   */
 void SystemClock_Config(void)
 {
-  RCC_OscInitTypeDef RCC_OscInitStruct = {0};
-  RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
-
-  /** Initializes the CPU, AHB and APB busses clocks 
-  */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
-  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
-  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
-  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
-  if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
-  {
-    Error_Handler();
-  }
-  /** Initializes the CPU, AHB and APB busses clocks 
-  */
-  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
-                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
-  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
-  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
-  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
-
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
+  if (SetClockProfile(CLOCK_PROFILE_LOW_POWER) != HAL_OK)
   {
     Error_Handler();
   }
@@ -111,7 +217,7 @@ static void MX_TIM1_Init(void)
   TIM_MasterConfigTypeDef sMasterConfig = {0};
 
   long_press_timer.Instance = TIM1;
-  long_press_timer.Init.Prescaler = 8000-1;
+  long_press_timer.Init.Prescaler = GetTimerPrescaler(TIM1, TIMER_TICK_FREQUENCY);
   long_press_timer.Init.CounterMode = TIM_COUNTERMODE_UP;
   long_press_timer.Init.Period = 3000;
   long_press_timer.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
@@ -145,7 +251,7 @@ static void MX_TIM2_Init(void)
   TIM_MasterConfigTypeDef sMasterConfig = {0};
 
   increment_timer.Instance = TIM2;
-  increment_timer.Init.Prescaler = 8000-1;
+  increment_timer.Init.Prescaler = GetTimerPrescaler(TIM2, TIMER_TICK_FREQUENCY);
   increment_timer.Init.CounterMode = TIM_COUNTERMODE_UP;
   increment_timer.Init.Period = 1000;
   increment_timer.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
@@ -167,6 +273,58 @@ static void MX_TIM2_Init(void)
   }
 }
 
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+/**
+  * @brief TIM3 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_TIM3_Init(void)
+{
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+
+  /* One digit per millisecond */
+  display_timer.Instance = TIM3;
+  display_timer.Init.Prescaler = GetTimerPrescaler(TIM3, DISPLAY_TIMER_TICK_FREQUENCY);
+  display_timer.Init.CounterMode = TIM_COUNTERMODE_UP;
+  display_timer.Init.Period = 1000-1;
+  display_timer.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  display_timer.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&display_timer) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&display_timer, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_RESET;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  if (HAL_TIMEx_MasterConfigSynchronization(&display_timer, &sMasterConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+  * @brief DMA Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_DMA_Init(void)
+{
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Channel3_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel3_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel3_IRQn);
+}
+#endif
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -180,24 +338,8 @@ static void MX_GPIO_Init(void)
   __HAL_RCC_GPIOA_CLK_ENABLE();
   __HAL_RCC_GPIOB_CLK_ENABLE();
 
-  /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(GPIOA, GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                          |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7 
-                          |GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11, GPIO_PIN_RESET);
-
-  /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_7, GPIO_PIN_RESET);
-
-  /*Configure GPIO pins : PA0 PA1 PA2 PA3 
-                           PA4 PA5 PA6 PA7 
-                           PA8 PA9 PA10 PA11 */
-  GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                          |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7 
-                          |GPIO_PIN_8|GPIO_PIN_9|GPIO_PIN_10|GPIO_PIN_11;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
+  ConfigurePort(GPIOA, &PORT_A_CONFIG);
+  ConfigurePort(GPIOB, &PORT_B_CONFIG);
 
   /*Configure GPIO pin : PB0 */
   GPIO_InitStruct.Pin = GPIO_PIN_0;
@@ -207,15 +349,8 @@ static void MX_GPIO_Init(void)
 
   /*Configure GPIO pin : PB1 */
   GPIO_InitStruct.Pin = GPIO_PIN_1;
-  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-  /*Configure GPIO pin : PB7 */
-  GPIO_InitStruct.Pin = GPIO_PIN_7;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
   HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
 
   /* EXTI interrupt init*/
@@ -232,70 +367,233 @@ static void MX_GPIO_Init(void)
 void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
 {
   if (htim == &long_press_timer) {
-    HAL_TIM_Base_Start_IT(&increment_timer);
-    HAL_TIM_Base_Stop_IT(&long_press_timer);
+    StartAutoRepeat();
+    FastStopTimerIT(&long_press_timer);
     long_press_timer_reached_timeout = true;
   } else if (htim == &increment_timer) {
-    IncrementDisplay();
+    AdvanceAutoRepeat();
   }
 }
 
 void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
 {
-  if (GPIO_Pin == INCREMENT_PIN) {
-    /* Increment button */
-    if (HAL_GPIO_ReadPin(GPIOB, INCREMENT_PIN) == GPIO_PIN_RESET) {
-      /* Button was pressed */
-      HAL_TIM_Base_Start_IT(&long_press_timer);
+  RecordEvent(POSITION_VAL(GPIO_Pin), FastReadPin(GPIOB, GPIO_Pin) == GPIO_PIN_SET);
+  HandleButtonEdge(GPIO_Pin);
+}
+
+void HAL_SYSTICK_Callback(void)
+{
+  UpdateButtons();
+}
+
+void HandleButtonEvents(uint32_t events)
+{
+  const uint32_t increment_events = BUTTON_EVENTS(events, INCREMENT_BUTTON);
+  if (increment_events & BUTTON_PRESSED) {
+    RestartTimerIT(&long_press_timer);
+  }
+  if (increment_events & BUTTON_RELEASED) {
+    if (!long_press_timer_reached_timeout) {
+      FastStopTimerIT(&long_press_timer);
+      IncrementDisplay();
     } else {
-      /* Button was released */
-      if (!long_press_timer_reached_timeout) {
-        HAL_TIM_Base_Stop_IT(&long_press_timer);
-        IncrementDisplay();
-      } else {
-        long_press_timer_reached_timeout = false;
-      }
+      StopAutoRepeat();
+      long_press_timer_reached_timeout = false;
     }
-  } else if (GPIO_Pin == RESET_PIN) {
-    /* Reset button was pressed */
+  }
+  if (BUTTON_EVENTS(events, RESET_BUTTON) & BUTTON_PRESSED) {
     ResetDisplay();
   }
 }
 
 void IncrementDisplay(void)
 {
-  displayed_number = (displayed_number + 1) % (MAX_DISPLAYED_NUMBER + 1);
-  if (displayed_number == 0) {
-    HAL_GPIO_WritePin(GPIOB, OVERFLOW_SIGNAL_PIN, GPIO_PIN_SET);
-  } else if (displayed_number == 1) {
-    HAL_GPIO_WritePin(GPIOB, OVERFLOW_SIGNAL_PIN, GPIO_PIN_RESET);
-  }
+  AddToDisplay(1);
+}
 
-  uint16_t cur_number_pin = GPIO_PIN_0;
-  uint32_t shifted_displayed_number = displayed_number;
-  const uint8_t number_pins_count = 12;
-  for (uint8_t i = 0; i < number_pins_count; ++i) {
-    HAL_GPIO_WritePin(GPIOA, cur_number_pin, shifted_displayed_number % 2 == 0 ? GPIO_PIN_RESET : GPIO_PIN_SET);
-    cur_number_pin <<= 1;
-    shifted_displayed_number >>= 1;
+void AddToDisplay(uint32_t step)
+{
+  displayed_number += step;
+  if (displayed_number > MAX_DISPLAYED_NUMBER) {
+    displayed_number %= MAX_DISPLAYED_NUMBER + 1;
+    FastWritePin(GPIOB, OVERFLOW_SIGNAL_PIN, GPIO_PIN_SET);
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+    SetDisplayDigits(displayed_number);
+#endif
+  } else {
+    FastWritePin(GPIOB, OVERFLOW_SIGNAL_PIN, GPIO_PIN_RESET);
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+    AddToDisplayDigits(step);
+#endif
   }
+
+  ShowDisplayedNumber();
 }
 void ResetDisplay(void)
 {
-  HAL_TIM_Base_Stop_IT(&long_press_timer);
-  HAL_TIM_Base_Stop_IT(&increment_timer);
-  HAL_GPIO_WritePin(GPIOB, OVERFLOW_SIGNAL_PIN, GPIO_PIN_RESET);
+  FastStopTimerIT(&long_press_timer);
+  StopAutoRepeat();
+  FastWritePin(GPIOB, OVERFLOW_SIGNAL_PIN, GPIO_PIN_RESET);
   displayed_number = 0;
   long_press_timer_reached_timeout = false;
 
-  uint16_t cur_number_pin = GPIO_PIN_0;
-  const uint8_t number_pins_count = 12;
-  for (uint8_t i = 0; i < number_pins_count; ++i) {
-    HAL_GPIO_WritePin(GPIOA, cur_number_pin, GPIO_PIN_RESET);
-    cur_number_pin <<= 1;
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+  SetDisplayDigits(0);
+#endif
+  ShowDisplayedNumber();
+}
+
+/* Counts a whole period from now. The update flag may be left over from
+   the UG of HAL_TIM_Base_Init or from an update the stop raced with, and
+   would fire at once */
+void RestartTimerIT(TIM_HandleTypeDef *htim)
+{
+  __HAL_TIM_SET_COUNTER(htim, 0);
+  __HAL_TIM_CLEAR_IT(htim, TIM_IT_UPDATE);
+  FastStartTimerIT(htim);
+}
+
+void StartAutoRepeat(void)
+{
+  repeat_stage = 0;
+  repeat_elapsed = 0;
+  __HAL_TIM_SET_AUTORELOAD(&increment_timer, REPEAT_RATE_CURVE[0].period - 1);
+  RestartTimerIT(&increment_timer);
+}
+
+void StopAutoRepeat(void)
+{
+  FastStopTimerIT(&increment_timer);
+}
+
+void AdvanceAutoRepeat(void)
+{
+  AddToDisplay(REPEAT_RATE_CURVE[repeat_stage].step);
+  repeat_elapsed += REPEAT_RATE_CURVE[repeat_stage].period;
+  if ((repeat_stage + 1 < REPEAT_RATE_CURVE_LENGTH)
+      && (repeat_elapsed >= REPEAT_RATE_CURVE[repeat_stage + 1].hold_time)) {
+    ++repeat_stage;
+    /* ARR is not preloaded, so the new period applies from this update on */
+    __HAL_TIM_SET_AUTORELOAD(&increment_timer, REPEAT_RATE_CURVE[repeat_stage].period - 1);
+  }
+}
+
+void ShowDisplayedNumber(void)
+{
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+  UpdateDisplayFrame();
+#else
+  WriteBus(DISPLAY_BUS, DISPLAY_BUS_SEGMENTS_COUNT, displayed_number);
+#endif
+}
+
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+void StartDisplayRefresh(void)
+{
+  display_dma.XferCpltCallback = SwapDisplayFrame;
+  HAL_DMA_Start(&display_dma, (uint32_t)display_frames[front_frame], (uint32_t)&GPIOA->BSRR, DISPLAY_DIGITS_COUNT);
+  __HAL_TIM_ENABLE_DMA(&display_timer, TIM_DMA_UPDATE);
+  __HAL_TIM_ENABLE(&display_timer);
+}
+
+/* Only used when the value jumps, counting goes through AddToDisplayDigits */
+void SetDisplayDigits(uint32_t value)
+{
+  for (uint8_t i = 0; i < DISPLAY_DIGITS_COUNT; ++i) {
+    displayed_digits[i] = value % 10;
+    value /= 10;
   }
 }
 
+/* Ripple-carry add, the loops are bounded by the largest auto-repeat step */
+void AddToDisplayDigits(uint32_t step)
+{
+  uint32_t carry = step;
+  for (uint8_t i = 0; (i < DISPLAY_DIGITS_COUNT) && (carry != 0); ++i) {
+    uint32_t digit = displayed_digits[i] + carry;
+    carry = 0;
+    while (digit > 9) {
+      digit -= 10;
+      ++carry;
+    }
+    displayed_digits[i] = digit;
+  }
+}
+
+void UpdateDisplayFrame(void)
+{
+  const uint16_t digit_pins = DISPLAY_DIGIT_PINS[0] | DISPLAY_DIGIT_PINS[1] | DISPLAY_DIGIT_PINS[2] | DISPLAY_DIGIT_PINS[3];
+  /* No swap while the back frame is half written */
+  __HAL_DMA_DISABLE_IT(&display_dma, DMA_IT_TC);
+  uint32_t *frame = display_frames[front_frame ^ 1];
+  for (uint8_t i = 0; i < DISPLAY_DIGITS_COUNT; ++i) {
+    const uint16_t segments = GLYPH_PINS[GLYPH_0 + displayed_digits[i]];
+    const uint16_t set_pins = DISPLAY_DIGIT_PINS[i] | (DISPLAY_SEGMENT_PINS & ~segments);
+    const uint16_t reset_pins = (digit_pins & ~DISPLAY_DIGIT_PINS[i]) | segments;
+    frame[i] = ((uint32_t)reset_pins << 16) | set_pins;
+  }
+  /* A stale flag would swap mid-scan, wait for the next end of frame */
+  __HAL_DMA_CLEAR_FLAG(&display_dma, __HAL_DMA_GET_TC_FLAG_INDEX(&display_dma));
+  __HAL_DMA_ENABLE_IT(&display_dma, DMA_IT_TC);
+}
+
+/* Transfer complete callback, runs between two frames while CNDTR is reloaded */
+void SwapDisplayFrame(DMA_HandleTypeDef *hdma)
+{
+  front_frame ^= 1;
+  __HAL_DMA_DISABLE(hdma);
+  hdma->Instance->CMAR = (uint32_t)display_frames[front_frame];
+  __HAL_DMA_ENABLE(hdma);
+  __HAL_DMA_DISABLE_IT(hdma, DMA_IT_TC);
+}
+#endif
+
+void LoadDisplayedNumber(void)
+{
+  uint32_t value;
+  if (ReadStorageValue(STORAGE_DISPLAYED_NUMBER, &value) && (value <= MAX_DISPLAYED_NUMBER)) {
+    displayed_number = value;
+    saved_number = value;
+  }
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+  SetDisplayDigits(displayed_number);
+#endif
+  ShowDisplayedNumber();
+}
+
+void SaveDisplayedNumber(void)
+{
+  /* Flash programming stalls the core, so this never runs while a timer
+     is counting. A failed save is retried from the main loop */
+  if (WriteStorageValue(STORAGE_DISPLAYED_NUMBER, displayed_number) != HAL_OK) {
+    Error_Handler();
+    return;
+  }
+  saved_number = displayed_number;
+}
+
+bool IsCounterIdle(void)
+{
+  return ((long_press_timer.Instance->CR1 & TIM_CR1_CEN) == 0)
+      && ((increment_timer.Instance->CR1 & TIM_CR1_CEN) == 0)
+      && AreButtonsIdle();
+}
+
+void EnterLowPowerMode(void)
+{
+  /* Checked with interrupts disabled, so a button EXTI can't start a timer
+     between the check and the WFI */
+  __disable_irq();
+  /* STOP would also freeze the multiplexed display on one digit */
+  if (IsCounterIdle() && (DISPLAY_MODE != DISPLAY_DECIMAL)) {
+    if (EnterStopMode() != HAL_OK) {
+      Error_Handler();
+    }
+  } else {
+    EnterSleepMode();
+  }
+  __enable_irq();
+}
 
 /**
   * @brief  This function is executed in case of error occurrence.
@@ -0,0 +1,168 @@
+/**
+  ******************************************************************************
+  * @file           : power.c
+  * @brief          : SLEEP and STOP entry with the share of time spent in each.
+  *
+  *                   SLEEP time is counted in SysTick cycles around the WFI.
+  *                   SysTick is frozen in STOP, so STOP time is counted by
+  *                   the RTC, which keeps running on the LSI. The LSI is
+  *                   only known to within 30 to 60 kHz, so its ticks are
+  *                   converted to ms at the rate measured against SysTick
+  *                   over the run time between two STOP entries.
+  *
+  *                   Both shares are published by UpdateSleepStats once per
+  *                   SLEEP_STATS_WINDOW ms of run time. STOP periods are
+  *                   left out of the run time, the STOP share is over the
+  *                   run time plus the STOP time of the window.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "power.h"
+#include "clock.h"
+
+/* Private define ------------------------------------------------------------*/
+/* The calibration sums are halved past this, so the rate follows the drift
+   of the LSI with temperature and the sums can't overflow */
+#define CALIBRATION_TICKS_MAX (1ULL << 32)
+
+/* Private variables ---------------------------------------------------------*/
+struct PowerStats powerStats;
+uint64_t asleepCycles;
+uint32_t sleepStatsStartTick;
+/* RTC ticks spent in STOP in the current window */
+uint32_t windowStopTicks;
+/* Fraction of a ms left over from the STOP time added to powerStats, in 16.16 */
+uint32_t stopTimeFraction;
+/* RTC ticks and SysTick ms of the run time between STOP periods */
+uint64_t calibrationTicks;
+uint64_t calibrationTime;
+uint32_t lastWakeUpTicks;
+uint32_t lastWakeUpTick;
+
+/* Private function prototypes -----------------------------------------------*/
+uint32_t ReadRtcCounter(void);
+void SynchronizeRtc(void);
+uint32_t GetRtcTickLength(void);
+
+/* Private user code ---------------------------------------------------------*/
+/* Starts the LSI and the RTC counting at its full rate. Only needed before
+   the first EnterStopMode */
+void InitStopClock(void)
+{
+  __HAL_RCC_PWR_CLK_ENABLE();
+  __HAL_RCC_BKP_CLK_ENABLE();
+  HAL_PWR_EnableBkUpAccess();
+  __HAL_RCC_LSI_ENABLE();
+  while (__HAL_RCC_GET_FLAG(RCC_FLAG_LSIRDY) == RESET)
+  {
+  }
+  __HAL_RCC_RTC_CONFIG(RCC_RTCCLKSOURCE_LSI);
+  __HAL_RCC_RTC_ENABLE();
+  SynchronizeRtc();
+  /* The prescaler is written in configuration mode, after the last write */
+  while ((RTC->CRL & RTC_CRL_RTOFF) == 0)
+  {
+  }
+  RTC->CRL |= RTC_CRL_CNF;
+  RTC->PRLH = 0;
+  RTC->PRLL = 0;
+  RTC->CRL &= ~RTC_CRL_CNF;
+  while ((RTC->CRL & RTC_CRL_RTOFF) == 0)
+  {
+  }
+}
+
+/* Must be called with interrupts disabled, the wake-up ISR runs once they are enabled back */
+void EnterSleepMode(void)
+{
+  /* A wrap already pending makes the WFI return at once, so only count one
+     that comes while asleep. The flag is read first, so a wrap between the
+     two reads counts one tick too many rather than going negative */
+  const uint32_t pendingBefore = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+  const uint32_t before = SysTick->VAL;
+  HAL_PWR_EnterSLEEPMode(PWR_MAINREGULATOR_ON, PWR_SLEEPENTRY_WFI);
+  const uint32_t after = SysTick->VAL;
+  const uint32_t pendingAfter = SCB->ICSR & SCB_ICSR_PENDSTSET_Msk;
+  /* SysTick counts down and wakes the core, so it wraps at most once while asleep */
+  const uint32_t wrap = (pendingAfter != pendingBefore) ? SysTick->LOAD + 1 : 0;
+  asleepCycles += before + wrap - after;
+}
+
+/* Must be called with interrupts disabled, the wake-up ISR runs once they are
+   enabled back. Only EXTI lines wake the core up */
+HAL_StatusTypeDef EnterStopMode(void)
+{
+  const uint32_t tick = HAL_GetTick();
+  const uint32_t before = ReadRtcCounter();
+  if (powerStats.stopCount != 0)
+  {
+    calibrationTicks += before - lastWakeUpTicks;
+    calibrationTime += tick - lastWakeUpTick;
+    if (calibrationTicks > CALIBRATION_TICKS_MAX)
+    {
+      calibrationTicks /= 2;
+      calibrationTime /= 2;
+    }
+  }
+  HAL_SuspendTick();
+  HAL_PWR_EnterSTOPMode(PWR_LOWPOWERREGULATOR_ON, PWR_STOPENTRY_WFI);
+  /* The core wakes up on HSI with the PLL off, restore the clock profile */
+  const HAL_StatusTypeDef status = RestoreClockProfile();
+  HAL_ResumeTick();
+  /* The RTC registers read stale values until resynchronized after STOP */
+  SynchronizeRtc();
+  lastWakeUpTicks = ReadRtcCounter();
+  lastWakeUpTick = tick;
+  windowStopTicks += lastWakeUpTicks - before;
+  ++powerStats.stopCount;
+  return status;
+}
+
+void UpdateSleepStats(void)
+{
+  const uint32_t elapsed = HAL_GetTick() - sleepStatsStartTick;
+  if (elapsed >= SLEEP_STATS_WINDOW)
+  {
+    powerStats.sleepPercent = (uint8_t)(asleepCycles * 100 / ((uint64_t)elapsed * (SysTick->LOAD + 1)));
+    const uint64_t stopTime = (uint64_t)windowStopTicks * GetRtcTickLength() + stopTimeFraction;
+    const uint32_t stopTimeMs = (uint32_t)(stopTime >> 16);
+    stopTimeFraction = (uint32_t)(stopTime & 0xFFFF);
+    powerStats.stopPercent = (uint8_t)((uint64_t)stopTimeMs * 100 / ((uint64_t)elapsed + stopTimeMs));
+    powerStats.stopTime += stopTimeMs;
+    asleepCycles = 0;
+    windowStopTicks = 0;
+    sleepStatsStartTick += elapsed;
+  }
+}
+
+/* The counter is split over two registers, read high again to catch a carry */
+uint32_t ReadRtcCounter(void)
+{
+  uint32_t high, low;
+  do
+  {
+    high = RTC->CNTH;
+    low = RTC->CNTL;
+  } while (high != RTC->CNTH);
+  return (high << 16) | low;
+}
+
+void SynchronizeRtc(void)
+{
+  RTC->CRL &= ~RTC_CRL_RSF;
+  while ((RTC->CRL & RTC_CRL_RSF) == 0)
+  {
+  }
+}
+
+/* In ms, in 16.16 fixed point. At the typical LSI rate until a run time
+   between two STOP periods was measured */
+uint32_t GetRtcTickLength(void)
+{
+  if (calibrationTicks == 0)
+  {
+    return (1000UL << 16) / LSI_VALUE;
+  }
+  return (uint32_t)((calibrationTime << 16) / calibrationTicks);
+}
@@ -0,0 +1,122 @@
+/**
+  ******************************************************************************
+  * @file           : profiler.c
+  * @brief          : ISR and critical section timing on the DWT cycle counter.
+  *
+  *                   A handler takes BeginProfile() on entry and passes it to
+  *                   EndProfile() on exit. Per slot min/max/total are kept in
+  *                   profilerStats and the last samples in the profilerTrace
+  *                   ring, both meant to be read from the debugger. Where a
+  *                   debugger can't be attached, FormatProfilerLine prints
+  *                   the stats of a slot as text to send out. A handler
+  *                   preempted by a higher priority one is charged for its
+  *                   time too.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "profiler.h"
+
+/* Private variables ---------------------------------------------------------*/
+struct ProfilerStats profilerStats[PROFILER_SLOTS_MAX_COUNT];
+struct ProfilerSample profilerTrace[PROFILER_TRACE_LENGTH];
+uint32_t profilerTraceHead;
+
+/* Private function prototypes -----------------------------------------------*/
+uint8_t AppendDecimal(char *text, uint32_t value);
+
+/* Private user code ---------------------------------------------------------*/
+void InitProfiler(void)
+{
+  CoreDebug->DEMCR |= CoreDebug_DEMCR_TRCENA_Msk;
+  DWT->CYCCNT = 0;
+  DWT->CTRL |= DWT_CTRL_CYCCNTENA_Msk;
+  ResetProfiler();
+}
+
+void ResetProfiler(void)
+{
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  for (uint8_t i = 0; i < PROFILER_SLOTS_MAX_COUNT; ++i)
+  {
+    profilerStats[i].count = 0;
+    profilerStats[i].minCycles = UINT32_MAX;
+    profilerStats[i].maxCycles = 0;
+    profilerStats[i].totalCycles = 0;
+  }
+  profilerTraceHead = 0;
+  __set_PRIMASK(primask);
+}
+
+void EndProfile(const uint8_t slot, const uint32_t startCycle)
+{
+  /* Unsigned difference stays right across a CYCCNT wrap */
+  const uint32_t cycles = DWT->CYCCNT - startCycle;
+  struct ProfilerStats *stats = &profilerStats[slot];
+  /* A slot belongs to one handler, which can't preempt itself */
+  ++stats->count;
+  stats->totalCycles += cycles;
+  if (cycles < stats->minCycles)
+  {
+    stats->minCycles = cycles;
+  }
+  if (cycles > stats->maxCycles)
+  {
+    stats->maxCycles = cycles;
+  }
+
+  /* The trace is shared between priorities, claim the entry atomically */
+  uint32_t head;
+  do
+  {
+    head = __LDREXW(&profilerTraceHead);
+  } while (__STREXW(head + 1, &profilerTraceHead) != 0);
+  struct ProfilerSample *sample = &profilerTrace[head & (PROFILER_TRACE_LENGTH - 1)];
+  sample->startCycle = startCycle;
+  sample->cycles = cycles;
+  sample->slot = slot;
+}
+
+/* Writes "slot count min max average" and the line end, without a
+   terminating zero, into at least PROFILER_LINE_LENGTH characters */
+uint8_t FormatProfilerLine(const uint8_t slot, char *line)
+{
+  /* Copied at once so the line can't mix two updates */
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const struct ProfilerStats stats = profilerStats[slot];
+  __set_PRIMASK(primask);
+  uint8_t length = AppendDecimal(line, slot);
+  const uint32_t fields[] =
+  {
+    stats.count,
+    (stats.count != 0) ? stats.minCycles : 0,
+    stats.maxCycles,
+    (stats.count != 0) ? (uint32_t)(stats.totalCycles / stats.count) : 0
+  };
+  for (uint8_t i = 0; i < sizeof(fields) / sizeof(fields[0]); ++i)
+  {
+    line[length++] = ' ';
+    length += AppendDecimal(&line[length], fields[i]);
+  }
+  line[length++] = '\r';
+  line[length++] = '\n';
+  return length;
+}
+
+uint8_t AppendDecimal(char *text, uint32_t value)
+{
+  char digits[10];
+  uint8_t count = 0;
+  do
+  {
+    digits[count++] = '0' + value % 10;
+    value /= 10;
+  } while (value != 0);
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    text[i] = digits[count - 1 - i];
+  }
+  return count;
+}
@@ -56,6 +56,9 @@
 /* USER CODE END ExternalFunctions */
 
 /* USER CODE BEGIN 0 */
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+extern DMA_HandleTypeDef display_dma;
+#endif
 
 /* USER CODE END 0 */
 /**
@@ -117,6 +120,30 @@ void HAL_TIM_Base_MspInit(TIM_HandleTypeDef* htim_base)
 
   /* USER CODE END TIM2_MspInit 1 */
   }
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+  else if(htim_base->Instance==TIM3)
+  {
+    /* Peripheral clock enable */
+    __HAL_RCC_TIM3_CLK_ENABLE();
+
+    /* TIM3 DMA Init */
+    /* TIM3_UP Init */
+    display_dma.Instance = DMA1_Channel3;
+    display_dma.Init.Direction = DMA_MEMORY_TO_PERIPH;
+    display_dma.Init.PeriphInc = DMA_PINC_DISABLE;
+    display_dma.Init.MemInc = DMA_MINC_ENABLE;
+    display_dma.Init.PeriphDataAlignment = DMA_PDATAALIGN_WORD;
+    display_dma.Init.MemDataAlignment = DMA_MDATAALIGN_WORD;
+    display_dma.Init.Mode = DMA_CIRCULAR;
+    display_dma.Init.Priority = DMA_PRIORITY_LOW;
+    if (HAL_DMA_Init(&display_dma) != HAL_OK)
+    {
+      Error_Handler();
+    }
+
+    __HAL_LINKDMA(htim_base,hdma[TIM_DMA_ID_UPDATE],display_dma);
+  }
+#endif
 
 }
 
@@ -156,6 +183,16 @@ void HAL_TIM_Base_MspDeInit(TIM_HandleTypeDef* htim_base)
 
   /* USER CODE END TIM2_MspDeInit 1 */
   }
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+  else if(htim_base->Instance==TIM3)
+  {
+    /* Peripheral clock disable */
+    __HAL_RCC_TIM3_CLK_DISABLE();
+
+    /* TIM3 DMA DeInit */
+    HAL_DMA_DeInit(htim_base->hdma[TIM_DMA_ID_UPDATE]);
+  }
+#endif
 
 }
 
@@ -23,6 +23,7 @@
 #include "stm32f1xx_it.h"
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "dispatcher.h"
 /* USER CODE END Includes */
 
 /* Private typedef -----------------------------------------------------------*/
@@ -59,6 +60,9 @@
 extern TIM_HandleTypeDef long_press_timer;
 extern TIM_HandleTypeDef increment_timer;
 /* USER CODE BEGIN EV */
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+extern DMA_HandleTypeDef display_dma;
+#endif
 
 /* USER CODE END EV */
 
@@ -183,10 +187,13 @@ void PendSV_Handler(void)
 void SysTick_Handler(void)
 {
   /* USER CODE BEGIN SysTick_IRQn 0 */
+  const uint32_t profileStart = BeginProfile();
 
   /* USER CODE END SysTick_IRQn 0 */
   HAL_IncTick();
   /* USER CODE BEGIN SysTick_IRQn 1 */
+  HAL_SYSTICK_IRQHandler();
+  EndProfile(PROFILE_SYSTICK, profileStart);
 
   /* USER CODE END SysTick_IRQn 1 */
 }
@@ -204,10 +211,12 @@ void SysTick_Handler(void)
 void EXTI0_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI0_IRQn 0 */
+  const uint32_t profileStart = BeginProfile();
 
   /* USER CODE END EXTI0_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_0);
   /* USER CODE BEGIN EXTI0_IRQn 1 */
+  EndProfile(PROFILE_EXTI0, profileStart);
 
   /* USER CODE END EXTI0_IRQn 1 */
 }
@@ -218,10 +227,12 @@ void EXTI0_IRQHandler(void)
 void EXTI1_IRQHandler(void)
 {
   /* USER CODE BEGIN EXTI1_IRQn 0 */
+  const uint32_t profileStart = BeginProfile();
 
   /* USER CODE END EXTI1_IRQn 0 */
   HAL_GPIO_EXTI_IRQHandler(GPIO_PIN_1);
   /* USER CODE BEGIN EXTI1_IRQn 1 */
+  EndProfile(PROFILE_EXTI1, profileStart);
 
   /* USER CODE END EXTI1_IRQn 1 */
 }
@@ -232,10 +243,12 @@ void EXTI1_IRQHandler(void)
 void TIM1_UP_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM1_UP_IRQn 0 */
+  const uint32_t profileStart = BeginProfile();
 
   /* USER CODE END TIM1_UP_IRQn 0 */
-  HAL_TIM_IRQHandler(&long_press_timer);
+  DispatchTimerInterrupt(&long_press_timer);
   /* USER CODE BEGIN TIM1_UP_IRQn 1 */
+  EndProfile(PROFILE_TIM1_UP, profileStart);
 
   /* USER CODE END TIM1_UP_IRQn 1 */
 }
@@ -246,15 +259,28 @@ void TIM1_UP_IRQHandler(void)
 void TIM2_IRQHandler(void)
 {
   /* USER CODE BEGIN TIM2_IRQn 0 */
+  const uint32_t profileStart = BeginProfile();
 
   /* USER CODE END TIM2_IRQn 0 */
-  HAL_TIM_IRQHandler(&increment_timer);
+  DispatchTimerInterrupt(&increment_timer);
   /* USER CODE BEGIN TIM2_IRQn 1 */
+  EndProfile(PROFILE_TIM2, profileStart);
 
   /* USER CODE END TIM2_IRQn 1 */
 }
 
 /* USER CODE BEGIN 1 */
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+/**
+  * @brief This function handles DMA1 channel3 global interrupt.
+  */
+void DMA1_Channel3_IRQHandler(void)
+{
+  const uint32_t profileStart = BeginProfile();
+  HAL_DMA_IRQHandler(&display_dma);
+  EndProfile(PROFILE_DMA1_CHANNEL3, profileStart);
+}
+#endif
 
 /* USER CODE END 1 */
 /************************ (C) COPYRIGHT STMicroelectronics *****END OF FILE****/
@@ -0,0 +1,60 @@
+/**
+  ******************************************************************************
+  * @file           : acquisition.h
+  * @brief          : Header for acquisition.c file.
+  *                   Continuous multi-channel ADC acquisition in blocks.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __ACQUISITION_H
+#define __ACQUISITION_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Scans of the regular sequence in a block */
+#ifndef ACQUISITION_BLOCK_LENGTH
+#define ACQUISITION_BLOCK_LENGTH 32
+#endif
+#define ACQUISITION_CHANNELS_MAX 4
+
+/* Exported types ------------------------------------------------------------*/
+/* The samples of a channel are contiguous, channel N starts at
+   samples + N * length. firstSample counts scans since StartAcquisition */
+struct AcquisitionBlock
+{
+  const uint16_t *samples;
+  uint32_t firstSample;
+  uint16_t length;
+  uint8_t channelsCount;
+};
+
+/* Runs from the DMA interrupt and must be done with the block before the
+   DMA comes back to it, one block period later */
+typedef void (*AcquisitionCallback)(const struct AcquisitionBlock *block);
+
+struct AcquisitionStats
+{
+  uint32_t blocksCount;
+  /* Blocks the DMA started overwriting before they were processed */
+  uint32_t droppedCount;
+};
+
+/* Exported variables --------------------------------------------------------*/
+extern struct AcquisitionStats acquisitionStats;
+
+/* Exported functions prototypes ---------------------------------------------*/
+HAL_StatusTypeDef StartAcquisition(ADC_HandleTypeDef *hadc, AcquisitionCallback callback);
+void ProcessAcquisitionBlock(const uint8_t half);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __ACQUISITION_H */
@@ -0,0 +1,129 @@
+/**
+  ******************************************************************************
+  * @file           : board.h
+  * @brief          : Register level port configuration built at compile time,
+  *                   and register level fast paths for hot HAL calls.
+  *
+  *                   PORT_CONFIG folds a port's pin list into the CRL, CRH
+  *                   and ODR words, so ConfigurePort sets the whole port with
+  *                   one store per register instead of the per-pin loop of
+  *                   HAL_GPIO_Init. Pins not listed as outputs are left
+  *                   floating inputs, the reset state. EXTI lines still go
+  *                   through HAL_GPIO_Init, which also sets AFIO and EXTI.
+  *
+  *                   The Fast* functions take the arguments of the HAL call
+  *                   they stand for, but skip its asserts and bookkeeping
+  *                   and are forced inline, so with constant arguments each
+  *                   one folds to a single register access. WriteBus is
+  *                   forced inline for the same reason: with a constant
+  *                   one-segment bus the loop and the table go away and a
+  *                   bus write is one shift, one mask and one BSRR store.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BOARD_H
+#define __BOARD_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* CNF:MODE nibbles of the port configuration registers */
+#define PIN_OUTPUT_PP_2MHZ 0x2U
+#define PIN_INPUT_FLOATING 0x4U
+#define PORT_CR_RESET 0x44444444U
+
+/* Exported macro ------------------------------------------------------------*/
+/* Moves bit i of an 8-pin mask to bit 4i, the low bit of that pin's nibble */
+#define PIN_NIBBLES(pins) \
+  (  ((pins) & 0x01U)        | (((pins) & 0x02U) << 3)  | (((pins) & 0x04U) << 6)  | (((pins) & 0x08U) << 9) \
+   | (((pins) & 0x10U) << 12) | (((pins) & 0x20U) << 15) | (((pins) & 0x40U) << 18) | (((pins) & 0x80U) << 21))
+
+#define PORT_CR_WORD(pins, nibble) \
+  ((PORT_CR_RESET & ~(PIN_NIBBLES(pins) * 0xFU)) | (PIN_NIBBLES(pins) * (nibble)))
+
+/* outputPins become 2 MHz push-pull outputs, highPins of them start high */
+#define PORT_CONFIG(outputPins, highPins) \
+  { \
+    .crl = PORT_CR_WORD((outputPins) & 0xFFU, PIN_OUTPUT_PP_2MHZ), \
+    .crh = PORT_CR_WORD(((outputPins) >> 8) & 0xFFU, PIN_OUTPUT_PP_2MHZ), \
+    .odr = (highPins) \
+  }
+
+/* Exported types ------------------------------------------------------------*/
+struct PortConfig
+{
+  uint32_t crl;
+  uint32_t crh;
+  uint32_t odr;
+};
+
+/* Run of contiguous pins on one port carrying a run of bus value bits */
+struct BusSegment
+{
+  GPIO_TypeDef *port;
+  uint16_t pins;
+  uint8_t firstPin;
+  uint8_t firstBit;
+};
+
+/* Exported inline functions -------------------------------------------------*/
+static inline void ConfigurePort(GPIO_TypeDef *port, const struct PortConfig *config)
+{
+  /* Levels first, so the pins turned into outputs start at them */
+  port->ODR = config->odr;
+  port->CRL = config->crl;
+  port->CRH = config->crh;
+}
+
+/* HAL_GPIO_WritePin as one BSRR store */
+__STATIC_FORCEINLINE void FastWritePin(GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin, GPIO_PinState PinState)
+{
+  GPIOx->BSRR = (PinState != GPIO_PIN_RESET) ? (uint32_t)GPIO_Pin : (uint32_t)GPIO_Pin << 16;
+}
+
+/* HAL_GPIO_ReadPin as one IDR load */
+__STATIC_FORCEINLINE GPIO_PinState FastReadPin(const GPIO_TypeDef *GPIOx, uint16_t GPIO_Pin)
+{
+  return ((GPIOx->IDR & GPIO_Pin) != 0U) ? GPIO_PIN_SET : GPIO_PIN_RESET;
+}
+
+/* Writes value over the segments of a bus, bit firstBit of a segment on
+   its pin firstPin */
+__STATIC_FORCEINLINE void WriteBus(const struct BusSegment *bus, uint8_t segmentsCount, uint32_t value)
+{
+  for (uint8_t i = 0; i < segmentsCount; ++i)
+  {
+    const uint16_t bits = ((value >> bus[i].firstBit) << bus[i].firstPin) & bus[i].pins;
+    /* Set and reset halves in one store, so the bus never shows a mixed value */
+    bus[i].port->BSRR = ((uint32_t)(bus[i].pins & ~bits) << 16) | bits;
+  }
+}
+
+#ifdef HAL_TIM_MODULE_ENABLED
+/* HAL_TIM_Base_Start_IT and HAL_TIM_Base_Stop_IT for timers started by
+   software with no capture/compare channel, the HAL versions also handle
+   trigger slave mode and running channels */
+__STATIC_FORCEINLINE void FastStartTimerIT(TIM_HandleTypeDef *htim)
+{
+  htim->Instance->DIER |= TIM_IT_UPDATE;
+  htim->Instance->CR1 |= TIM_CR1_CEN;
+}
+
+__STATIC_FORCEINLINE void FastStopTimerIT(TIM_HandleTypeDef *htim)
+{
+  htim->Instance->DIER &= ~TIM_IT_UPDATE;
+  htim->Instance->CR1 &= ~TIM_CR1_CEN;
+}
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BOARD_H */
@@ -0,0 +1,71 @@
+/**
+  ******************************************************************************
+  * @file           : button.h
+  * @brief          : Header for button.c file.
+  *                   Debounced push buttons with click classification.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __BUTTON_H
+#define __BUTTON_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+#ifndef BUTTON_DEBOUNCE_TIME
+#define BUTTON_DEBOUNCE_TIME 20
+#endif
+#ifndef BUTTON_DOUBLE_CLICK_TIME
+#define BUTTON_DOUBLE_CLICK_TIME 300
+#endif
+#ifndef BUTTON_LONG_PRESS_TIME
+#define BUTTON_LONG_PRESS_TIME 1000
+#endif
+
+#define BUTTONS_MAX_COUNT 4
+
+/* Events of button N occupy bits 8N..8N+7 of the published flag word */
+#define BUTTON_PRESSED 0x01
+#define BUTTON_RELEASED 0x02
+#define BUTTON_CLICK 0x04
+#define BUTTON_DOUBLE_CLICK 0x08
+#define BUTTON_LONG_PRESS 0x10
+
+/* Exported macro ------------------------------------------------------------*/
+#define BUTTON_EVENTS(events, button) (((events) >> (8 * (button))) & 0xFF)
+
+/* Exported types ------------------------------------------------------------*/
+struct Button
+{
+  GPIO_TypeDef *port;
+  uint16_t pin;
+  GPIO_PinState pressedState;
+  /* Filled in by the service */
+  volatile bool isEdgePending;
+  volatile uint32_t edgeTick;
+  bool isPressed;
+  bool isLongPressReported;
+  uint8_t clicksCount;
+  uint32_t pressTick;
+  uint32_t releaseTick;
+};
+
+/* Exported functions prototypes ---------------------------------------------*/
+void InitButtons(struct Button *buttons, uint8_t count);
+void HandleButtonEdge(uint16_t GPIO_Pin);
+void UpdateButtons(void);
+uint32_t TakeButtonEvents(void);
+bool AreButtonsIdle(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __BUTTON_H */
@@ -0,0 +1,49 @@
+/**
+  ******************************************************************************
+  * @file           : clock.h
+  * @brief          : Header for clock.c file.
+  *                   System clock profiles switched at runtime.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __CLOCK_H
+#define __CLOCK_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+#define SCALED_TIMERS_MAX_COUNT 4
+#define SCALED_UARTS_MAX_COUNT 2
+
+/* Exported types ------------------------------------------------------------*/
+enum ClockProfile
+{
+  CLOCK_PROFILE_LOW_POWER,   /* 8 MHz HSI, PLL off, the reset configuration */
+  CLOCK_PROFILE_BALANCED,    /* 24 MHz from HSI/2 x6 */
+  CLOCK_PROFILE_PERFORMANCE, /* 64 MHz from HSI/2 x16, APB1 at 32 MHz */
+  CLOCK_PROFILES_COUNT
+};
+
+/* Exported functions prototypes ---------------------------------------------*/
+HAL_StatusTypeDef SetClockProfile(const enum ClockProfile profile);
+HAL_StatusTypeDef RestoreClockProfile(void);
+enum ClockProfile GetClockProfile(void);
+uint32_t GetTimerPrescaler(const TIM_TypeDef *instance, const uint32_t tickFrequency);
+#ifdef HAL_TIM_MODULE_ENABLED
+void RegisterScaledTimer(TIM_HandleTypeDef *htim, const uint32_t tickFrequency);
+#endif
+#ifdef HAL_UART_MODULE_ENABLED
+void RegisterScaledUart(UART_HandleTypeDef *huart);
+#endif
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __CLOCK_H */
@@ -32,11 +32,25 @@ extern "C" {
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "profiler.h"
 
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
+/* Slots of profilerStats, one per profiled handler or critical section */
+enum ProfilerSlot {
+  PROFILE_SYSTICK,
+  PROFILE_EXTI0,
+  PROFILE_DMA1_CHANNEL1,
+  PROFILE_DMA1_CHANNEL4,
+  PROFILE_DMA1_CHANNEL5,
+  PROFILE_USART1,
+  PROFILE_EXTI15_10,
+  PROFILE_BUTTON_EVENTS,
+  PROFILER_SLOTS_COUNT
+};
+_Static_assert(PROFILER_SLOTS_COUNT <= PROFILER_SLOTS_MAX_COUNT, "profilerStats has no room for every slot");
 
 /* USER CODE END ET */
 
@@ -0,0 +1,84 @@
+/**
+  ******************************************************************************
+  * @file           : serial.h
+  * @brief          : Header for serial.c file.
+  *                   Streaming UART receive and queued transmit over DMA.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __SERIAL_H
+#define __SERIAL_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Must be a power of two. Half of it is the longest burst the receiver
+   takes between two interrupts */
+#ifndef SERIAL_RX_BUFFER_SIZE
+#define SERIAL_RX_BUFFER_SIZE 128
+#endif
+
+/* Transmits queued at once, QueueSerialTransmit refuses more */
+#ifndef SERIAL_TX_QUEUE_DEPTH
+#define SERIAL_TX_QUEUE_DEPTH 8
+#endif
+
+/* Exported types ------------------------------------------------------------*/
+/* Gets the bytes in place in the receive ring. A wrapped run comes as two
+   calls, and the data is only valid until the callback returns */
+typedef void (*SerialReceiveCallback)(const uint8_t *data, uint16_t length);
+
+struct SerialTransmit;
+/* Runs from the DMA interrupt once the last byte is in the USART, so the
+   buffer is free again. It may queue the transmit again */
+typedef void (*SerialTransmitCallback)(struct SerialTransmit *transmit);
+
+/* The data is sent from where it lies and stays owned by the caller, but
+   must not change until the callback */
+struct SerialTransmit
+{
+  const uint8_t *data;
+  uint16_t length;
+  SerialTransmitCallback callback;
+  /* Filled in by the service */
+  struct SerialTransmit *next;
+  volatile bool isPending;
+};
+
+struct SerialStats
+{
+  uint32_t receivedCount;
+  /* Bytes the USART lost before the DMA could read them, rings the DMA
+     wrote over before they were drained, and line errors */
+  uint32_t overrunCount;
+  uint32_t errorCount;
+  /* Largest backlog found in the ring, a value near half the ring means
+     the interrupts are served too late for the baud rate */
+  uint16_t highWaterMark;
+  uint32_t transmittedCount;
+  /* Transmits refused while the queue was full or they were still pending */
+  uint32_t transmitBusyCount;
+};
+
+/* Exported variables --------------------------------------------------------*/
+extern struct SerialStats serialStats;
+
+/* Exported functions prototypes ---------------------------------------------*/
+HAL_StatusTypeDef StartSerialReceive(UART_HandleTypeDef *huart, SerialReceiveCallback callback);
+void HandleSerialInterrupt(UART_HandleTypeDef *huart);
+void StartSerialTransmit(UART_HandleTypeDef *huart);
+HAL_StatusTypeDef QueueSerialTransmit(struct SerialTransmit *transmit);
+bool IsSerialTransmitIdle(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __SERIAL_H */
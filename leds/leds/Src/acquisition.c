@@ -0,0 +1,105 @@
+/**
+  ******************************************************************************
+  * @file           : acquisition.c
+  * @brief          : Continuous multi-channel ADC acquisition in blocks.
+  *
+  *                   The ADC scans its regular sequence on every trigger and
+  *                   the DMA stores the scans, interleaved, into a circular
+  *                   buffer of two blocks. While the DMA fills one block
+  *                   the other is reordered in place so every channel is
+  *                   contiguous, and handed to the callback. The ADC handle
+  *                   is set up by the caller, the half and full transfer
+  *                   callbacks of the HAL call ProcessAcquisitionBlock.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "acquisition.h"
+
+/* Private variables ---------------------------------------------------------*/
+struct AcquisitionStats acquisitionStats;
+ADC_HandleTypeDef *acquisitionAdc;
+AcquisitionCallback acquisitionCallback;
+uint16_t acquisitionBuffer[2 * ACQUISITION_BLOCK_LENGTH * ACQUISITION_CHANNELS_MAX];
+uint8_t acquisitionChannelsCount;
+uint32_t acquiredBlocksCount;
+
+/* Private function prototypes -----------------------------------------------*/
+void DeinterleaveBlock(uint16_t *samples, const uint8_t channelsCount);
+uint16_t GetDeinterleavedIndex(const uint16_t index, const uint8_t channelsCount);
+
+/* Private user code ---------------------------------------------------------*/
+HAL_StatusTypeDef StartAcquisition(ADC_HandleTypeDef *hadc, AcquisitionCallback callback)
+{
+  if (hadc->Init.NbrOfConversion > ACQUISITION_CHANNELS_MAX)
+  {
+    return HAL_ERROR;
+  }
+  acquisitionAdc = hadc;
+  acquisitionCallback = callback;
+  acquisitionChannelsCount = hadc->Init.NbrOfConversion;
+  acquiredBlocksCount = 0;
+  return HAL_ADC_Start_DMA(hadc, (uint32_t *)acquisitionBuffer, 2 * ACQUISITION_BLOCK_LENGTH * acquisitionChannelsCount);
+}
+
+/* half is 0 from the half transfer callback, 1 from the transfer complete one */
+void ProcessAcquisitionBlock(const uint8_t half)
+{
+  const uint16_t blockSize = ACQUISITION_BLOCK_LENGTH * acquisitionChannelsCount;
+  uint16_t *samples = &acquisitionBuffer[half * blockSize];
+  DeinterleaveBlock(samples, acquisitionChannelsCount);
+
+  const struct AcquisitionBlock block =
+  {
+    .samples = samples,
+    .firstSample = acquiredBlocksCount * ACQUISITION_BLOCK_LENGTH,
+    .length = ACQUISITION_BLOCK_LENGTH,
+    .channelsCount = acquisitionChannelsCount
+  };
+  acquisitionCallback(&block);
+  ++acquiredBlocksCount;
+  ++acquisitionStats.blocksCount;
+
+  /* The DMA counts down from two blocks. It has to still be filling the
+     other block, or it came back to this one during the processing */
+  const uint32_t remaining = __HAL_DMA_GET_COUNTER(acquisitionAdc->DMA_Handle);
+  const uint8_t fillingHalf = (remaining > blockSize) ? 0 : 1;
+  if (fillingHalf == half)
+  {
+    ++acquisitionStats.droppedCount;
+  }
+}
+
+/* Transposes the scans into channel runs in place, following every cycle
+   of the permutation once from its smallest index */
+void DeinterleaveBlock(uint16_t *samples, const uint8_t channelsCount)
+{
+  const uint16_t blockSize = ACQUISITION_BLOCK_LENGTH * channelsCount;
+  /* The first and the last sample never move */
+  for (uint16_t start = 1; start + 1 < blockSize; ++start)
+  {
+    uint16_t index = GetDeinterleavedIndex(start, channelsCount);
+    while (index > start)
+    {
+      index = GetDeinterleavedIndex(index, channelsCount);
+    }
+    if (index < start)
+    {
+      continue;
+    }
+    uint16_t carried = samples[start];
+    do
+    {
+      index = GetDeinterleavedIndex(index, channelsCount);
+      const uint16_t displaced = samples[index];
+      samples[index] = carried;
+      carried = displaced;
+    } while (index != start);
+  }
+}
+
+/* Scan s, channel c sits at s * channelsCount + c and moves to c * length + s */
+uint16_t GetDeinterleavedIndex(const uint16_t index, const uint8_t channelsCount)
+{
+  return (index % channelsCount) * ACQUISITION_BLOCK_LENGTH + index / channelsCount;
+}
@@ -0,0 +1,189 @@
+/**
+  ******************************************************************************
+  * @file           : clock.c
+  * @brief          : System clock profiles switched at runtime.
+  *
+  *                   SetClockProfile moves SYSCLK back to HSI, reprograms the
+  *                   PLL and switches to the new configuration. The flash
+  *                   latency and the SysTick reload follow from
+  *                   HAL_RCC_ClockConfig, every registered timer gets its
+  *                   prescaler recomputed and every registered UART its baud
+  *                   rate divider, so tick based and timer based delays keep
+  *                   their length and the serial lines their baud rate.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "clock.h"
+
+/* Private typedef -----------------------------------------------------------*/
+struct ClockProfileConfig
+{
+  uint32_t pllState;
+  uint32_t pllMul;
+  uint32_t sysclkSource;
+  uint32_t apb1Divider;
+  uint32_t flashLatency;
+};
+
+#ifdef HAL_TIM_MODULE_ENABLED
+struct ScaledTimer
+{
+  TIM_HandleTypeDef *htim;
+  uint32_t tickFrequency;
+};
+#endif
+
+/* Private variables ---------------------------------------------------------*/
+/* APB1 must stay at or below 36 MHz, the flash needs a wait state past
+   24 MHz and two past 48 MHz */
+const struct ClockProfileConfig CLOCK_PROFILES[CLOCK_PROFILES_COUNT] =
+{
+  [CLOCK_PROFILE_LOW_POWER] = { RCC_PLL_OFF, RCC_PLL_MUL2, RCC_SYSCLKSOURCE_HSI, RCC_HCLK_DIV1, FLASH_LATENCY_0 },
+  [CLOCK_PROFILE_BALANCED] = { RCC_PLL_ON, RCC_PLL_MUL6, RCC_SYSCLKSOURCE_PLLCLK, RCC_HCLK_DIV1, FLASH_LATENCY_0 },
+  [CLOCK_PROFILE_PERFORMANCE] = { RCC_PLL_ON, RCC_PLL_MUL16, RCC_SYSCLKSOURCE_PLLCLK, RCC_HCLK_DIV2, FLASH_LATENCY_2 }
+};
+enum ClockProfile currentProfile = CLOCK_PROFILE_LOW_POWER;
+#ifdef HAL_TIM_MODULE_ENABLED
+struct ScaledTimer scaledTimers[SCALED_TIMERS_MAX_COUNT];
+uint8_t scaledTimersCount;
+#endif
+#ifdef HAL_UART_MODULE_ENABLED
+UART_HandleTypeDef *scaledUarts[SCALED_UARTS_MAX_COUNT];
+uint8_t scaledUartsCount;
+#endif
+
+/* Private function prototypes -----------------------------------------------*/
+uint32_t GetTimerClock(const TIM_TypeDef *instance);
+void RescaleTimers(void);
+void RescaleUarts(void);
+
+/* Private user code ---------------------------------------------------------*/
+HAL_StatusTypeDef SetClockProfile(const enum ClockProfile profile)
+{
+  const struct ClockProfileConfig *config = &CLOCK_PROFILES[profile];
+  RCC_OscInitTypeDef oscInit = {0};
+  RCC_ClkInitTypeDef clkInit = {0};
+
+  /* The PLL can't be reconfigured while it drives SYSCLK */
+  clkInit.ClockType = RCC_CLOCKTYPE_HCLK | RCC_CLOCKTYPE_SYSCLK | RCC_CLOCKTYPE_PCLK1 | RCC_CLOCKTYPE_PCLK2;
+  clkInit.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
+  clkInit.AHBCLKDivider = RCC_SYSCLK_DIV1;
+  clkInit.APB1CLKDivider = RCC_HCLK_DIV1;
+  clkInit.APB2CLKDivider = RCC_HCLK_DIV1;
+  if (HAL_RCC_ClockConfig(&clkInit, FLASH_LATENCY_0) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  oscInit.OscillatorType = RCC_OSCILLATORTYPE_HSI;
+  oscInit.HSIState = RCC_HSI_ON;
+  oscInit.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
+  oscInit.PLL.PLLState = config->pllState;
+  oscInit.PLL.PLLSource = RCC_PLLSOURCE_HSI_DIV2;
+  oscInit.PLL.PLLMUL = config->pllMul;
+  if (HAL_RCC_OscConfig(&oscInit) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  clkInit.SYSCLKSource = config->sysclkSource;
+  clkInit.APB1CLKDivider = config->apb1Divider;
+  if (HAL_RCC_ClockConfig(&clkInit, config->flashLatency) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+
+  currentProfile = profile;
+  RescaleTimers();
+  RescaleUarts();
+  return HAL_OK;
+}
+
+/* STOP mode falls back to HSI with the PLL off, this brings the profile back */
+HAL_StatusTypeDef RestoreClockProfile(void)
+{
+  return SetClockProfile(currentProfile);
+}
+
+enum ClockProfile GetClockProfile(void)
+{
+  return currentProfile;
+}
+
+uint32_t GetTimerClock(const TIM_TypeDef *instance)
+{
+  /* TIM1 sits on APB2, the others on APB1. A divided APB clocks its
+     timers at twice its own rate */
+  if (instance == TIM1)
+  {
+    const uint32_t pclk = HAL_RCC_GetPCLK2Freq();
+    return ((RCC->CFGR & RCC_CFGR_PPRE2) == RCC_CFGR_PPRE2_DIV1) ? pclk : 2 * pclk;
+  }
+  const uint32_t pclk = HAL_RCC_GetPCLK1Freq();
+  return ((RCC->CFGR & RCC_CFGR_PPRE1) == RCC_CFGR_PPRE1_DIV1) ? pclk : 2 * pclk;
+}
+
+uint32_t GetTimerPrescaler(const TIM_TypeDef *instance, const uint32_t tickFrequency)
+{
+  return GetTimerClock(instance) / tickFrequency - 1;
+}
+
+#ifdef HAL_TIM_MODULE_ENABLED
+void RegisterScaledTimer(TIM_HandleTypeDef *htim, const uint32_t tickFrequency)
+{
+  if (scaledTimersCount < SCALED_TIMERS_MAX_COUNT)
+  {
+    scaledTimers[scaledTimersCount].htim = htim;
+    scaledTimers[scaledTimersCount].tickFrequency = tickFrequency;
+    ++scaledTimersCount;
+  }
+}
+#endif
+
+#ifdef HAL_UART_MODULE_ENABLED
+void RegisterScaledUart(UART_HandleTypeDef *huart)
+{
+  if (scaledUartsCount < SCALED_UARTS_MAX_COUNT)
+  {
+    scaledUarts[scaledUartsCount] = huart;
+    ++scaledUartsCount;
+  }
+}
+#endif
+
+void RescaleTimers(void)
+{
+#ifdef HAL_TIM_MODULE_ENABLED
+  for (uint8_t i = 0; i < scaledTimersCount; ++i)
+  {
+    TIM_HandleTypeDef *htim = scaledTimers[i].htim;
+    TIM_TypeDef *tim = htim->Instance;
+    const uint32_t count = tim->CNT;
+    const uint32_t urs = tim->CR1 & TIM_CR1_URS;
+    htim->Init.Prescaler = GetTimerPrescaler(tim, scaledTimers[i].tickFrequency);
+    tim->PSC = htim->Init.Prescaler;
+    /* Load PSC now rather than at the next overflow. URS keeps the forced
+       update from raising an interrupt or a DMA request, and the tick
+       length is unchanged, so the count carries over */
+    tim->CR1 |= TIM_CR1_URS;
+    tim->EGR = TIM_EGR_UG;
+    tim->CR1 = (tim->CR1 & ~TIM_CR1_URS) | urs;
+    tim->CNT = count;
+  }
+#endif
+}
+
+void RescaleUarts(void)
+{
+#ifdef HAL_UART_MODULE_ENABLED
+  for (uint8_t i = 0; i < scaledUartsCount; ++i)
+  {
+    UART_HandleTypeDef *huart = scaledUarts[i];
+    /* USART1 sits on APB2, the others on APB1, like in UART_SetConfig.
+       A byte on the line while the clock switches is lost either way */
+    const uint32_t pclk = (huart->Instance == USART1) ? HAL_RCC_GetPCLK2Freq() : HAL_RCC_GetPCLK1Freq();
+    huart->Instance->BRR = UART_BRR_SAMPLING16(pclk, huart->Init.BaudRate);
+  }
+#endif
+}
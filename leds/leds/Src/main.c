@@ -1,44 +1,185 @@
 #include "main.h"
+#include "button.h"
+#include "recorder.h"
+#include "board.h"
+#include "ports.h"
+#include "clock.h"
+#include "timers.h"
+#include "serial.h"
+#include "acquisition.h"
+#include "power.h"
 #include <stdbool.h>
+#include <string.h>
+
+/* 2-bit brightness of every led (led N in bits 2N..2N+1) shown for duration ms */
+struct Frame {
+  uint16_t levels;
+  uint16_t duration;
+};
+
+struct Pattern {
+  const struct Frame *frames;
+  uint8_t framesCount;
+  const char *name;
+};
+
+#define LEDS_COUNT 8
+#define BRIGHTNESS_LEVELS 3
+/* Brightness of a single led */
+#define LED_LEVEL(led, level) ((uint16_t)(level) << (2 * (led)))
+/* Every led of the mask at the given brightness */
+#define LEDS_LEVEL(mask, level) \
+  ((((mask) >> 0) & 1 ? LED_LEVEL(0, level) : 0) | (((mask) >> 1) & 1 ? LED_LEVEL(1, level) : 0) | \
+   (((mask) >> 2) & 1 ? LED_LEVEL(2, level) : 0) | (((mask) >> 3) & 1 ? LED_LEVEL(3, level) : 0) | \
+   (((mask) >> 4) & 1 ? LED_LEVEL(4, level) : 0) | (((mask) >> 5) & 1 ? LED_LEVEL(5, level) : 0) | \
+   (((mask) >> 6) & 1 ? LED_LEVEL(6, level) : 0) | (((mask) >> 7) & 1 ? LED_LEVEL(7, level) : 0))
+#define LEDS_ON(mask) LEDS_LEVEL(mask, BRIGHTNESS_LEVELS)
+#define PATTERN(frames, name) { frames, sizeof(frames) / sizeof(frames[0]), name }
 
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
+static void MX_USART1_UART_Init(void);
+static void MX_ADC1_Init(void);
+static void MX_TIM3_Init(void);
+void EnterLowPowerMode(void);
+void SuspendForStop(void);
+void ResumeAfterStop(void);
+void SelectNextPattern(void);
+void RestartPattern(void);
+void StopPattern(void);
+void LoadFrame(void);
+void HandleButtonEvents(uint32_t events);
+void HandleSerialCommands(const uint8_t *data, uint16_t length);
+void SwitchClockProfile(void);
+void ReportPattern(void);
+void SendPatternReport(void);
+void HandleReportSent(struct SerialTransmit *transmit);
+void ReportProfiler(void);
+void SendProfilerLine(void);
+void HandleProfilerLineSent(struct SerialTransmit *transmit);
+void HandleAcquisitionBlock(const struct AcquisitionBlock *block);
+
+ADC_HandleTypeDef hadc1;
+DMA_HandleTypeDef hdma_adc1;
+TIM_HandleTypeDef htim3;
+UART_HandleTypeDef huart1;
+DMA_HandleTypeDef hdma_usart1_rx;
+DMA_HandleTypeDef hdma_usart1_tx;
+
+volatile bool isRunning = false;
+/* Set by the serial command, the main loop switches the clock profile */
+volatile bool isClockSwitchRequested = false;
+struct Button button = { .port = GPIOA, .pin = GPIO_PIN_0, .pressedState = GPIO_PIN_RESET };
+const struct BusSegment LEDS_BUS[] = {
+  { GPIOB, GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3
+          |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7, 0, 0 }
+};
+/* LED outputs, pin lists generated from leds.ioc by tools/ports.py */
+const struct PortConfig PORT_B_CONFIG = PORT_CONFIG(PORT_B_OUTPUT_PINS, PORT_B_HIGH_PINS);
+const uint8_t LEDS_BUS_SEGMENTS_COUNT = sizeof(LEDS_BUS) / sizeof(LEDS_BUS[0]);
+
+const struct Frame CONVERGE_FRAMES[] = {
+  { LEDS_ON(0x81), 250 }, { 0, 1 },
+  { LEDS_ON(0x42), 250 }, { 0, 1 },
+  { LEDS_ON(0x24), 250 }, { 0, 1 },
+  { LEDS_ON(0x18), 250 }, { 0, 1 },
+  { LEDS_ON(0xFF), 250 }, { 0, 250 }
+};
+const struct Frame COMET_FRAMES[] = {
+  { LED_LEVEL(0, 3) | LED_LEVEL(7, 2) | LED_LEVEL(6, 1), 100 },
+  { LED_LEVEL(1, 3) | LED_LEVEL(0, 2) | LED_LEVEL(7, 1), 100 },
+  { LED_LEVEL(2, 3) | LED_LEVEL(1, 2) | LED_LEVEL(0, 1), 100 },
+  { LED_LEVEL(3, 3) | LED_LEVEL(2, 2) | LED_LEVEL(1, 1), 100 },
+  { LED_LEVEL(4, 3) | LED_LEVEL(3, 2) | LED_LEVEL(2, 1), 100 },
+  { LED_LEVEL(5, 3) | LED_LEVEL(4, 2) | LED_LEVEL(3, 1), 100 },
+  { LED_LEVEL(6, 3) | LED_LEVEL(5, 2) | LED_LEVEL(4, 1), 100 },
+  { LED_LEVEL(7, 3) | LED_LEVEL(6, 2) | LED_LEVEL(5, 1), 100 }
+};
+const struct Frame BREATHE_FRAMES[] = {
+  { LEDS_LEVEL(0xFF, 1), 150 },
+  { LEDS_LEVEL(0xFF, 2), 150 },
+  { LEDS_LEVEL(0xFF, 3), 300 },
+  { LEDS_LEVEL(0xFF, 2), 150 },
+  { LEDS_LEVEL(0xFF, 1), 150 },
+  { 0, 300 }
+};
+const struct Pattern PATTERNS[] = {
+  PATTERN(CONVERGE_FRAMES, "converge"),
+  PATTERN(COMET_FRAMES, "comet"),
+  PATTERN(BREATHE_FRAMES, "breathe")
+};
+const uint8_t PATTERNS_COUNT = sizeof(PATTERNS) / sizeof(PATTERNS[0]);
 
-bool isRunning = false;
+/* Playback state, owned by SysTick and the button interrupt (same priority) */
+uint8_t patternIndex = 0;
+uint8_t frameIndex = 0;
+uint16_t frameElapsed = 0;
+uint8_t pwmPhase = 0;
+/* Leds lit during every PWM phase of the current frame */
+uint8_t phaseMasks[BRIGHTNESS_LEVELS];
+
+/* Pattern report, the name is sent from flash followed by the line end */
+struct SerialTransmit patternReport = { 0 };
+struct SerialTransmit reportEnd = { .data = (const uint8_t *)"\r\n", .length = 2, .callback = HandleReportSent };
+bool isReportStale = false;
+/* Profiler dump, the lines of the slots are sent in turn from one buffer */
+char profilerLine[PROFILER_LINE_LENGTH];
+struct SerialTransmit profilerReport = { .data = (const uint8_t *)profilerLine, .callback = HandleProfilerLineSent };
+uint8_t profilerReportSlot = 0;
+
+/* TIM3 triggers a scan of the internal channels every millisecond */
+const uint32_t ACQUISITION_TIMER_TICK_FREQUENCY = 1000000;
+/* Ranks of the regular sequence */
+enum { TEMPERATURE_CHANNEL, VREFINT_CHANNEL, ACQUISITION_CHANNELS_COUNT };
+/* Averages over the last block, in tenths of a degree and in mV */
+int16_t chipTemperature = 0;
+uint16_t supplyVoltage = 0;
+
+/* Keeps the core out of STOP after a serial wake-up, for the command that
+   follows the lost byte */
+const uint32_t SERIAL_WAKE_UP_TIME = 20;
+struct Timer serialWakeUpTimer = { 0 };
 
 int main(void)
 {
   HAL_Init();
   SystemClock_Config();
+  InitProfiler();
+  InitRecorder();
+  InitStopClock();
   MX_GPIO_Init();
+  MX_DMA_Init();
+  MX_USART1_UART_Init();
+  MX_ADC1_Init();
+  MX_TIM3_Init();
+  RegisterScaledTimer(&htim3, ACQUISITION_TIMER_TICK_FREQUENCY);
+  RegisterScaledUart(&huart1);
+  InitButtons(&button, 1);
+  StartSerialTransmit(&huart1);
+  if (StartSerialReceive(&huart1, HandleSerialCommands) != HAL_OK) {
+    Error_Handler();
+  }
+  if ((StartAcquisition(&hadc1, HandleAcquisitionBlock) != HAL_OK) || (HAL_TIM_Base_Start(&htim3) != HAL_OK)) {
+    Error_Handler();
+  }
 
-  const uint32_t delayLength = 250;
-  const uint8_t ledsCount = 8;
-	
   while (true) {
-    if (!isRunning) {
-      HAL_GPIO_WritePin(GPIOB, GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                              |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7, GPIO_PIN_RESET);
-      while (!isRunning) {
-        HAL_Delay(1);
-      }
+    const uint32_t events = TakeButtonEvents();
+    if (events != 0) {
+      /* SysTick plays the pattern from the same state */
+      __disable_irq();
+      const uint32_t profileStart = BeginProfile();
+      HandleButtonEvents(events);
+      EndProfile(PROFILE_BUTTON_EVENTS, profileStart);
+      __enable_irq();
     }
-           					
-    for (uint8_t i = 1; isRunning && (i <= (ledsCount / 2) + 1); i++)	{			
-      if (i <= (ledsCount / 2)) {
-        HAL_GPIO_WritePin(GPIOB,(1 << (i - 1)) | (1 << (ledsCount - i)), GPIO_PIN_SET);
-        HAL_Delay(delayLength);
-        HAL_GPIO_WritePin(GPIOB,(1 << (i - 1)) | (1 << (ledsCount - i)), GPIO_PIN_RESET);  	
-        HAL_Delay(1);
-      } else  {
-        HAL_GPIO_WritePin(GPIOB,GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                              |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7, GPIO_PIN_SET); 
-        HAL_Delay(delayLength);
-        HAL_GPIO_WritePin(GPIOB,GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                              |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7, GPIO_PIN_RESET); 
-        HAL_Delay(delayLength);
-      }
-    }		
+    if (isClockSwitchRequested) {
+      isClockSwitchRequested = false;
+      SwitchClockProfile();
+    }
+    UpdateSleepStats();
+    EnterLowPowerMode();
   }
 }
 
@@ -48,34 +189,143 @@ int main(void)
   */
 void SystemClock_Config(void)
 {
-  RCC_OscInitTypeDef RCC_OscInitStruct = {0};
-  RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
+  RCC_PeriphCLKInitTypeDef PeriphClkInit = {0};
+
+  if (SetClockProfile(CLOCK_PROFILE_LOW_POWER) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /* PCLK2 / 6 stays within the 14 MHz ADC limit in every clock profile */
+  PeriphClkInit.PeriphClockSelection = RCC_PERIPHCLK_ADC;
+  PeriphClkInit.AdcClockSelection = RCC_ADCPCLK2_DIV6;
+  if (HAL_RCCEx_PeriphCLKConfig(&PeriphClkInit) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+  * @brief ADC1 Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_ADC1_Init(void)
+{
+  ADC_ChannelConfTypeDef sConfig = {0};
+
+  /** Common config 
+  */
+  hadc1.Instance = ADC1;
+  hadc1.Init.ScanConvMode = ADC_SCAN_ENABLE;
+  hadc1.Init.ContinuousConvMode = DISABLE;
+  hadc1.Init.DiscontinuousConvMode = DISABLE;
+  hadc1.Init.ExternalTrigConv = ADC_EXTERNALTRIGCONV_T3_TRGO;
+  hadc1.Init.DataAlign = ADC_DATAALIGN_RIGHT;
+  hadc1.Init.NbrOfConversion = ACQUISITION_CHANNELS_COUNT;
+  if (HAL_ADC_Init(&hadc1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel 
+  */
+  /* The sensor needs 17.1 us of sampling, a scan then takes under 0.4 ms
+     at the slowest ADC clock */
+  sConfig.Channel = ADC_CHANNEL_TEMPSENSOR;
+  sConfig.Rank = ADC_REGULAR_RANK_1;
+  sConfig.SamplingTime = ADC_SAMPLETIME_239CYCLES_5;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  /** Configure Regular Channel 
+  */
+  sConfig.Channel = ADC_CHANNEL_VREFINT;
+  sConfig.Rank = ADC_REGULAR_RANK_2;
+  if (HAL_ADC_ConfigChannel(&hadc1, &sConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  if (HAL_ADCEx_Calibration_Start(&hadc1) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
 
-  /** Initializes the CPU, AHB and APB busses clocks 
+/**
+  * @brief TIM3 Initialization Function
+  * @param None
+  * @retval None
   */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
-  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
-  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
-  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
-  if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
+static void MX_TIM3_Init(void)
+{
+  TIM_ClockConfigTypeDef sClockSourceConfig = {0};
+  TIM_MasterConfigTypeDef sMasterConfig = {0};
+
+  htim3.Instance = TIM3;
+  htim3.Init.Prescaler = GetTimerPrescaler(TIM3, ACQUISITION_TIMER_TICK_FREQUENCY);
+  htim3.Init.CounterMode = TIM_COUNTERMODE_UP;
+  htim3.Init.Period = 1000-1;
+  htim3.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
+  htim3.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
+  if (HAL_TIM_Base_Init(&htim3) != HAL_OK)
   {
     Error_Handler();
   }
-  /** Initializes the CPU, AHB and APB busses clocks 
+  sClockSourceConfig.ClockSource = TIM_CLOCKSOURCE_INTERNAL;
+  if (HAL_TIM_ConfigClockSource(&htim3, &sClockSourceConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+  sMasterConfig.MasterOutputTrigger = TIM_TRGO_UPDATE;
+  sMasterConfig.MasterSlaveMode = TIM_MASTERSLAVEMODE_DISABLE;
+  if (HAL_TIMEx_MasterConfigSynchronization(&htim3, &sMasterConfig) != HAL_OK)
+  {
+    Error_Handler();
+  }
+}
+
+/**
+  * @brief USART1 Initialization Function
+  * @param None
+  * @retval None
   */
-  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
-                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
-  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
-  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
-  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
-
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
+static void MX_USART1_UART_Init(void)
+{
+  huart1.Instance = USART1;
+  huart1.Init.BaudRate = 115200;
+  huart1.Init.WordLength = UART_WORDLENGTH_8B;
+  huart1.Init.StopBits = UART_STOPBITS_1;
+  huart1.Init.Parity = UART_PARITY_NONE;
+  huart1.Init.Mode = UART_MODE_TX_RX;
+  huart1.Init.HwFlowCtl = UART_HWCONTROL_NONE;
+  huart1.Init.OverSampling = UART_OVERSAMPLING_16;
+  if (HAL_UART_Init(&huart1) != HAL_OK)
   {
     Error_Handler();
   }
 }
 
+/**
+  * @brief DMA Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_DMA_Init(void)
+{
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+
+  /* DMA interrupt init */
+  /* DMA1_Channel1_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel1_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel1_IRQn);
+  /* DMA1_Channel4_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel4_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel4_IRQn);
+  /* DMA1_Channel5_IRQn interrupt configuration */
+  HAL_NVIC_SetPriority(DMA1_Channel5_IRQn, 0, 0);
+  HAL_NVIC_EnableIRQ(DMA1_Channel5_IRQn);
+}
 
 /**
   * @brief GPIO Initialization Function
@@ -90,34 +340,280 @@ static void MX_GPIO_Init(void)
   __HAL_RCC_GPIOA_CLK_ENABLE();
   __HAL_RCC_GPIOB_CLK_ENABLE();
 
-  /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(GPIOB, GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                          |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7, GPIO_PIN_RESET);
+  ConfigurePort(GPIOB, &PORT_B_CONFIG);
 
   /*Configure GPIO pin : PA0 */
   GPIO_InitStruct.Pin = GPIO_PIN_0;
-  GPIO_InitStruct.Mode = GPIO_MODE_IT_FALLING;
+  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING_FALLING;
   GPIO_InitStruct.Pull = GPIO_NOPULL;
   HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
 
-  /*Configure GPIO pins : PB0 PB1 PB2 PB3 
-                           PB4 PB5 PB6 PB7 */
-  GPIO_InitStruct.Pin = GPIO_PIN_0|GPIO_PIN_1|GPIO_PIN_2|GPIO_PIN_3 
-                          |GPIO_PIN_4|GPIO_PIN_5|GPIO_PIN_6|GPIO_PIN_7;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
+  HAL_NVIC_SetPriority(EXTI0_IRQn, 0, 0);
   HAL_NVIC_EnableIRQ(EXTI0_IRQn);
 
 }
 
-void EXTI0_IRQHandler(void)
+void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+{
+  /* The serial RX wake-up line ends up here too, only the button is traced */
+  if (GPIO_Pin == button.pin) {
+    RecordEvent(POSITION_VAL(GPIO_Pin), FastReadPin(button.port, GPIO_Pin) == GPIO_PIN_SET);
+  }
+  if (GPIO_Pin == GPIO_PIN_10) {
+    StartTimer(&serialWakeUpTimer, SERIAL_WAKE_UP_TIME, NULL);
+  }
+  HandleButtonEdge(GPIO_Pin);
+}
+
+/* Click cycles the patterns, double click restarts the current one, long press stops */
+void HandleButtonEvents(uint32_t events)
 {
-  isRunning = !isRunning;
+  const uint32_t buttonEvents = BUTTON_EVENTS(events, 0);
+  if (buttonEvents & BUTTON_CLICK) {
+    SelectNextPattern();
+  }
+  if (buttonEvents & BUTTON_DOUBLE_CLICK) {
+    RestartPattern();
+  }
+  if (buttonEvents & BUTTON_LONG_PRESS) {
+    StopPattern();
+  }
 }
 
+/* Serial commands mirror the button: 'n' selects the next pattern, 'r'
+   restarts the current one and 's' stops, 'p' dumps the profiler stats
+   and 'c' cycles the clock profiles.
+   They arrive from the USART and DMA interrupts, which can't preempt the
+   SysTick playback */
+void HandleSerialCommands(const uint8_t *data, uint16_t length)
+{
+  for (uint16_t i = 0; i < length; ++i) {
+    switch (data[i]) {
+    case 'n':
+      SelectNextPattern();
+      break;
+    case 'r':
+      RestartPattern();
+      break;
+    case 's':
+      StopPattern();
+      break;
+    case 'p':
+      ReportProfiler();
+      break;
+    case 'c':
+      isClockSwitchRequested = true;
+      break;
+    default:
+      break;
+    }
+  }
+}
+
+/* Cycles low power -> balanced -> performance. The HAL waits for the PLL
+   on the tick, which doesn't move from an interrupt of the same priority,
+   hence the main loop */
+void SwitchClockProfile(void)
+{
+  if (SetClockProfile((enum ClockProfile)((GetClockProfile() + 1) % CLOCK_PROFILES_COUNT)) != HAL_OK) {
+    Error_Handler();
+  }
+}
+
+/* Cycles off -> every pattern in turn -> off */
+void SelectNextPattern(void)
+{
+  if (!isRunning) {
+    patternIndex = 0;
+    isRunning = true;
+  } else if (++patternIndex == PATTERNS_COUNT) {
+    StopPattern();
+    return;
+  }
+  RestartPattern();
+}
+
+void RestartPattern(void)
+{
+  if (isRunning) {
+    frameIndex = 0;
+    LoadFrame();
+    ReportPattern();
+  }
+}
+
+void StopPattern(void)
+{
+  isRunning = false;
+  WriteBus(LEDS_BUS, LEDS_BUS_SEGMENTS_COUNT, 0);
+  ReportPattern();
+}
+
+/* Sends the name of the playing pattern, or "off". A change made while the
+   previous report is still queued is sent once that one is done */
+void ReportPattern(void)
+{
+  isReportStale = true;
+  if (!patternReport.isPending && !reportEnd.isPending) {
+    SendPatternReport();
+  }
+}
+
+void SendPatternReport(void)
+{
+  const char *name = isRunning ? PATTERNS[patternIndex].name : "off";
+  isReportStale = false;
+  patternReport.data = (const uint8_t *)name;
+  patternReport.length = strlen(name);
+  QueueSerialTransmit(&patternReport);
+  QueueSerialTransmit(&reportEnd);
+}
+
+void HandleReportSent(struct SerialTransmit *transmit)
+{
+  if (isReportStale) {
+    SendPatternReport();
+  }
+}
+
+/* Sends "slot count min max average" in cycles for every profiler slot. A
+   request while a dump is still being sent is dropped */
+void ReportProfiler(void)
+{
+  if (!profilerReport.isPending) {
+    profilerReportSlot = 0;
+    SendProfilerLine();
+  }
+}
+
+void SendProfilerLine(void)
+{
+  profilerReport.length = FormatProfilerLine(profilerReportSlot, profilerLine);
+  QueueSerialTransmit(&profilerReport);
+}
+
+void HandleProfilerLineSent(struct SerialTransmit *transmit)
+{
+  if (++profilerReportSlot < PROFILER_SLOTS_COUNT) {
+    SendProfilerLine();
+  }
+}
+
+void LoadFrame(void)
+{
+  const uint16_t levels = PATTERNS[patternIndex].frames[frameIndex].levels;
+  for (uint8_t phase = 0; phase < BRIGHTNESS_LEVELS; ++phase) {
+    uint8_t mask = 0;
+    for (uint8_t led = 0; led < LEDS_COUNT; ++led) {
+      if (((levels >> (2 * led)) & 3) > phase) {
+        mask |= 1 << led;
+      }
+    }
+    phaseMasks[phase] = mask;
+  }
+  frameElapsed = 0;
+}
+
+void HAL_ADC_ConvHalfCpltCallback(ADC_HandleTypeDef *hadc)
+{
+  ProcessAcquisitionBlock(0);
+}
+
+void HAL_ADC_ConvCpltCallback(ADC_HandleTypeDef *hadc)
+{
+  ProcessAcquisitionBlock(1);
+}
+
+void HandleAcquisitionBlock(const struct AcquisitionBlock *block)
+{
+  uint32_t sums[ACQUISITION_CHANNELS_COUNT] = { 0 };
+  for (uint8_t channel = 0; channel < ACQUISITION_CHANNELS_COUNT; ++channel) {
+    const uint16_t *samples = &block->samples[channel * block->length];
+    for (uint16_t i = 0; i < block->length; ++i) {
+      sums[channel] += samples[i];
+    }
+  }
+  if (sums[VREFINT_CHANNEL] == 0) {
+    return;
+  }
+  /* VREFINT is 1.20 V, which scales the readings to VDDA. The sensor gives
+     1.43 V at 25 C and drops 4.3 mV per degree (typical values) */
+  supplyVoltage = (uint16_t)(1200UL * 4095 * block->length / sums[VREFINT_CHANNEL]);
+  const int32_t senseVoltage = (int32_t)(sums[TEMPERATURE_CHANNEL] * supplyVoltage / (4095UL * block->length));
+  chipTemperature = (int16_t)(250 + (1430 - senseVoltage) * 100 / 43);
+}
+
+void HAL_SYSTICK_Callback(void)
+{
+  UpdateButtons();
+  UpdateTimers();
+  if (!isRunning) {
+    return;
+  }
+  const struct Pattern *pattern = &PATTERNS[patternIndex];
+  if (++frameElapsed >= pattern->frames[frameIndex].duration) {
+    frameIndex = (frameIndex + 1) % pattern->framesCount;
+    LoadFrame();
+  }
+  pwmPhase = (pwmPhase + 1) % BRIGHTNESS_LEVELS;
+  WriteBus(LEDS_BUS, LEDS_BUS_SEGMENTS_COUNT, phaseMasks[pwmPhase]);
+}
+
+/* Sleeps on a software timer instead of spinning on the tick */
+void HAL_Delay(uint32_t Delay)
+{
+  struct Timer delayTimer = { 0 };
+  /* Add a freq to guarantee minimum wait, as the HAL version does */
+  StartTimer(&delayTimer, (Delay < HAL_MAX_DELAY) ? Delay + (uint32_t)(uwTickFreq) : Delay, NULL);
+  while (!TakeTimerExpiry(&delayTimer)) {
+    UpdateSleepStats();
+    __disable_irq();
+    if (!delayTimer.isExpired) {
+      EnterSleepMode();
+    }
+    __enable_irq();
+  }
+}
+
+void EnterLowPowerMode(void)
+{
+  /* Checked with interrupts disabled, so the button can't be missed
+     between the check and the WFI. STOP would also freeze a transmit */
+  __disable_irq();
+  if (!isRunning && !isClockSwitchRequested && !serialWakeUpTimer.isArmed && AreButtonsIdle()
+      && IsSerialTransmitIdle()) {
+    SuspendForStop();
+    const HAL_StatusTypeDef status = EnterStopMode();
+    ResumeAfterStop();
+    if (status != HAL_OK) {
+      Error_Handler();
+    }
+  } else {
+    EnterSleepMode();
+  }
+  __enable_irq();
+}
+
+/* Only the button and serial RX EXTI lines wake the core up from STOP.
+   The USART is unclocked in STOP, so the byte that wakes it is lost, and
+   the core then stays in SLEEP for SERIAL_WAKE_UP_TIME */
+void SuspendForStop(void)
+{
+  __HAL_GPIO_EXTI_CLEAR_IT(GPIO_PIN_10);
+  SET_BIT(EXTI->IMR, GPIO_PIN_10);
+  /* The ADC keeps drawing current in STOP unless powered down. That is
+     done between two scans, so the DMA stays in step with the sequence,
+     and once back on the ADC waits for the next trigger */
+  while ((__HAL_DMA_GET_COUNTER(&hdma_adc1) % ACQUISITION_CHANNELS_COUNT) != 0) {
+  }
+  __HAL_ADC_DISABLE(&hadc1);
+}
+
+void ResumeAfterStop(void)
+{
+  CLEAR_BIT(EXTI->IMR, GPIO_PIN_10);
+  __HAL_ADC_ENABLE(&hadc1);
+}
 
 /**
   * @brief  This function is executed in case of error occurrence.
@@ -0,0 +1,62 @@
+/**
+  ******************************************************************************
+  * @file           : recorder.c
+  * @brief          : Compact ring buffer trace of input events.
+  *
+  *                   RecordEvent is called by the single input interrupt
+  *                   context of the firmware. A record takes two bytes for
+  *                   events less than 128 ms apart, three up to 16 s. Once
+  *                   the ring is full the oldest records are dropped whole,
+  *                   so it always holds the latest input history.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "recorder.h"
+
+/* Private define ------------------------------------------------------------*/
+/* Tick delta fits in 5 varint bytes, plus the event byte */
+#define RECORD_MAX_LENGTH 6
+
+/* Private variables ---------------------------------------------------------*/
+struct Recorder recorder;
+
+/* Private function prototypes -----------------------------------------------*/
+void DropOldestRecord(void);
+
+/* Private user code ---------------------------------------------------------*/
+void InitRecorder(void)
+{
+  recorder.head = 0;
+  recorder.tail = 0;
+  recorder.droppedCount = 0;
+  recorder.lastTick = HAL_GetTick();
+}
+
+void RecordEvent(const uint8_t source, const bool isHigh)
+{
+  const uint32_t now = HAL_GetTick();
+  uint32_t delta = now - recorder.lastTick;
+  recorder.lastTick = now;
+  while (RECORDER_CAPACITY - (recorder.head - recorder.tail) < RECORD_MAX_LENGTH)
+  {
+    DropOldestRecord();
+  }
+  while (delta >= 0x80)
+  {
+    recorder.bytes[recorder.head++ % RECORDER_CAPACITY] = (uint8_t)(delta | 0x80);
+    delta >>= 7;
+  }
+  recorder.bytes[recorder.head++ % RECORDER_CAPACITY] = (uint8_t)delta;
+  recorder.bytes[recorder.head++ % RECORDER_CAPACITY] = (source & RECORDER_EVENT_SOURCE_MASK) | (isHigh ? RECORDER_EVENT_HIGH : 0);
+}
+
+void DropOldestRecord(void)
+{
+  /* Skip the varint continuation bytes, its last byte and the event byte */
+  while ((recorder.bytes[recorder.tail++ % RECORDER_CAPACITY] & 0x80) != 0)
+  {
+  }
+  ++recorder.tail;
+  ++recorder.droppedCount;
+}
@@ -0,0 +1,242 @@
+/**
+  ******************************************************************************
+  * @file           : serial.c
+  * @brief          : Streaming UART receive and queued transmit over DMA.
+  *
+  *                   The DMA fills a ring from the USART data register on its
+  *                   own, so the core is not interrupted per byte. The ring
+  *                   is drained at its half and full marks and when the line
+  *                   goes idle after a frame, whichever comes first, and the
+  *                   new bytes are handed to the callback where they lie.
+  *                   A drain that finds the DMA has lapped the read index
+  *                   counts a ring overrun.
+  *
+  *                   Transmits are linked into a queue by their descriptors
+  *                   and the DMA sends each buffer in place. The transfer
+  *                   complete interrupt starts the next one while the USART
+  *                   still shifts out the last two bytes, so back to back
+  *                   transmits leave no gap on the line.
+  *
+  *                   The USART and DMA interrupts must share a priority, so
+  *                   the handlers never preempt each other.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "serial.h"
+
+/* Private variables ---------------------------------------------------------*/
+struct SerialStats serialStats;
+UART_HandleTypeDef *serialUart;
+SerialReceiveCallback receiveCallback;
+uint8_t rxBuffer[SERIAL_RX_BUFFER_SIZE];
+uint16_t rxReadIndex;
+/* Half and full marks the DMA reported, and the ones the drained bytes went
+   past. More reports than crossings means the DMA lapped the read index */
+uint32_t rxMarksReported;
+uint32_t rxMarksDrained;
+struct SerialTransmit *txHead;
+struct SerialTransmit *txTail;
+uint8_t txQueueLength;
+
+/* Private function prototypes -----------------------------------------------*/
+void HandleReceiveDmaEvent(DMA_HandleTypeDef *hdma);
+void DeliverReceivedBytes(void);
+void HandleTransmitDmaEvent(DMA_HandleTypeDef *hdma);
+void HandleTransmitDmaError(DMA_HandleTypeDef *hdma);
+void StartTransmitDma(void);
+
+/* Private user code ---------------------------------------------------------*/
+HAL_StatusTypeDef StartSerialReceive(UART_HandleTypeDef *huart, SerialReceiveCallback callback)
+{
+  DMA_HandleTypeDef *hdma = huart->hdmarx;
+  serialUart = huart;
+  receiveCallback = callback;
+  rxReadIndex = 0;
+  rxMarksReported = 0;
+  rxMarksDrained = 0;
+
+  hdma->XferHalfCpltCallback = HandleReceiveDmaEvent;
+  hdma->XferCpltCallback = HandleReceiveDmaEvent;
+  if (HAL_DMA_Start_IT(hdma, (uint32_t)&huart->Instance->DR, (uint32_t)rxBuffer, SERIAL_RX_BUFFER_SIZE) != HAL_OK)
+  {
+    return HAL_ERROR;
+  }
+  /* Error interrupts have to be enabled by hand in DMA mode, or an overrun
+     would stall the receiver silently */
+  __HAL_UART_CLEAR_OREFLAG(huart);
+  __HAL_UART_ENABLE_IT(huart, UART_IT_IDLE);
+  __HAL_UART_ENABLE_IT(huart, UART_IT_ERR);
+  SET_BIT(huart->Instance->CR3, USART_CR3_DMAR);
+  return HAL_OK;
+}
+
+/* Replaces HAL_UART_IRQHandler, which would abort the DMA on an overrun */
+void HandleSerialInterrupt(UART_HandleTypeDef *huart)
+{
+  const uint32_t status = huart->Instance->SR;
+  if ((status & (USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE | USART_SR_PE)) == 0)
+  {
+    return;
+  }
+  /* Reading SR then DR clears every flag above. The byte in DR, if any,
+     has already been moved by the DMA, which reacts within a few cycles */
+  (void)huart->Instance->DR;
+  if ((status & USART_SR_ORE) != 0)
+  {
+    ++serialStats.overrunCount;
+  }
+  if ((status & (USART_SR_NE | USART_SR_FE | USART_SR_PE)) != 0)
+  {
+    ++serialStats.errorCount;
+  }
+  DeliverReceivedBytes();
+}
+
+void HandleReceiveDmaEvent(DMA_HandleTypeDef *hdma)
+{
+  ++rxMarksReported;
+  DeliverReceivedBytes();
+}
+
+void DeliverReceivedBytes(void)
+{
+  DMA_HandleTypeDef *hdma = serialUart->hdmarx;
+  /* Marks whose interrupt is still pending count as reported. The flags are
+     read before the counter, so a mark reached in between only shows up as
+     crossed and never looks like a lap */
+  uint32_t marksReported = rxMarksReported;
+  if (__HAL_DMA_GET_FLAG(hdma, __HAL_DMA_GET_HT_FLAG_INDEX(hdma)) != 0)
+  {
+    ++marksReported;
+  }
+  if (__HAL_DMA_GET_FLAG(hdma, __HAL_DMA_GET_TC_FLAG_INDEX(hdma)) != 0)
+  {
+    ++marksReported;
+  }
+  /* The DMA counts down and reloads to the full size at the end of the ring */
+  const uint16_t writeIndex = (SERIAL_RX_BUFFER_SIZE - __HAL_DMA_GET_COUNTER(hdma)) % SERIAL_RX_BUFFER_SIZE;
+  const uint16_t pending = (writeIndex + SERIAL_RX_BUFFER_SIZE - rxReadIndex) % SERIAL_RX_BUFFER_SIZE;
+  rxMarksDrained += (rxReadIndex + pending) / (SERIAL_RX_BUFFER_SIZE / 2) - rxReadIndex / (SERIAL_RX_BUFFER_SIZE / 2);
+  if ((int32_t)(marksReported - rxMarksDrained) > 0)
+  {
+    /* A whole ring was written over unread, what is left looks like fewer
+       bytes or none at all */
+    ++serialStats.overrunCount;
+    rxMarksDrained = marksReported;
+  }
+  else if ((int32_t)(rxMarksDrained - marksReported) > 1)
+  {
+    /* Only one mark can be reached between the flags and the counter. More
+       means a flag was raised twice before its interrupt was served, and
+       that report is gone for good */
+    rxMarksDrained = marksReported + 1;
+  }
+  if (pending == 0)
+  {
+    return;
+  }
+  if (pending > serialStats.highWaterMark)
+  {
+    serialStats.highWaterMark = pending;
+  }
+  serialStats.receivedCount += pending;
+
+  const uint16_t tailLength = SERIAL_RX_BUFFER_SIZE - rxReadIndex;
+  if (pending <= tailLength)
+  {
+    receiveCallback(&rxBuffer[rxReadIndex], pending);
+  }
+  else
+  {
+    receiveCallback(&rxBuffer[rxReadIndex], tailLength);
+    receiveCallback(rxBuffer, pending - tailLength);
+  }
+  rxReadIndex = writeIndex;
+}
+
+void StartSerialTransmit(UART_HandleTypeDef *huart)
+{
+  serialUart = huart;
+  txHead = NULL;
+  txTail = NULL;
+  txQueueLength = 0;
+  huart->hdmatx->XferCpltCallback = HandleTransmitDmaEvent;
+  huart->hdmatx->XferErrorCallback = HandleTransmitDmaError;
+  /* The request stays raised while TXE is set, the channel only moves
+     data once a transmit enables it */
+  SET_BIT(huart->Instance->CR3, USART_CR3_DMAT);
+}
+
+/* Returns HAL_BUSY as backpressure when the queue is full or the transmit
+   is still pending */
+HAL_StatusTypeDef QueueSerialTransmit(struct SerialTransmit *transmit)
+{
+  if (transmit->length == 0)
+  {
+    return HAL_ERROR;
+  }
+  HAL_StatusTypeDef status = HAL_OK;
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (transmit->isPending || (txQueueLength == SERIAL_TX_QUEUE_DEPTH))
+  {
+    ++serialStats.transmitBusyCount;
+    status = HAL_BUSY;
+  }
+  else
+  {
+    transmit->next = NULL;
+    transmit->isPending = true;
+    ++txQueueLength;
+    if (txHead == NULL)
+    {
+      txHead = transmit;
+      txTail = transmit;
+      StartTransmitDma();
+    }
+    else
+    {
+      txTail->next = transmit;
+      txTail = transmit;
+    }
+  }
+  __set_PRIMASK(primask);
+  return status;
+}
+
+/* True once the queue is empty and the last stop bit is on the line */
+bool IsSerialTransmitIdle(void)
+{
+  return (txHead == NULL) && ((serialUart->Instance->SR & USART_SR_TC) != 0);
+}
+
+void StartTransmitDma(void)
+{
+  /* Only ever called once the previous transfer completed, so the channel is ready */
+  (void)HAL_DMA_Start_IT(serialUart->hdmatx, (uint32_t)txHead->data, (uint32_t)&serialUart->Instance->DR, txHead->length);
+}
+
+void HandleTransmitDmaEvent(DMA_HandleTypeDef *hdma)
+{
+  struct SerialTransmit *sent = txHead;
+  txHead = sent->next;
+  --txQueueLength;
+  serialStats.transmittedCount += sent->length;
+  if (txHead != NULL)
+  {
+    StartTransmitDma();
+  }
+  sent->isPending = false;
+  if (sent->callback != NULL)
+  {
+    sent->callback(sent);
+  }
+}
+
+/* A failed transfer is dropped and the queue moves on */
+void HandleTransmitDmaError(DMA_HandleTypeDef *hdma)
+{
+  ++serialStats.errorCount;
+  HandleTransmitDmaEvent(hdma);
+}
@@ -0,0 +1,166 @@
+/**
+  ******************************************************************************
+  * @file           : timers.c
+  * @brief          : Software timers on a two level timing wheel.
+  *
+  *                   UpdateTimers runs from SysTick once per tick. A timer
+  *                   due within TIMER_WHEEL_SIZE ticks sits in the slot of
+  *                   its expiry tick on the first level, a later one in the
+  *                   second level slot of its expiry tick divided by
+  *                   TIMER_WHEEL_SIZE. Whenever the first level wraps, the
+  *                   next second level slot is moved down. Timers further
+  *                   away than the second level reaches are parked in its
+  *                   last slot and placed again on every pass. Starting,
+  *                   stopping and expiring a timer are all O(1).
+  *
+  *                   On expiry the callback runs, if any, and isExpired is
+  *                   set for code that polls with TakeTimerExpiry instead.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "timers.h"
+
+/* Private define ------------------------------------------------------------*/
+#define TIMER_WHEEL_MASK (TIMER_WHEEL_SIZE - 1)
+
+/* Private variables ---------------------------------------------------------*/
+struct Timer *firstLevel[TIMER_WHEEL_SIZE];
+struct Timer *secondLevel[TIMER_WHEEL_SIZE];
+/* Last tick processed by UpdateTimers */
+uint32_t timersTick;
+
+/* Private function prototypes -----------------------------------------------*/
+void InsertTimer(struct Timer *timer);
+void RemoveTimer(struct Timer *timer);
+struct Timer *DetachSlot(struct Timer **slot);
+
+/* Private user code ---------------------------------------------------------*/
+void StartTimer(struct Timer *timer, const uint32_t delay, const TimerCallback callback)
+{
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (timer->isArmed)
+  {
+    RemoveTimer(timer);
+  }
+  /* A zero delay still waits for the next tick */
+  timer->expiryTick = timersTick + ((delay != 0) ? delay : 1);
+  timer->callback = callback;
+  timer->isExpired = false;
+  timer->isArmed = true;
+  InsertTimer(timer);
+  __set_PRIMASK(primask);
+}
+
+void StopTimer(struct Timer *timer)
+{
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  if (timer->isArmed)
+  {
+    RemoveTimer(timer);
+    timer->isArmed = false;
+  }
+  timer->isExpired = false;
+  __set_PRIMASK(primask);
+}
+
+bool TakeTimerExpiry(struct Timer *timer)
+{
+  if (!timer->isExpired)
+  {
+    return false;
+  }
+  timer->isExpired = false;
+  return true;
+}
+
+void UpdateTimers(void)
+{
+  ++timersTick;
+  if ((timersTick & TIMER_WHEEL_MASK) == 0)
+  {
+    struct Timer *timer = DetachSlot(&secondLevel[(timersTick >> TIMER_WHEEL_BITS) & TIMER_WHEEL_MASK]);
+    while (timer != NULL)
+    {
+      struct Timer *next = timer->next;
+      InsertTimer(timer);
+      timer = next;
+    }
+  }
+
+  /* Walked from a local list head, so a callback restarting its timer
+     can't land in the list being walked and one stopping a timer due on
+     the same tick unlinks it from here */
+  struct Timer *expiring = DetachSlot(&firstLevel[timersTick & TIMER_WHEEL_MASK]);
+  if (expiring != NULL)
+  {
+    expiring->slot = &expiring;
+  }
+  while (expiring != NULL)
+  {
+    struct Timer *timer = expiring;
+    expiring = timer->next;
+    if (expiring != NULL)
+    {
+      expiring->previous = NULL;
+      expiring->slot = &expiring;
+    }
+    timer->isArmed = false;
+    timer->isExpired = true;
+    if (timer->callback != NULL)
+    {
+      timer->callback(timer);
+    }
+  }
+}
+
+void InsertTimer(struct Timer *timer)
+{
+  const uint32_t delta = timer->expiryTick - timersTick;
+  struct Timer **slot;
+  if (delta < TIMER_WHEEL_SIZE)
+  {
+    slot = &firstLevel[timer->expiryTick & TIMER_WHEEL_MASK];
+  }
+  else if (delta < TIMER_WHEEL_SIZE * TIMER_WHEEL_SIZE)
+  {
+    slot = &secondLevel[(timer->expiryTick >> TIMER_WHEEL_BITS) & TIMER_WHEEL_MASK];
+  }
+  else
+  {
+    slot = &secondLevel[((timersTick >> TIMER_WHEEL_BITS) - 1) & TIMER_WHEEL_MASK];
+  }
+  timer->slot = slot;
+  timer->previous = NULL;
+  timer->next = *slot;
+  if (*slot != NULL)
+  {
+    (*slot)->previous = timer;
+  }
+  *slot = timer;
+}
+
+void RemoveTimer(struct Timer *timer)
+{
+  if (timer->next != NULL)
+  {
+    timer->next->previous = timer->previous;
+  }
+  if (timer->previous != NULL)
+  {
+    timer->previous->next = timer->next;
+  }
+  else
+  {
+    *timer->slot = timer->next;
+  }
+}
+
+struct Timer *DetachSlot(struct Timer **slot)
+{
+  struct Timer *timer = *slot;
+  *slot = NULL;
+  return timer;
+}
@@ -32,11 +32,20 @@ extern "C" {
 
 /* Private includes ----------------------------------------------------------*/
 /* USER CODE BEGIN Includes */
+#include "profiler.h"
 
 /* USER CODE END Includes */
 
 /* Exported types ------------------------------------------------------------*/
 /* USER CODE BEGIN ET */
+/* Slots of profilerStats, one per profiled handler or critical section */
+enum ProfilerSlot
+{
+  PROFILE_SYSTICK,
+  PROFILE_PASSWORD_CHECK,
+  PROFILER_SLOTS_COUNT
+};
+_Static_assert(PROFILER_SLOTS_COUNT <= PROFILER_SLOTS_MAX_COUNT, "profilerStats has no room for every slot");
 
 /* USER CODE END ET */
 
@@ -96,13 +105,10 @@ void Error_Handler(void);
 #define KEYPAD_D_GPIO_Port GPIOB
 #define KEYPAD_1_Pin GPIO_PIN_5
 #define KEYPAD_1_GPIO_Port GPIOB
-#define KEYPAD_1_EXTI_IRQn EXTI9_5_IRQn
 #define KEYPAD_2_Pin GPIO_PIN_6
 #define KEYPAD_2_GPIO_Port GPIOB
-#define KEYPAD_2_EXTI_IRQn EXTI9_5_IRQn
 #define KEYPAD_3_Pin GPIO_PIN_7
 #define KEYPAD_3_GPIO_Port GPIOB
-#define KEYPAD_3_EXTI_IRQn EXTI9_5_IRQn
 /* USER CODE BEGIN Private defines */
 
 /* USER CODE END Private defines */
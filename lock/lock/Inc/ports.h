@@ -0,0 +1,33 @@
+/**
+  ******************************************************************************
+  * @file           : ports.h
+  * @brief          : Output pins of every port, generated by tools/ports.py
+  *                   from lock.ioc. Do not edit, run the script again once
+  *                   the pinout is changed in CubeMX.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PORTS_H
+#define __PORTS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* PORT_x_OUTPUT_PINS are the GPIO_Output pins, PORT_x_HIGH_PINS the ones of
+   them that start high */
+#define PORT_A_OUTPUT_PINS (GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_2 | GPIO_PIN_3 | GPIO_PIN_4 | GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10 | GPIO_PIN_11 | GPIO_PIN_13 | GPIO_PIN_14 | GPIO_PIN_15)
+#define PORT_A_HIGH_PINS 0
+#define PORT_B_OUTPUT_PINS (GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_2 | GPIO_PIN_3)
+#define PORT_B_HIGH_PINS 0
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PORTS_H */
@@ -0,0 +1,49 @@
+/**
+  ******************************************************************************
+  * @file           : power.h
+  * @brief          : Header for power.c file.
+  *                   SLEEP and STOP entry with the share of time spent in each.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __POWER_H
+#define __POWER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* Run time over which the shares are computed, in SysTick ms */
+#define SLEEP_STATS_WINDOW 1000
+
+/* Exported types ------------------------------------------------------------*/
+struct PowerStats
+{
+  /* Share of the run time of the last window spent in SLEEP, in percent */
+  uint8_t sleepPercent;
+  /* Share of the wall time of the last window spent in STOP, in percent */
+  uint8_t stopPercent;
+  /* Since boot */
+  uint32_t stopCount;
+  uint32_t stopTime; /* in ms */
+};
+
+/* Exported variables --------------------------------------------------------*/
+extern struct PowerStats powerStats;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void InitStopClock(void);
+void EnterSleepMode(void);
+HAL_StatusTypeDef EnterStopMode(void);
+void UpdateSleepStats(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __POWER_H */
@@ -0,0 +1,55 @@
+/**
+  ******************************************************************************
+  * @file           : recorder.h
+  * @brief          : Header for recorder.c file.
+  *                   Compact ring buffer trace of input events.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __RECORDER_H
+#define __RECORDER_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Must be a power of two */
+#ifndef RECORDER_CAPACITY
+#define RECORDER_CAPACITY 256
+#endif
+
+/* An event is a source (pin number or key) with its new level */
+#define RECORDER_EVENT_HIGH 0x80
+#define RECORDER_EVENT_SOURCE_MASK 0x7F
+
+/* Exported types ------------------------------------------------------------*/
+/* Records are the ms since the previous one as an LEB128 varint followed by
+   the event byte. head and tail count bytes and only wrap as integers */
+struct Recorder
+{
+  uint8_t bytes[RECORDER_CAPACITY];
+  uint32_t head;
+  uint32_t tail;
+  uint32_t lastTick;
+  uint32_t droppedCount;
+};
+
+/* Exported variables --------------------------------------------------------*/
+/* Dumped with the debugger, the oldest record starts at tail */
+extern struct Recorder recorder;
+
+/* Exported functions prototypes ---------------------------------------------*/
+void InitRecorder(void);
+void RecordEvent(const uint8_t source, const bool isHigh);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __RECORDER_H */
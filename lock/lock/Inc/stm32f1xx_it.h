@@ -56,7 +56,6 @@ void SVC_Handler(void);
 void DebugMon_Handler(void);
 void PendSV_Handler(void);
 void SysTick_Handler(void);
-void EXTI9_5_IRQHandler(void);
 void TIM1_UP_IRQHandler(void);
 /* USER CODE BEGIN EFP */
 
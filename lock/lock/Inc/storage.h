@@ -0,0 +1,39 @@
+/**
+  ******************************************************************************
+  * @file           : storage.h
+  * @brief          : Header for storage.c file.
+  *                   Log-structured key-value store in the last flash pages.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __STORAGE_H
+#define __STORAGE_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Keys are small integers indexing the RAM index */
+#define STORAGE_KEYS_COUNT 8
+#define STORAGE_PAGES_COUNT 2
+/* The pages sit at the very end of the flash, the linker region stops before them */
+#ifndef STORAGE_START_ADDRESS
+#define STORAGE_START_ADDRESS (FLASH_BANK1_END + 1 - STORAGE_PAGES_COUNT * FLASH_PAGE_SIZE)
+#endif
+
+/* Exported functions prototypes ---------------------------------------------*/
+HAL_StatusTypeDef InitStorage(void);
+bool ReadStorageValue(uint8_t key, uint32_t *value);
+HAL_StatusTypeDef WriteStorageValue(uint8_t key, uint32_t value);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __STORAGE_H */
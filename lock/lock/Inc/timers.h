@@ -0,0 +1,53 @@
+/**
+  ******************************************************************************
+  * @file           : timers.h
+  * @brief          : Header for timers.c file.
+  *                   Software timers on a two level timing wheel.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __TIMERS_H
+#define __TIMERS_H
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/* Exported constants --------------------------------------------------------*/
+/* Each level has 2^TIMER_WHEEL_BITS slots, the first one of 1 ms */
+#define TIMER_WHEEL_BITS 6
+#define TIMER_WHEEL_SIZE (1U << TIMER_WHEEL_BITS)
+
+/* Exported types ------------------------------------------------------------*/
+struct Timer;
+/* Runs from SysTick, so it must be short. It may restart its own timer */
+typedef void (*TimerCallback)(struct Timer *timer);
+
+struct Timer
+{
+  /* Filled in by the service */
+  struct Timer *next;
+  struct Timer *previous;
+  struct Timer **slot;
+  uint32_t expiryTick;
+  TimerCallback callback;
+  bool isArmed;
+  volatile bool isExpired;
+};
+
+/* Exported functions prototypes ---------------------------------------------*/
+void StartTimer(struct Timer *timer, const uint32_t delay, const TimerCallback callback);
+void StopTimer(struct Timer *timer);
+bool TakeTimerExpiry(struct Timer *timer);
+void UpdateTimers(void);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __TIMERS_H */
@@ -18,19 +18,74 @@
 
 /* Includes ------------------------------------------------------------------*/
 #include "main.h"
+#include "storage.h"
+#include "recorder.h"
+#include "board.h"
+#include "ports.h"
+#include "clock.h"
+#include "timers.h"
+#include "glyphs.h"
+#include "power.h"
 #include <stdbool.h>
 
 /* Defines -------------------------------------------------------------------*/
 #define LED_SIGNAL_TIMEOUT 2000
 #define DISPLAY_REACT_TIME 1
+#define TIMER_TICK_FREQUENCY 1000
 #define PASSWORD_LENGTH 4
+#define DISPLAY_SEGMENTS (DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin)
+#define DISPLAY_DIGITS (DISPLAY_1_Pin | DISPLAY_2_Pin | DISPLAY_3_Pin | DISPLAY_4_Pin)
+#define KEYPAD_ROWS_COUNT 4
+#define KEYPAD_COLUMNS_COUNT 3
+#define KEYPAD_KEYS_COUNT (KEYPAD_ROWS_COUNT * KEYPAD_COLUMNS_COUNT)
+#define KEYPAD_ROWS (KEYPAD_A_Pin | KEYPAD_B_Pin | KEYPAD_C_Pin | KEYPAD_D_Pin)
+#define KEYPAD_DEBOUNCE_SAMPLES 3
+#define KEY_EVENT_PRESSED 0x80
+#define KEY_EVENT_KEY_MASK 0x7F
+#define KEY_EVENTS_CAPACITY 16 /* must be a power of two */
+#define INPUT_TIMEOUT 10000
+#define USER_SLOTS_COUNT 4
+#define LOCKOUT_THRESHOLD 3
+#define LOCKOUT_BASE_TIME 5000
+#define LOCKOUT_MAX_SHIFT 6
+#define FNV_OFFSET_BASIS 0x811C9DC5
+#define FNV_PRIME 0x01000193
 
 /* Private typedef -----------------------------------------------------------*/
 enum InputState
 {
   IDLE,
   FIRST_PASSWORD_INPUT,
-  NEW_PUBLIC_PASSWORD_INPUT
+  USER_SLOT_SELECTION,
+  NEW_PUBLIC_PASSWORD_INPUT,
+  LOCKED_OUT,
+  INPUT_STATES_COUNT
+};
+
+enum InputEvent
+{
+  EVENT_NONE,
+  EVENT_NUMBER,
+  EVENT_STAR,
+  EVENT_SHARP,
+  EVENT_TIMEOUT,
+  /* Raised by the actions themselves */
+  EVENT_INPUT_COMPLETE,
+  EVENT_MASTER_PASSWORD,
+  EVENT_PUBLIC_PASSWORD,
+  EVENT_WRONG_PASSWORD,
+  EVENT_USER_SLOT_SELECTED,
+  EVENT_LOCKOUT,
+  INPUT_EVENTS_COUNT
+};
+
+/* An action may raise a follow-up event, which is dispatched in the next state */
+typedef enum InputEvent (*TransitionAction)(void);
+
+struct Transition
+{
+  TransitionAction action;
+  enum InputState nextState;
 };
 
 struct LedsState
@@ -38,6 +93,16 @@ struct LedsState
   bool red, yellow, green;
 };
 
+enum StorageKey
+{
+  /* Digits of the single public password of older firmwares, packed one per
+     byte with the first digit in the lowest one. Moved to slot 0 at boot */
+  STORAGE_LEGACY_PUBLIC_PASSWORD,
+  /* Salted hashes of the public passwords, one key per user slot */
+  STORAGE_USER_PASSWORDS,
+  STORAGE_FAILED_ATTEMPTS = STORAGE_USER_PASSWORDS + USER_SLOTS_COUNT
+};
+
 enum SymbolType
 {
   NONE,
@@ -47,296 +112,534 @@ enum SymbolType
 };
 
 /* Private variables ---------------------------------------------------------*/
+/* Lit segments of every glyph, resolved from the pin map at compile time */
+const uint16_t GLYPH_PINS[GLYPH_COUNT] = GLYPH_PINS_TABLE;
 TIM_HandleTypeDef htim1;
+DMA_HandleTypeDef hdma_tim1_up;
+/* Pin lists generated from lock.ioc by tools/ports.py, the keypad columns
+   stay floating inputs */
+const struct PortConfig PORT_A_CONFIG = PORT_CONFIG(PORT_A_OUTPUT_PINS, PORT_A_HIGH_PINS);
+const struct PortConfig PORT_B_CONFIG = PORT_CONFIG(PORT_B_OUTPUT_PINS, PORT_B_HIGH_PINS);
 const uint8_t MASTER_PASSWORD[] = { 4,4,9,2 };
-uint8_t publicPassword[] = { 1,8,5,2 };
+/* Given to user slot 0 until a public password is set */
+const uint8_t DEFAULT_PUBLIC_PASSWORD[] = { 1,8,5,2 };
+/* Overwrites the legacy digits once moved, no packed password has this value */
+const uint32_t LEGACY_PASSWORD_MOVED = 0xFFFFFFFF;
+const struct LedsState LEDS_OFF = { .red = false, .yellow = false, .green = false };
 enum InputState currentState = IDLE;
+/* Input timeout, then lockout time, polled from the main loop */
+struct Timer inputTimer;
+uint8_t pressedNumber;
+uint8_t selectedUserSlot;
+uint32_t failedAttempts;
 uint8_t enteredSymbolsCount;
 uint8_t enteredSymbols[4];
+/* GPIOA BSRR words streamed by DMA on every TIM1 update, one per digit */
+uint32_t displayFrame[PASSWORD_LENGTH];
+/* Fallback LEDs state applied from SysTick once the signal expires */
+struct LedsState fallbackLedsState;
+struct Timer ledsTimer;
+/* Keypad scanner state, owned by SysTick */
+uint8_t scannedRow;
+uint8_t keyIntegrators[KEYPAD_KEYS_COUNT];
+bool keyStates[KEYPAD_KEYS_COUNT];
+/* Single-producer (SysTick) single-consumer (main loop) key events ring */
+volatile uint8_t keyEvents[KEY_EVENTS_CAPACITY];
+volatile uint8_t keyEventsHead, keyEventsTail;
 
 /* Private function prototypes -----------------------------------------------*/
 void SystemClock_Config(void);
 static void MX_GPIO_Init(void);
+static void MX_DMA_Init(void);
 static void MX_TIM1_Init(void);
-void HAL_GPIO_EXTI_Callback(uint16_t);
-void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim);
-  
-enum SymbolType GetPressedSymbol(uint8_t*);
-int8_t GetPressedRow(void);
-int8_t GetPressedColumn(void);
+void HAL_SYSTICK_Callback(void);
+
+void ScanKeypad(void);
+void PushKeyEvent(const uint8_t);
+bool PopKeyEvent(uint8_t*);
+void HandleKeyEvent(const uint8_t);
+void DispatchInputEvent(enum InputEvent);
+void CheckInputTimeout(void);
+enum SymbolType GetKeySymbol(const uint8_t, uint8_t*);
 
 void SetLedsState(const struct LedsState);
 void SetLedsStateFor(const struct LedsState, const uint32_t, const struct LedsState);
-uint16_t GetPinsForNumber(const uint8_t);
-
-void IdleHandler(void);
-void FirstPasswordInputHandler(void);
-void NewPublicPasswordInputHandler(void);
-void Reset(void);
+void RestoreLedsState(struct Timer *);
+uint16_t GetPinsForGlyph(const uint8_t);
+uint32_t GetDisplayFrameWord(const uint8_t, const uint16_t);
+void UpdateDisplayFrame(void);
+void StartDisplay(void);
+void StopDisplay(void);
+
+enum InputEvent StartPasswordInput(void);
+enum InputEvent AppendDigit(void);
+enum InputEvent CheckPassword(void);
+enum InputEvent StartUserSlotSelection(void);
+enum InputEvent SelectUserSlot(void);
+enum InputEvent ChangePublicPassword(void);
+enum InputEvent AcceptPassword(void);
+enum InputEvent DenyAccess(void);
+enum InputEvent RejectPassword(void);
+enum InputEvent CancelInput(void);
+enum InputEvent StartLockout(void);
+enum InputEvent EndLockout(void);
+void StopPasswordInput(const struct LedsState);
 
 bool ArePasswordsEqual(const uint8_t[], const uint8_t[], const uint8_t length);
+uint32_t HashPassword(const uint8_t[], const uint8_t length, const uint8_t slot);
+bool IsPublicPasswordEntered(void);
+void InitUserPasswords(void);
+void SaveUserPassword(const uint8_t slot, const uint8_t[], const uint8_t length);
+void SaveFailedAttempts(const uint32_t);
 
-/* Private user code ---------------------------------------------------------*/
-void HAL_GPIO_EXTI_Callback(uint16_t GPIO_Pin)
+void EnterLowPowerMode(void);
+
+/* Private constants ---------------------------------------------------------*/
+/* Events missing from a state's row have no action and are ignored */
+const struct Transition TRANSITIONS[INPUT_STATES_COUNT][INPUT_EVENTS_COUNT] =
 {
-  switch (currentState)
+  [IDLE] =
+  {
+    [EVENT_STAR] = { StartPasswordInput, FIRST_PASSWORD_INPUT },
+    [EVENT_LOCKOUT] = { StartLockout, LOCKED_OUT }
+  },
+  [FIRST_PASSWORD_INPUT] =
+  {
+    [EVENT_NUMBER] = { AppendDigit, FIRST_PASSWORD_INPUT },
+    [EVENT_SHARP] = { CancelInput, IDLE },
+    [EVENT_TIMEOUT] = { CancelInput, IDLE },
+    [EVENT_INPUT_COMPLETE] = { CheckPassword, FIRST_PASSWORD_INPUT },
+    [EVENT_MASTER_PASSWORD] = { StartUserSlotSelection, USER_SLOT_SELECTION },
+    [EVENT_PUBLIC_PASSWORD] = { AcceptPassword, IDLE },
+    [EVENT_WRONG_PASSWORD] = { DenyAccess, IDLE }
+  },
+  [USER_SLOT_SELECTION] =
+  {
+    [EVENT_NUMBER] = { SelectUserSlot, USER_SLOT_SELECTION },
+    [EVENT_STAR] = { RejectPassword, IDLE },
+    [EVENT_SHARP] = { RejectPassword, IDLE },
+    [EVENT_TIMEOUT] = { RejectPassword, IDLE },
+    [EVENT_USER_SLOT_SELECTED] = { StartPasswordInput, NEW_PUBLIC_PASSWORD_INPUT }
+  },
+  [NEW_PUBLIC_PASSWORD_INPUT] =
+  {
+    [EVENT_NUMBER] = { AppendDigit, NEW_PUBLIC_PASSWORD_INPUT },
+    [EVENT_STAR] = { RejectPassword, IDLE },
+    [EVENT_SHARP] = { RejectPassword, IDLE },
+    [EVENT_TIMEOUT] = { RejectPassword, IDLE },
+    [EVENT_INPUT_COMPLETE] = { ChangePublicPassword, IDLE }
+  },
+  [LOCKED_OUT] =
   {
-    case IDLE:
-      IdleHandler();
-      break;
-    case FIRST_PASSWORD_INPUT:
-      FirstPasswordInputHandler();
-      break;
-    case NEW_PUBLIC_PASSWORD_INPUT:
-      NewPublicPasswordInputHandler();
-      break;
+    [EVENT_TIMEOUT] = { EndLockout, IDLE }
   }
-}
+};
 
-void HAL_TIM_PeriodElapsedCallback(TIM_HandleTypeDef *htim)
+/* Private user code ---------------------------------------------------------*/
+void HandleKeyEvent(const uint8_t keyEvent)
 {
-  const uint16_t allSegments = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
-  const uint16_t displayControls[PASSWORD_LENGTH] = { DISPLAY_1_Pin, DISPLAY_2_Pin, DISPLAY_3_Pin, DISPLAY_4_Pin };
-  for (uint8_t curSym = 0; curSym < enteredSymbolsCount; ++curSym)
+  if ((keyEvent & KEY_EVENT_PRESSED) == 0)
   {
-    HAL_GPIO_WritePin(GPIOA, displayControls[curSym], GPIO_PIN_SET);
-    HAL_GPIO_WritePin(GPIOA, allSegments, GPIO_PIN_SET);
-    HAL_GPIO_WritePin(GPIOA, GetPinsForNumber(enteredSymbols[curSym]), GPIO_PIN_RESET);
-    HAL_Delay(DISPLAY_REACT_TIME);
-    HAL_GPIO_WritePin(GPIOA, displayControls[curSym], GPIO_PIN_RESET);
+    return;
   }
-  for (uint8_t curSym = enteredSymbolsCount; curSym < PASSWORD_LENGTH; ++curSym)
+  const enum InputEvent SYMBOL_EVENTS[] = { [NONE] = EVENT_NONE, [NUMBER] = EVENT_NUMBER, [STAR] = EVENT_STAR, [SHARP] = EVENT_SHARP };
+  /* Keys pressed while locked out don't extend the lockout */
+  if (currentState != LOCKED_OUT)
   {
-    HAL_GPIO_WritePin(GPIOA, displayControls[curSym], GPIO_PIN_SET);
-    HAL_GPIO_WritePin(GPIOA, allSegments, GPIO_PIN_SET);
-    HAL_Delay(DISPLAY_REACT_TIME);
-    HAL_GPIO_WritePin(GPIOA, displayControls[curSym], GPIO_PIN_RESET);
+    StartTimer(&inputTimer, INPUT_TIMEOUT, NULL);
   }
-  HAL_GPIO_WritePin(GPIOA, allSegments, GPIO_PIN_RESET);
+  DispatchInputEvent(SYMBOL_EVENTS[GetKeySymbol(keyEvent & KEY_EVENT_KEY_MASK, &pressedNumber)]);
 }
 
-enum SymbolType GetPressedSymbol(uint8_t* number)
+void DispatchInputEvent(enum InputEvent event)
 {
-  const int8_t row = GetPressedRow(), column = GetPressedColumn();
-  enum SymbolType type = NONE;
-  if ((row != -1) && (column != -1))
+  while (event != EVENT_NONE)
   {
-    if ((row == 3) && (column == 0))
+    const struct Transition *transition = &TRANSITIONS[currentState][event];
+    if (transition->action == NULL)
     {
-      type = STAR;
-    }
-    else if ((row == 3) && (column == 2))
-    {
-      type = SHARP;
-    }
-    else
-    {
-      type = NUMBER;
-      if (number != NULL)
-      {
-        if (row == 3)
-        {
-          *number = 0;
-        }
-        else
-        {
-          *number = 3 * row + column + 1;
-        }
-      }
+      return;
     }
+    event = transition->action();
+    currentState = transition->nextState;
   }
-  return type;
 }
 
-int8_t GetPressedRow(void)
+void CheckInputTimeout(void)
 {
-  int8_t row = -1;
-  if (HAL_GPIO_ReadPin(KEYPAD_A_GPIO_Port, KEYPAD_A_Pin) == GPIO_PIN_SET)
+  if (TakeTimerExpiry(&inputTimer) && (currentState != IDLE))
   {
-    row = 0;
+    DispatchInputEvent(EVENT_TIMEOUT);
   }
-  else if (HAL_GPIO_ReadPin(KEYPAD_B_GPIO_Port, KEYPAD_B_Pin) == GPIO_PIN_SET)
+}
+
+uint32_t GetDisplayFrameWord(const uint8_t digit, const uint16_t segments)
+{
+  const uint16_t displayControls[PASSWORD_LENGTH] = { DISPLAY_1_Pin, DISPLAY_2_Pin, DISPLAY_3_Pin, DISPLAY_4_Pin };
+  /* Segments are lit on low level, the selected digit on high level */
+  const uint16_t setPins = displayControls[digit] | (DISPLAY_SEGMENTS & ~segments);
+  const uint16_t resetPins = (DISPLAY_DIGITS & ~displayControls[digit]) | segments;
+  return ((uint32_t)resetPins << 16) | setPins;
+}
+
+void UpdateDisplayFrame(void)
+{
+  for (uint8_t curSym = 0; curSym < PASSWORD_LENGTH; ++curSym)
   {
-    row = 1;
+    const uint16_t segments = (curSym < enteredSymbolsCount) ? GetPinsForGlyph(enteredSymbols[curSym]) : GetPinsForGlyph(GLYPH_BLANK);
+    displayFrame[curSym] = GetDisplayFrameWord(curSym, segments);
   }
-  else if (HAL_GPIO_ReadPin(KEYPAD_C_GPIO_Port, KEYPAD_C_Pin) == GPIO_PIN_SET)
+}
+
+void StartDisplay(void)
+{
+  UpdateDisplayFrame();
+  HAL_DMA_Start(&hdma_tim1_up, (uint32_t)displayFrame, (uint32_t)&GPIOA->BSRR, PASSWORD_LENGTH);
+  __HAL_TIM_ENABLE_DMA(&htim1, TIM_DMA_UPDATE);
+  __HAL_TIM_ENABLE(&htim1);
+}
+
+void StopDisplay(void)
+{
+  __HAL_TIM_DISABLE(&htim1);
+  __HAL_TIM_DISABLE_DMA(&htim1, TIM_DMA_UPDATE);
+  HAL_DMA_Abort(&hdma_tim1_up);
+  FastWritePin(GPIOA, DISPLAY_DIGITS | DISPLAY_SEGMENTS, GPIO_PIN_RESET);
+}
+
+void HAL_SYSTICK_Callback(void)
+{
+  ScanKeypad();
+  UpdateTimers();
+}
+
+void ScanKeypad(void)
+{
+  const uint16_t rowPins[KEYPAD_ROWS_COUNT] = { KEYPAD_A_Pin, KEYPAD_B_Pin, KEYPAD_C_Pin, KEYPAD_D_Pin };
+  const uint16_t columnPins[KEYPAD_COLUMNS_COUNT] = { KEYPAD_1_Pin, KEYPAD_2_Pin, KEYPAD_3_Pin };
+  /* The row was driven on the previous tick, so the columns have settled */
+  const uint32_t columns = KEYPAD_1_GPIO_Port->IDR;
+  for (uint8_t column = 0; column < KEYPAD_COLUMNS_COUNT; ++column)
   {
-    row = 2;
+    const uint8_t key = KEYPAD_COLUMNS_COUNT * scannedRow + column;
+    if ((columns & columnPins[column]) != 0)
+    {
+      if ((keyIntegrators[key] < KEYPAD_DEBOUNCE_SAMPLES) && (++keyIntegrators[key] == KEYPAD_DEBOUNCE_SAMPLES) && !keyStates[key])
+      {
+        keyStates[key] = true;
+        PushKeyEvent(key | KEY_EVENT_PRESSED);
+      }
+    }
+    else if ((keyIntegrators[key] > 0) && (--keyIntegrators[key] == 0) && keyStates[key])
+    {
+      keyStates[key] = false;
+      PushKeyEvent(key);
+    }
   }
-  else if (HAL_GPIO_ReadPin(KEYPAD_D_GPIO_Port, KEYPAD_D_Pin) == GPIO_PIN_SET)
+  scannedRow = (scannedRow + 1) % KEYPAD_ROWS_COUNT;
+  KEYPAD_A_GPIO_Port->BSRR = ((uint32_t)(KEYPAD_ROWS & ~rowPins[scannedRow]) << 16) | rowPins[scannedRow];
+}
+
+void PushKeyEvent(const uint8_t keyEvent)
+{
+  RecordEvent(keyEvent & KEY_EVENT_KEY_MASK, (keyEvent & KEY_EVENT_PRESSED) != 0);
+  const uint8_t head = keyEventsHead;
+  if ((uint8_t)(head - keyEventsTail) < KEY_EVENTS_CAPACITY)
   {
-    row = 3;
+    keyEvents[head % KEY_EVENTS_CAPACITY] = keyEvent;
+    keyEventsHead = head + 1;
   }
-  return row;
 }
 
-int8_t GetPressedColumn(void)
+bool PopKeyEvent(uint8_t* keyEvent)
 {
-  int8_t column = -1;
-  if (HAL_GPIO_ReadPin(KEYPAD_1_GPIO_Port, KEYPAD_1_Pin) == GPIO_PIN_SET)
+  const uint8_t tail = keyEventsTail;
+  if (tail == keyEventsHead)
   {
-    column = 0;
+    return false;
   }
-  else if (HAL_GPIO_ReadPin(KEYPAD_2_GPIO_Port, KEYPAD_2_Pin) == GPIO_PIN_SET)
+  *keyEvent = keyEvents[tail % KEY_EVENTS_CAPACITY];
+  keyEventsTail = tail + 1;
+  return true;
+}
+
+enum SymbolType GetKeySymbol(const uint8_t key, uint8_t* number)
+{
+  const uint8_t row = key / KEYPAD_COLUMNS_COUNT, column = key % KEYPAD_COLUMNS_COUNT;
+  enum SymbolType type = NONE;
+  if ((row == 3) && (column == 0))
   {
-    column = 1;
+    type = STAR;
   }
-  else if (HAL_GPIO_ReadPin(KEYPAD_3_GPIO_Port, KEYPAD_3_Pin) == GPIO_PIN_SET)
+  else if ((row == 3) && (column == 2))
   {
-    column = 2;
+    type = SHARP;
   }
-  return column;
+  else
+  {
+    type = NUMBER;
+    if (number != NULL)
+    {
+      if (row == 3)
+      {
+        *number = 0;
+      }
+      else
+      {
+        *number = 3 * row + column + 1;
+      }
+    }
+  }
+  return type;
 }
 
 void SetLedsState(const struct LedsState state)
 {
-  HAL_GPIO_WritePin(LED_RED_GPIO_Port, LED_RED_Pin, state.red ? GPIO_PIN_SET : GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(LED_YELLOW_GPIO_Port, LED_YELLOW_Pin, state.yellow ? GPIO_PIN_SET : GPIO_PIN_RESET);
-  HAL_GPIO_WritePin(LED_GREEN_GPIO_Port, LED_GREEN_Pin, state.green ? GPIO_PIN_SET : GPIO_PIN_RESET);
+  StopTimer(&ledsTimer);
+  FastWritePin(LED_RED_GPIO_Port, LED_RED_Pin, state.red ? GPIO_PIN_SET : GPIO_PIN_RESET);
+  FastWritePin(LED_YELLOW_GPIO_Port, LED_YELLOW_Pin, state.yellow ? GPIO_PIN_SET : GPIO_PIN_RESET);
+  FastWritePin(LED_GREEN_GPIO_Port, LED_GREEN_Pin, state.green ? GPIO_PIN_SET : GPIO_PIN_RESET);
 }
 
 void SetLedsStateFor(const struct LedsState state, const uint32_t delay, const struct LedsState fallbackState)
 {
   SetLedsState(state);
-  HAL_Delay(delay);
-  SetLedsState(fallbackState);
+  fallbackLedsState = fallbackState;
+  StartTimer(&ledsTimer, delay, RestoreLedsState);
+}
+
+void RestoreLedsState(struct Timer *timer)
+{
+  SetLedsState(fallbackLedsState);
+}
+
+uint16_t GetPinsForGlyph(const uint8_t glyph)
+{
+  return (glyph < GLYPH_COUNT) ? GLYPH_PINS[glyph] : 0;
+}
+
+enum InputEvent StartPasswordInput(void)
+{
+  enteredSymbolsCount = 0;
+  StartDisplay();
+  return EVENT_NONE;
+}
+
+enum InputEvent AppendDigit(void)
+{
+  enteredSymbols[enteredSymbolsCount++] = pressedNumber;
+  UpdateDisplayFrame();
+  return (enteredSymbolsCount == PASSWORD_LENGTH) ? EVENT_INPUT_COMPLETE : EVENT_NONE;
 }
 
-uint16_t GetPinsForNumber(const uint8_t numberToDisplay)
+enum InputEvent CheckPassword(void)
 {
-  switch (numberToDisplay)
+  /* Masked while timed, so the interrupts don't add to the spread of the
+     profiler slot and it shows the time of the check alone */
+  const uint32_t primask = __get_PRIMASK();
+  __disable_irq();
+  const uint32_t profileStart = BeginProfile();
+  /* Both checks always run, so the time taken doesn't tell which one matched */
+  const bool isMasterPassword = ArePasswordsEqual(enteredSymbols, MASTER_PASSWORD, PASSWORD_LENGTH);
+  const bool isPublicPassword = IsPublicPasswordEntered();
+  EndProfile(PROFILE_PASSWORD_CHECK, profileStart);
+  __set_PRIMASK(primask);
+  if (isMasterPassword)
   {
-    case 0:
-      return DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin;
-    case 1:
-      return DISPLAY_B_Pin | DISPLAY_C_Pin;
-    case 2:
-      return DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_G_Pin;
-    case 3:
-      return DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_G_Pin;
-    case 4:
-      return DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
-    case 5:
-      return DISPLAY_A_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
-    case 6:
-      return DISPLAY_A_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
-    case 7:
-      return DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin;
-    case 8:
-      return DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
-    case 9:
-      return DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
-    default:
-      return 0;
+    return EVENT_MASTER_PASSWORD;
   }
+  return isPublicPassword ? EVENT_PUBLIC_PASSWORD : EVENT_WRONG_PASSWORD;
 }
 
-void IdleHandler()
+enum InputEvent StartUserSlotSelection(void)
 {
-  if (GetPressedSymbol(NULL) == STAR)
+  const struct LedsState state = { .red = true, .yellow = true, .green = true };
+  StopDisplay();
+  enteredSymbolsCount = 0;
+  SetLedsState(state);
+  if (failedAttempts != 0)
   {
-    enteredSymbolsCount = 0;
-    HAL_TIM_Base_Start_IT(&htim1);
-    currentState = FIRST_PASSWORD_INPUT;
+    SaveFailedAttempts(0);
   }
+  return EVENT_NONE;
 }
 
-void FirstPasswordInputHandler(void)
+enum InputEvent SelectUserSlot(void)
 {
-  uint8_t pressedNumber;
-  const enum SymbolType symType = GetPressedSymbol(&pressedNumber);
-  if (symType == NUMBER)
+  if (pressedNumber >= USER_SLOTS_COUNT)
   {
-    enteredSymbols[enteredSymbolsCount++] = pressedNumber;
-    if (enteredSymbolsCount == PASSWORD_LENGTH)
-    {
-      if (ArePasswordsEqual(enteredSymbols, MASTER_PASSWORD, PASSWORD_LENGTH))
-      {
-        Reset();
-        const struct LedsState state = { .red = true, .yellow = true, .green = true };
-        SetLedsState(state);
-        currentState = NEW_PUBLIC_PASSWORD_INPUT;
-        HAL_TIM_Base_Start_IT(&htim1);
-        while (GetPressedSymbol(NULL) == NUMBER)
-        {
-          HAL_Delay(1);
-        }
-      }
-      else
-      {
-        const bool isPasswordCorrect = ArePasswordsEqual(enteredSymbols, publicPassword, PASSWORD_LENGTH);
-        const struct LedsState state = { .red = !isPasswordCorrect, .yellow = false, .green = isPasswordCorrect },
-          fallbackState = { .red = false, .yellow = false, .green = false };
-        SetLedsStateFor(state, LED_SIGNAL_TIMEOUT, fallbackState);
-        Reset();
-      }
-    }
-    else
-    {
-      while (GetPressedSymbol(NULL) == NUMBER)
-      {
-        HAL_Delay(1);
-      }
-    }
+    return EVENT_NONE;
+  }
+  selectedUserSlot = pressedNumber;
+  return EVENT_USER_SLOT_SELECTED;
+}
+
+enum InputEvent ChangePublicPassword(void)
+{
+  SaveUserPassword(selectedUserSlot, enteredSymbols, PASSWORD_LENGTH);
+  return AcceptPassword();
+}
+
+enum InputEvent AcceptPassword(void)
+{
+  const struct LedsState state = { .red = false, .yellow = false, .green = true };
+  StopPasswordInput(state);
+  if (failedAttempts != 0)
+  {
+    SaveFailedAttempts(0);
+  }
+  return EVENT_NONE;
+}
+
+enum InputEvent DenyAccess(void)
+{
+  RejectPassword();
+  SaveFailedAttempts(failedAttempts + 1);
+  return (failedAttempts >= LOCKOUT_THRESHOLD) ? EVENT_LOCKOUT : EVENT_NONE;
+}
+
+enum InputEvent RejectPassword(void)
+{
+  const struct LedsState state = { .red = true, .yellow = false, .green = false };
+  StopPasswordInput(state);
+  return EVENT_NONE;
+}
+
+enum InputEvent CancelInput(void)
+{
+  const struct LedsState state = { .red = false, .yellow = true, .green = false };
+  StopPasswordInput(state);
+  return EVENT_NONE;
+}
+
+/* The lockout doubles with every failed attempt past the threshold and
+   runs on a software timer, so the core still sleeps through it */
+enum InputEvent StartLockout(void)
+{
+  const struct LedsState state = { .red = true, .yellow = false, .green = false };
+  const uint32_t shift = failedAttempts - LOCKOUT_THRESHOLD;
+  SetLedsState(state);
+  StartTimer(&inputTimer, (uint32_t)LOCKOUT_BASE_TIME << ((shift < LOCKOUT_MAX_SHIFT) ? shift : LOCKOUT_MAX_SHIFT), NULL);
+  return EVENT_NONE;
+}
+
+enum InputEvent EndLockout(void)
+{
+  SetLedsState(LEDS_OFF);
+  return EVENT_NONE;
+}
+
+void StopPasswordInput(const struct LedsState signal)
+{
+  SetLedsStateFor(signal, LED_SIGNAL_TIMEOUT, LEDS_OFF);
+  StopDisplay();
+  enteredSymbolsCount = 0;
+}
+
+/* Runs in the same time whatever the position of the first mismatch */
+bool ArePasswordsEqual(const uint8_t first[], const uint8_t second[], const uint8_t length)
+{
+  uint8_t difference = 0;
+  for (uint8_t i = 0; i < length; ++i)
+  {
+    difference |= first[i] ^ second[i];
+  }
+  return difference == 0;
+}
+
+/* FNV-1a over the device unique ID, the slot, the length and the digits,
+   so equal passwords give different hashes on other slots and devices */
+uint32_t HashPassword(const uint8_t password[], const uint8_t length, const uint8_t slot)
+{
+  const uint8_t *uid = (const uint8_t *)UID_BASE;
+  uint32_t hash = FNV_OFFSET_BASIS;
+  for (uint8_t i = 0; i < 12; ++i)
+  {
+    hash = (hash ^ uid[i]) * FNV_PRIME;
+  }
+  hash = (hash ^ slot) * FNV_PRIME;
+  hash = (hash ^ length) * FNV_PRIME;
+  for (uint8_t i = 0; i < length; ++i)
+  {
+    hash = (hash ^ password[i]) * FNV_PRIME;
   }
-  else if (symType == SHARP)
+  return hash;
+}
+
+bool IsPublicPasswordEntered(void)
+{
+  uint32_t matches = 0;
+  /* Every slot is hashed and compared, empty or not, without branching on the result */
+  for (uint8_t slot = 0; slot < USER_SLOTS_COUNT; ++slot)
   {
-    const struct LedsState state = { .red = false, .yellow = true, .green = false },
-      fallbackState = { .red = false, .yellow = false, .green = false };
-    SetLedsStateFor(state, LED_SIGNAL_TIMEOUT, fallbackState);
-    Reset();
+    uint32_t storedHash = 0;
+    const uint32_t isSet = ReadStorageValue(STORAGE_USER_PASSWORDS + slot, &storedHash) ? 1 : 0;
+    const uint32_t difference = HashPassword(enteredSymbols, enteredSymbolsCount, slot) ^ storedHash;
+    matches |= isSet & (uint32_t)(difference == 0);
   }
+  return matches != 0;
 }
 
-void NewPublicPasswordInputHandler(void)
+void InitUserPasswords(void)
 {
-  uint8_t pressedNumber;
-  const enum SymbolType symType = GetPressedSymbol(&pressedNumber);
-  if (symType == NUMBER)
+  uint32_t value;
+  if (ReadStorageValue(STORAGE_LEGACY_PUBLIC_PASSWORD, &value) && (value != LEGACY_PASSWORD_MOVED))
   {
-    enteredSymbols[enteredSymbolsCount++] = pressedNumber;
-    if (enteredSymbolsCount == PASSWORD_LENGTH)
+    /* The password of an upgraded device keeps working from slot 0, and
+       its plain digits don't stay in flash */
+    uint8_t password[PASSWORD_LENGTH];
+    for (uint8_t i = 0; i < PASSWORD_LENGTH; ++i)
     {
-      for (uint8_t i = 0; i < PASSWORD_LENGTH; ++i)
-      {
-        publicPassword[i] = enteredSymbols[i];
-      }
-      const struct LedsState state = { .red = false, .yellow = false, .green = true },
-        fallbackState = { .red = false, .yellow = false, .green = false };
-      SetLedsStateFor(state, LED_SIGNAL_TIMEOUT, fallbackState);
-      Reset();
+      password[i] = (uint8_t)(value >> (8 * i));
     }
-    else
+    SaveUserPassword(0, password, PASSWORD_LENGTH);
+    if (WriteStorageValue(STORAGE_LEGACY_PUBLIC_PASSWORD, LEGACY_PASSWORD_MOVED) != HAL_OK)
     {
-      while (GetPressedSymbol(NULL) == NUMBER);
+      Error_Handler();
     }
   }
-  else if ((symType == STAR) || (symType == SHARP))
+  else if (!ReadStorageValue(STORAGE_USER_PASSWORDS, &value))
+  {
+    SaveUserPassword(0, DEFAULT_PUBLIC_PASSWORD, PASSWORD_LENGTH);
+  }
+  if (ReadStorageValue(STORAGE_FAILED_ATTEMPTS, &value))
+  {
+    failedAttempts = value;
+  }
+  /* A reset doesn't skip a lockout that was running */
+  if (failedAttempts >= LOCKOUT_THRESHOLD)
   {
-    const struct LedsState state = { .red = true, .yellow = false, .green = false },
-      fallbackState = { .red = false, .yellow = false, .green = false };
-    SetLedsStateFor(state, LED_SIGNAL_TIMEOUT, fallbackState);
-    Reset();
+    DispatchInputEvent(EVENT_LOCKOUT);
   }
 }
 
-void Reset(void)
+void SaveUserPassword(const uint8_t slot, const uint8_t password[], const uint8_t length)
 {
-  HAL_TIM_Base_Stop_IT(&htim1);
-  enteredSymbolsCount = 0;
-  const struct LedsState state = { .red = false, .yellow = false, .green = false };
-  SetLedsState(state);
-  currentState = IDLE;
+  if (WriteStorageValue(STORAGE_USER_PASSWORDS + slot, HashPassword(password, length, slot)) != HAL_OK)
+  {
+    Error_Handler();
+  }
 }
 
-bool ArePasswordsEqual(const uint8_t first[], const uint8_t second[], const uint8_t length)
+/* Kept in flash, so power cycling doesn't reset the backoff */
+void SaveFailedAttempts(const uint32_t count)
 {
-  bool result = true;
-  for (uint8_t i = 0; result && (i < length); ++i)
+  failedAttempts = count;
+  if (WriteStorageValue(STORAGE_FAILED_ATTEMPTS, count) != HAL_OK)
   {
-    result = result && (first[i] == second[i]);
+    Error_Handler();
   }
-  return result;
+}
+
+void EnterLowPowerMode(void)
+{
+  /* SysTick keeps scanning the keypad, so only SLEEP is allowed here */
+  __disable_irq();
+  if (keyEventsHead == keyEventsTail)
+  {
+    EnterSleepMode();
+  }
+  __enable_irq();
 }
 
 /**
@@ -352,20 +655,32 @@ int main(void)
 
   /* Configure the system clock */
   SystemClock_Config();
+  InitProfiler();
+  InitRecorder();
 
   /* Initialize all configured peripherals */
   MX_GPIO_Init();
+  MX_DMA_Init();
   MX_TIM1_Init();
+  RegisterScaledTimer(&htim1, TIMER_TICK_FREQUENCY);
+
+  if (InitStorage() != HAL_OK)
+  {
+    Error_Handler();
+  }
+  InitUserPasswords();
 
   /* Infinite loop */
-  const uint16_t Scan_Pins[] = { KEYPAD_A_Pin, KEYPAD_B_Pin, KEYPAD_C_Pin, KEYPAD_D_Pin };
-  const uint8_t Scan_Pins_Count = sizeof(Scan_Pins) / sizeof(Scan_Pins[0]);
-  for (uint8_t Cur_Pin = 0;; Cur_Pin = (Cur_Pin + 1) % Scan_Pins_Count)
+  uint8_t keyEvent;
+  while (true)
   {
-    HAL_GPIO_WritePin(GPIOB, Scan_Pins[Cur_Pin], GPIO_PIN_SET);
-    HAL_Delay(1);
-    HAL_GPIO_WritePin(GPIOB, Scan_Pins[Cur_Pin], GPIO_PIN_RESET);
-    HAL_Delay(1);
+    while (PopKeyEvent(&keyEvent))
+    {
+      HandleKeyEvent(keyEvent);
+    }
+    CheckInputTimeout();
+    UpdateSleepStats();
+    EnterLowPowerMode();
   }
 }
 
@@ -375,29 +690,7 @@ int main(void)
   */
 void SystemClock_Config(void)
 {
-  RCC_OscInitTypeDef RCC_OscInitStruct = {0};
-  RCC_ClkInitTypeDef RCC_ClkInitStruct = {0};
-
-  /** Initializes the CPU, AHB and APB busses clocks 
-  */
-  RCC_OscInitStruct.OscillatorType = RCC_OSCILLATORTYPE_HSI;
-  RCC_OscInitStruct.HSIState = RCC_HSI_ON;
-  RCC_OscInitStruct.HSICalibrationValue = RCC_HSICALIBRATION_DEFAULT;
-  RCC_OscInitStruct.PLL.PLLState = RCC_PLL_NONE;
-  if (HAL_RCC_OscConfig(&RCC_OscInitStruct) != HAL_OK)
-  {
-    Error_Handler();
-  }
-  /** Initializes the CPU, AHB and APB busses clocks 
-  */
-  RCC_ClkInitStruct.ClockType = RCC_CLOCKTYPE_HCLK|RCC_CLOCKTYPE_SYSCLK
-                              |RCC_CLOCKTYPE_PCLK1|RCC_CLOCKTYPE_PCLK2;
-  RCC_ClkInitStruct.SYSCLKSource = RCC_SYSCLKSOURCE_HSI;
-  RCC_ClkInitStruct.AHBCLKDivider = RCC_SYSCLK_DIV1;
-  RCC_ClkInitStruct.APB1CLKDivider = RCC_HCLK_DIV1;
-  RCC_ClkInitStruct.APB2CLKDivider = RCC_HCLK_DIV1;
-
-  if (HAL_RCC_ClockConfig(&RCC_ClkInitStruct, FLASH_LATENCY_0) != HAL_OK)
+  if (SetClockProfile(CLOCK_PROFILE_LOW_POWER) != HAL_OK)
   {
     Error_Handler();
   }
@@ -414,9 +707,9 @@ static void MX_TIM1_Init(void)
   TIM_MasterConfigTypeDef sMasterConfig = {0};
 
   htim1.Instance = TIM1;
-  htim1.Init.Prescaler = 8000 - 1;
+  htim1.Init.Prescaler = GetTimerPrescaler(TIM1, TIMER_TICK_FREQUENCY);
   htim1.Init.CounterMode = TIM_COUNTERMODE_UP;
-  htim1.Init.Period = 10 * DISPLAY_REACT_TIME;
+  htim1.Init.Period = DISPLAY_REACT_TIME;
   htim1.Init.ClockDivision = TIM_CLOCKDIVISION_DIV1;
   htim1.Init.RepetitionCounter = 0;
   htim1.Init.AutoReloadPreload = TIM_AUTORELOAD_PRELOAD_DISABLE;
@@ -437,6 +730,17 @@ static void MX_TIM1_Init(void)
   }
 }
 
+/**
+  * @brief DMA Initialization Function
+  * @param None
+  * @retval None
+  */
+static void MX_DMA_Init(void)
+{
+  /* DMA controller clock enable */
+  __HAL_RCC_DMA1_CLK_ENABLE();
+}
+
 /**
   * @brief GPIO Initialization Function
   * @param None
@@ -444,50 +748,12 @@ static void MX_TIM1_Init(void)
   */
 static void MX_GPIO_Init(void)
 {
-  GPIO_InitTypeDef GPIO_InitStruct = {0};
-
   /* GPIO Ports Clock Enable */
   __HAL_RCC_GPIOA_CLK_ENABLE();
   __HAL_RCC_GPIOB_CLK_ENABLE();
 
-  /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(GPIOA, DISPLAY_G_Pin|DISPLAY_F_Pin|DISPLAY_E_Pin|DISPLAY_D_Pin 
-                          |DISPLAY_C_Pin|DISPLAY_B_Pin|DISPLAY_A_Pin|DISPLAY_1_Pin 
-                          |DISPLAY_2_Pin|DISPLAY_3_Pin|DISPLAY_4_Pin|LED_RED_Pin 
-                          |LED_YELLOW_Pin|LED_GREEN_Pin, GPIO_PIN_RESET);
-
-  /*Configure GPIO pin Output Level */
-  HAL_GPIO_WritePin(GPIOB, KEYPAD_A_Pin|KEYPAD_B_Pin|KEYPAD_C_Pin|KEYPAD_D_Pin, GPIO_PIN_RESET);
-
-  /*Configure GPIO pins : DISPLAY_G_Pin DISPLAY_F_Pin DISPLAY_E_Pin DISPLAY_D_Pin 
-                           DISPLAY_C_Pin DISPLAY_B_Pin DISPLAY_A_Pin DISPLAY_1_Pin 
-                           DISPLAY_2_Pin DISPLAY_3_Pin DISPLAY_4_Pin LED_RED_Pin 
-                           LED_YELLOW_Pin LED_GREEN_Pin */
-  GPIO_InitStruct.Pin = DISPLAY_G_Pin|DISPLAY_F_Pin|DISPLAY_E_Pin|DISPLAY_D_Pin 
-                          |DISPLAY_C_Pin|DISPLAY_B_Pin|DISPLAY_A_Pin|DISPLAY_1_Pin 
-                          |DISPLAY_2_Pin|DISPLAY_3_Pin|DISPLAY_4_Pin|LED_RED_Pin 
-                          |LED_YELLOW_Pin|LED_GREEN_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOA, &GPIO_InitStruct);
-
-  /*Configure GPIO pins : KEYPAD_A_Pin KEYPAD_B_Pin KEYPAD_C_Pin KEYPAD_D_Pin */
-  GPIO_InitStruct.Pin = KEYPAD_A_Pin|KEYPAD_B_Pin|KEYPAD_C_Pin|KEYPAD_D_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_OUTPUT_PP;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  GPIO_InitStruct.Speed = GPIO_SPEED_FREQ_LOW;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-  /*Configure GPIO pins : KEYPAD_1_Pin KEYPAD_2_Pin KEYPAD_3_Pin */
-  GPIO_InitStruct.Pin = KEYPAD_1_Pin|KEYPAD_2_Pin|KEYPAD_3_Pin;
-  GPIO_InitStruct.Mode = GPIO_MODE_IT_RISING;
-  GPIO_InitStruct.Pull = GPIO_NOPULL;
-  HAL_GPIO_Init(GPIOB, &GPIO_InitStruct);
-
-  /* EXTI interrupt init*/
-  HAL_NVIC_SetPriority(EXTI9_5_IRQn, 2, 0);
-  HAL_NVIC_EnableIRQ(EXTI9_5_IRQn);
+  ConfigurePort(GPIOA, &PORT_A_CONFIG);
+  ConfigurePort(GPIOB, &PORT_B_CONFIG);
 }
 
 /**
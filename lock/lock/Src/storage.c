@@ -0,0 +1,286 @@
+/**
+  ******************************************************************************
+  * @file           : storage.c
+  * @brief          : Log-structured key-value store in the last flash pages.
+  *
+  *                   One page is active at a time and records are appended to
+  *                   it; a record is committed by programming its key last,
+  *                   and a CRC rejects records torn by a power loss. When the
+  *                   active page is full the latest value of every key is
+  *                   copied to the other page, which then becomes active:
+  *                   the page states make this recoverable at any point.
+  *                   Lookups are served from a RAM index built at boot.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "storage.h"
+#include <stddef.h>
+
+/* Private define ------------------------------------------------------------*/
+#define PAGE_ERASED 0xFFFF
+#define PAGE_RECEIVING 0xEEEE
+#define PAGE_ACTIVE 0x0000
+#define RECORD_EMPTY_KEY 0xFFFF
+#define RECORDS_PER_PAGE ((FLASH_PAGE_SIZE - sizeof(struct PageHeader)) / sizeof(struct Record))
+
+/* Private typedef -----------------------------------------------------------*/
+struct PageHeader
+{
+  uint16_t state;
+  uint16_t generation;
+  uint32_t reserved;
+};
+
+struct Record
+{
+  uint16_t key;
+  uint16_t crc;
+  uint32_t value;
+};
+
+/* Private macro -------------------------------------------------------------*/
+#define PAGE_ADDRESS(page) (STORAGE_START_ADDRESS + (page) * FLASH_PAGE_SIZE)
+#define PAGE_HEADER(page) ((const volatile struct PageHeader *)PAGE_ADDRESS(page))
+#define PAGE_RECORDS(page) ((const volatile struct Record *)(PAGE_ADDRESS(page) + sizeof(struct PageHeader)))
+
+/* Private variables ---------------------------------------------------------*/
+uint32_t storageValues[STORAGE_KEYS_COUNT];
+bool storageHasValue[STORAGE_KEYS_COUNT];
+uint8_t activePage;
+uint16_t nextRecord;
+
+/* Private function prototypes -----------------------------------------------*/
+uint16_t GetRecordCrc(uint16_t key, uint32_t value);
+bool IsRecordEmpty(const volatile struct Record *record);
+HAL_StatusTypeDef ProgramHalfWord(uint32_t address, uint16_t data);
+HAL_StatusTypeDef ProgramRecord(uint8_t page, uint16_t index, uint16_t key, uint32_t value);
+HAL_StatusTypeDef ErasePage(uint8_t page);
+HAL_StatusTypeDef FormatStorage(void);
+HAL_StatusTypeDef CompactStorage(void);
+void LoadActivePage(void);
+
+/* Private user code ---------------------------------------------------------*/
+HAL_StatusTypeDef InitStorage(void)
+{
+  const uint16_t firstState = PAGE_HEADER(0)->state, secondState = PAGE_HEADER(1)->state;
+  HAL_StatusTypeDef status = HAL_OK;
+  if ((firstState == PAGE_ACTIVE) && (secondState == PAGE_ACTIVE))
+  {
+    /* Power was lost after the copy was committed but before the old page was erased */
+    const int16_t age = (int16_t)(PAGE_HEADER(1)->generation - PAGE_HEADER(0)->generation);
+    activePage = (age > 0) ? 1 : 0;
+    status = ErasePage(1 - activePage);
+  }
+  else if ((firstState == PAGE_ACTIVE) || (secondState == PAGE_ACTIVE))
+  {
+    /* The other page is either erased or holds an unfinished copy */
+    activePage = (firstState == PAGE_ACTIVE) ? 0 : 1;
+    if (PAGE_HEADER(1 - activePage)->state != PAGE_ERASED)
+    {
+      status = ErasePage(1 - activePage);
+    }
+  }
+  else
+  {
+    return FormatStorage();
+  }
+  LoadActivePage();
+  return status;
+}
+
+bool ReadStorageValue(uint8_t key, uint32_t *value)
+{
+  if ((key >= STORAGE_KEYS_COUNT) || !storageHasValue[key])
+  {
+    return false;
+  }
+  *value = storageValues[key];
+  return true;
+}
+
+HAL_StatusTypeDef WriteStorageValue(uint8_t key, uint32_t value)
+{
+  if (key >= STORAGE_KEYS_COUNT)
+  {
+    return HAL_ERROR;
+  }
+  if (storageHasValue[key] && (storageValues[key] == value))
+  {
+    return HAL_OK;
+  }
+  if (nextRecord == RECORDS_PER_PAGE)
+  {
+    /* The copy carries the new value, which is dropped again unless the
+       new page was committed */
+    const uint32_t previousValue = storageValues[key];
+    const bool hadValue = storageHasValue[key];
+    const uint8_t page = activePage;
+    storageValues[key] = value;
+    storageHasValue[key] = true;
+    const HAL_StatusTypeDef status = CompactStorage();
+    if (activePage == page)
+    {
+      storageValues[key] = previousValue;
+      storageHasValue[key] = hadValue;
+    }
+    return status;
+  }
+  const uint16_t index = nextRecord;
+  const HAL_StatusTypeDef status = ProgramRecord(activePage, index, key, value);
+  if (status == HAL_OK)
+  {
+    storageValues[key] = value;
+    storageHasValue[key] = true;
+  }
+  /* A torn record can't be programmed again and is skipped like at boot,
+     a slot the failure left erased is used by the next write */
+  if ((status == HAL_OK) || !IsRecordEmpty(&PAGE_RECORDS(activePage)[index]))
+  {
+    nextRecord = index + 1;
+  }
+  return status;
+}
+
+uint16_t GetRecordCrc(uint16_t key, uint32_t value)
+{
+  /* CRC-16/CCITT over the key and the value */
+  const uint8_t bytes[] = { key, key >> 8, value, value >> 8, value >> 16, value >> 24 };
+  uint16_t crc = 0xFFFF;
+  for (uint8_t i = 0; i < sizeof(bytes); ++i)
+  {
+    crc ^= (uint16_t)bytes[i] << 8;
+    for (uint8_t bit = 0; bit < 8; ++bit)
+    {
+      crc = (crc & 0x8000) ? (crc << 1) ^ 0x1021 : crc << 1;
+    }
+  }
+  return crc;
+}
+
+bool IsRecordEmpty(const volatile struct Record *record)
+{
+  return (record->key == RECORD_EMPTY_KEY) && (record->crc == 0xFFFF) && (record->value == 0xFFFFFFFF);
+}
+
+HAL_StatusTypeDef ProgramHalfWord(uint32_t address, uint16_t data)
+{
+  HAL_FLASH_Unlock();
+  const HAL_StatusTypeDef status = HAL_FLASH_Program(FLASH_TYPEPROGRAM_HALFWORD, address, data);
+  HAL_FLASH_Lock();
+  return status;
+}
+
+HAL_StatusTypeDef ProgramRecord(uint8_t page, uint16_t index, uint16_t key, uint32_t value)
+{
+  const uint32_t address = PAGE_ADDRESS(page) + sizeof(struct PageHeader) + index * sizeof(struct Record);
+  /* The key goes last and commits the record */
+  HAL_StatusTypeDef status = ProgramHalfWord(address + offsetof(struct Record, value), (uint16_t)value);
+  if (status == HAL_OK)
+  {
+    status = ProgramHalfWord(address + offsetof(struct Record, value) + 2, (uint16_t)(value >> 16));
+  }
+  if (status == HAL_OK)
+  {
+    status = ProgramHalfWord(address + offsetof(struct Record, crc), GetRecordCrc(key, value));
+  }
+  if (status == HAL_OK)
+  {
+    status = ProgramHalfWord(address + offsetof(struct Record, key), key);
+  }
+  return status;
+}
+
+HAL_StatusTypeDef ErasePage(uint8_t page)
+{
+  FLASH_EraseInitTypeDef erase = {0};
+  uint32_t pageError;
+  erase.TypeErase = FLASH_TYPEERASE_PAGES;
+  erase.PageAddress = PAGE_ADDRESS(page);
+  erase.NbPages = 1;
+  HAL_FLASH_Unlock();
+  const HAL_StatusTypeDef status = HAL_FLASHEx_Erase(&erase, &pageError);
+  HAL_FLASH_Lock();
+  return status;
+}
+
+HAL_StatusTypeDef FormatStorage(void)
+{
+  for (uint8_t key = 0; key < STORAGE_KEYS_COUNT; ++key)
+  {
+    storageHasValue[key] = false;
+  }
+  activePage = 0;
+  nextRecord = 0;
+  HAL_StatusTypeDef status = ErasePage(0);
+  if (status == HAL_OK)
+  {
+    status = ErasePage(1);
+  }
+  if (status == HAL_OK)
+  {
+    status = ProgramHalfWord(PAGE_ADDRESS(0) + offsetof(struct PageHeader, state), PAGE_ACTIVE);
+  }
+  return status;
+}
+
+HAL_StatusTypeDef CompactStorage(void)
+{
+  const uint8_t newPage = 1 - activePage;
+  const uint16_t generation = PAGE_HEADER(activePage)->generation + 1;
+  uint16_t copied = 0;
+  HAL_StatusTypeDef status = HAL_OK;
+  if (PAGE_HEADER(newPage)->state != PAGE_ERASED)
+  {
+    status = ErasePage(newPage);
+  }
+  if (status == HAL_OK)
+  {
+    status = ProgramHalfWord(PAGE_ADDRESS(newPage) + offsetof(struct PageHeader, generation), generation);
+  }
+  if (status == HAL_OK)
+  {
+    status = ProgramHalfWord(PAGE_ADDRESS(newPage) + offsetof(struct PageHeader, state), PAGE_RECEIVING);
+  }
+  for (uint8_t key = 0; (status == HAL_OK) && (key < STORAGE_KEYS_COUNT); ++key)
+  {
+    if (storageHasValue[key])
+    {
+      status = ProgramRecord(newPage, copied++, key, storageValues[key]);
+    }
+  }
+  if (status == HAL_OK)
+  {
+    /* From here on a power loss keeps the new page */
+    status = ProgramHalfWord(PAGE_ADDRESS(newPage) + offsetof(struct PageHeader, state), PAGE_ACTIVE);
+  }
+  if (status == HAL_OK)
+  {
+    activePage = newPage;
+    nextRecord = copied;
+    status = ErasePage(1 - newPage);
+  }
+  return status;
+}
+
+void LoadActivePage(void)
+{
+  const volatile struct Record *records = PAGE_RECORDS(activePage);
+  nextRecord = RECORDS_PER_PAGE;
+  for (uint16_t i = 0; i < RECORDS_PER_PAGE; ++i)
+  {
+    if (IsRecordEmpty(&records[i]))
+    {
+      nextRecord = i;
+      break;
+    }
+    /* Torn or foreign records are skipped, later ones still apply */
+    const uint16_t key = records[i].key;
+    const uint32_t value = records[i].value;
+    if ((key < STORAGE_KEYS_COUNT) && (records[i].crc == GetRecordCrc(key, value)))
+    {
+      storageValues[key] = value;
+      storageHasValue[key] = true;
+    }
+  }
+}
@@ -0,0 +1,86 @@
+/**
+  ******************************************************************************
+  * @file           : host.h
+  * @brief          : Host stand-in for the CMSIS compiler layer.
+  *
+  *                   Force-included ahead of every source of the host tests.
+  *                   It takes the include guard of cmsis_compiler.h, so the
+  *                   device headers keep their types and register layouts
+  *                   while the core intrinsics below replace the Cortex-M
+  *                   inline assembly. PRIMASK is a plain variable. With
+  *                   HOST_SIMULATOR defined, unmasking and WFI call into
+  *                   the simulator.
+  ******************************************************************************
+  */
+
+#ifndef __HOST_H
+#define __HOST_H
+
+#define __CMSIS_COMPILER_H
+
+#include <stdint.h>
+
+#define __ASM __asm__
+#define __INLINE inline
+#define __STATIC_INLINE static inline
+#define __STATIC_FORCEINLINE static inline
+#define __NO_RETURN __attribute__((__noreturn__))
+#define __USED __attribute__((used))
+#define __WEAK __attribute__((weak))
+#define __PACKED __attribute__((packed, aligned(1)))
+#define __PACKED_STRUCT struct __attribute__((packed, aligned(1)))
+#define __PACKED_UNION union __attribute__((packed, aligned(1)))
+#define __ALIGNED(x) __attribute__((aligned(x)))
+#define __RESTRICT __restrict
+
+extern uint32_t hostPrimask;
+
+#ifdef HOST_SIMULATOR
+/* The simulator takes the pending interrupts once unmasked, and moves the
+   time on to the next event on a WFI */
+void HostInterruptsUnmasked(void);
+void HostWaitForInterrupt(void);
+/* The HAL has a WFE in inline assembly, it must still assemble on the host */
+__asm__(".macro wfe\n.endm");
+#else
+__STATIC_INLINE void HostInterruptsUnmasked(void) {}
+__STATIC_INLINE void HostWaitForInterrupt(void) {}
+#endif
+
+__STATIC_INLINE uint32_t __get_PRIMASK(void) { return hostPrimask; }
+__STATIC_INLINE void __disable_irq(void) { hostPrimask = 1; }
+__STATIC_INLINE void __enable_irq(void) { hostPrimask = 0; HostInterruptsUnmasked(); }
+__STATIC_INLINE void __NOP(void) {}
+__STATIC_INLINE void __WFI(void) { HostWaitForInterrupt(); }
+__STATIC_INLINE void __WFE(void) { HostWaitForInterrupt(); }
+
+__STATIC_INLINE void __set_PRIMASK(uint32_t priMask)
+{
+  hostPrimask = priMask;
+  if (priMask == 0)
+  {
+    HostInterruptsUnmasked();
+  }
+}
+
+__STATIC_INLINE void __SEV(void) {}
+__STATIC_INLINE void __ISB(void) {}
+__STATIC_INLINE void __DSB(void) {}
+__STATIC_INLINE void __DMB(void) {}
+__STATIC_INLINE uint8_t __CLZ(uint32_t value) { return (value != 0) ? (uint8_t)__builtin_clz(value) : 32; }
+
+__STATIC_INLINE uint32_t __RBIT(uint32_t value)
+{
+  uint32_t result = 0;
+  for (uint8_t i = 0; i < 32; ++i)
+  {
+    result = (result << 1) | ((value >> i) & 1);
+  }
+  return result;
+}
+
+/* Single threaded, so the exclusive store always succeeds */
+__STATIC_INLINE uint32_t __LDREXW(volatile uint32_t *address) { return *address; }
+__STATIC_INLINE uint32_t __STREXW(uint32_t value, volatile uint32_t *address) { *address = value; return 0; }
+
+#endif /* __HOST_H */
@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file           : segments.h
+  * @brief          : Expected glyphs of the 7-segment displays, spelled out
+  *                   as segment letters.
+  *
+  *                   Written apart from GLYPH_PINS_TABLE, so a segment
+  *                   swapped or dropped in the table, or a pin swapped in a
+  *                   project's main.h, shows up as a mismatch.
+  ******************************************************************************
+  */
+
+#ifndef __SEGMENTS_H
+#define __SEGMENTS_H
+
+#include "glyphs.h"
+#include "test.h"
+
+/*    a
+    f   b
+      g
+    e   c
+      d    */
+static const char *const GLYPH_SEGMENTS[GLYPH_COUNT] =
+{
+  [GLYPH_0] = "abcdef", [GLYPH_1] = "bc", [GLYPH_2] = "abdeg", [GLYPH_3] = "abcdg",
+  [GLYPH_4] = "bcfg", [GLYPH_5] = "acdfg", [GLYPH_6] = "acdefg", [GLYPH_7] = "abc",
+  [GLYPH_8] = "abcdefg", [GLYPH_9] = "abcdfg", [GLYPH_A] = "abcefg", [GLYPH_B] = "cdefg",
+  [GLYPH_C] = "adef", [GLYPH_D] = "bcdeg", [GLYPH_E] = "adefg", [GLYPH_F] = "aefg",
+  [GLYPH_BLANK] = "", [GLYPH_MINUS] = "g", [GLYPH_H] = "bcefg", [GLYPH_L] = "def",
+  [GLYPH_N] = "ceg", [GLYPH_O] = "cdeg", [GLYPH_P] = "abefg", [GLYPH_R] = "eg",
+  [GLYPH_U] = "bcdef"
+};
+
+static inline uint16_t GetSegmentsPins(const char *segments)
+{
+  const uint16_t SEGMENT_PINS[] = { DISPLAY_A_Pin, DISPLAY_B_Pin, DISPLAY_C_Pin, DISPLAY_D_Pin, DISPLAY_E_Pin, DISPLAY_F_Pin, DISPLAY_G_Pin };
+  uint16_t pins = 0;
+  for (; *segments != '\0'; ++segments)
+  {
+    pins |= SEGMENT_PINS[*segments - 'a'];
+  }
+  return pins;
+}
+
+/* Checks every glyph of a table lights exactly its segments */
+static inline void CheckGlyphPins(const uint16_t glyphPins[GLYPH_COUNT])
+{
+  for (uint8_t glyph = 0; glyph < GLYPH_COUNT; ++glyph)
+  {
+    CHECK(GLYPH_SEGMENTS[glyph] != NULL);
+    if (GLYPH_SEGMENTS[glyph] != NULL)
+    {
+      CHECK_EQUAL(GetSegmentsPins(GLYPH_SEGMENTS[glyph]), glyphPins[glyph]);
+    }
+  }
+}
+
+#endif /* __SEGMENTS_H */
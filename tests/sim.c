@@ -0,0 +1,1331 @@
+/**
+  ******************************************************************************
+  * @file           : sim.c
+  * @brief          : Simulator core: memory map, access decoding, virtual
+  *                   time, core peripherals and exceptions.
+  *
+  *                   The register ranges are mapped without access rights, so
+  *                   every load and store to them raises SIGSEGV. The handler
+  *                   decodes the moves the compiler emits for volatile
+  *                   accesses, serves them from the models and skips the
+  *                   instruction. Any other instruction is single-stepped
+  *                   over a page filled with the register values, the bytes
+  *                   it changed are written to the models afterwards.
+  *
+  *                   Each access is charged to the core, which advances the
+  *                   clock through the peripheral and script events, and
+  *                   then takes the pending interrupts the NVIC would. The
+  *                   handlers run on the interrupted stack, from within the
+  *                   signal handler, at the same instruction boundary as
+  *                   on the device.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim_devices.h"
+#include <setjmp.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include <ucontext.h>
+#include <unistd.h>
+
+/* Private define ------------------------------------------------------------*/
+/* Cycles charged for a register access, an exception entry or exit and a
+   HAL tick read */
+#define ACCESS_CYCLES 2
+#define EXCEPTION_ENTRY_CYCLES 12
+#define EXCEPTION_EXIT_CYCLES 12
+#define TICK_READ_CYCLES 6
+/* Low-power regulator wake-up from STOP, typical */
+#define STOP_WAKEUP_TIME SIM_NS(5400)
+#define PAGE_SIZE 0x1000U
+#define EFLAGS_TRAP 0x100
+/* Exit statuses of a run besides its failed checks count */
+#define RUN_FAILURES_MAX 100
+#define RUN_ERROR_STATUS 101
+#define SYSTEM_MEMORY_BASE 0x1FFFF000U
+#define CORE_PERIPHERALS_BASE 0xE0000000U
+
+/* Private typedef -----------------------------------------------------------*/
+enum WindowIndex
+{
+  WINDOW_PERIPHERALS,
+  WINDOW_BIT_BAND,
+  WINDOW_CORE,
+  WINDOW_FLASH,
+  WINDOW_SYSTEM_MEMORY,
+  WINDOWS_COUNT
+};
+
+struct Window
+{
+  uint32_t base;
+  uint32_t size;
+  int protection;
+  uint32_t *shadow;
+};
+
+/* A mov between a register or an immediate and memory */
+struct Move
+{
+  uint8_t length;
+  uint8_t size;
+  uint8_t registerSize;
+  uint8_t reg;
+  bool isStore;
+  bool isSigned;
+  bool isImmediate;
+  bool isHighByte;
+  uint64_t immediate;
+};
+
+/* Access single-stepped over an opened register page */
+struct Step
+{
+  bool isActive;
+  bool isWrite;
+  uintptr_t address;
+  uint8_t *page;
+  uint8_t before[16];
+};
+
+struct ScheduledEvent
+{
+  SimTime time;
+  SimEventCallback callback;
+  void *argument;
+  struct ScheduledEvent *next;
+};
+
+/* Private variables ---------------------------------------------------------*/
+extern unsigned testsFailedCount;
+extern uint32_t hostPrimask;
+extern __IO uint32_t uwTick;
+int FirmwareMain(void);
+void SystemInit(void);
+
+/* Handlers of the firmware, the missing ones are null */
+#define WEAK_HANDLER(name) extern void name(void) __attribute__((weak));
+WEAK_HANDLER(NMI_Handler) WEAK_HANDLER(HardFault_Handler) WEAK_HANDLER(MemManage_Handler)
+WEAK_HANDLER(BusFault_Handler) WEAK_HANDLER(UsageFault_Handler) WEAK_HANDLER(SVC_Handler)
+WEAK_HANDLER(DebugMon_Handler) WEAK_HANDLER(PendSV_Handler) WEAK_HANDLER(SysTick_Handler)
+WEAK_HANDLER(WWDG_IRQHandler) WEAK_HANDLER(PVD_IRQHandler) WEAK_HANDLER(TAMPER_IRQHandler)
+WEAK_HANDLER(RTC_IRQHandler) WEAK_HANDLER(FLASH_IRQHandler) WEAK_HANDLER(RCC_IRQHandler)
+WEAK_HANDLER(EXTI0_IRQHandler) WEAK_HANDLER(EXTI1_IRQHandler) WEAK_HANDLER(EXTI2_IRQHandler)
+WEAK_HANDLER(EXTI3_IRQHandler) WEAK_HANDLER(EXTI4_IRQHandler)
+WEAK_HANDLER(DMA1_Channel1_IRQHandler) WEAK_HANDLER(DMA1_Channel2_IRQHandler)
+WEAK_HANDLER(DMA1_Channel3_IRQHandler) WEAK_HANDLER(DMA1_Channel4_IRQHandler)
+WEAK_HANDLER(DMA1_Channel5_IRQHandler) WEAK_HANDLER(DMA1_Channel6_IRQHandler)
+WEAK_HANDLER(DMA1_Channel7_IRQHandler) WEAK_HANDLER(ADC1_2_IRQHandler)
+WEAK_HANDLER(USB_HP_CAN1_TX_IRQHandler) WEAK_HANDLER(USB_LP_CAN1_RX0_IRQHandler)
+WEAK_HANDLER(CAN1_RX1_IRQHandler) WEAK_HANDLER(CAN1_SCE_IRQHandler) WEAK_HANDLER(EXTI9_5_IRQHandler)
+WEAK_HANDLER(TIM1_BRK_IRQHandler) WEAK_HANDLER(TIM1_UP_IRQHandler) WEAK_HANDLER(TIM1_TRG_COM_IRQHandler)
+WEAK_HANDLER(TIM1_CC_IRQHandler) WEAK_HANDLER(TIM2_IRQHandler) WEAK_HANDLER(TIM3_IRQHandler)
+WEAK_HANDLER(I2C1_EV_IRQHandler) WEAK_HANDLER(I2C1_ER_IRQHandler) WEAK_HANDLER(SPI1_IRQHandler)
+WEAK_HANDLER(USART1_IRQHandler) WEAK_HANDLER(USART2_IRQHandler) WEAK_HANDLER(EXTI15_10_IRQHandler)
+WEAK_HANDLER(RTC_Alarm_IRQHandler) WEAK_HANDLER(USBWakeUp_IRQHandler)
+
+/* By exception number, as in startup_stm32f103x6.s */
+void (*const VECTORS[SIM_EXCEPTIONS_COUNT])(void) =
+{
+  [2] = NMI_Handler, [3] = HardFault_Handler, [4] = MemManage_Handler, [5] = BusFault_Handler,
+  [6] = UsageFault_Handler, [11] = SVC_Handler, [12] = DebugMon_Handler, [14] = PendSV_Handler,
+  [15] = SysTick_Handler, [16] = WWDG_IRQHandler, [17] = PVD_IRQHandler, [18] = TAMPER_IRQHandler,
+  [19] = RTC_IRQHandler, [20] = FLASH_IRQHandler, [21] = RCC_IRQHandler, [22] = EXTI0_IRQHandler,
+  [23] = EXTI1_IRQHandler, [24] = EXTI2_IRQHandler, [25] = EXTI3_IRQHandler, [26] = EXTI4_IRQHandler,
+  [27] = DMA1_Channel1_IRQHandler, [28] = DMA1_Channel2_IRQHandler, [29] = DMA1_Channel3_IRQHandler,
+  [30] = DMA1_Channel4_IRQHandler, [31] = DMA1_Channel5_IRQHandler, [32] = DMA1_Channel6_IRQHandler,
+  [33] = DMA1_Channel7_IRQHandler, [34] = ADC1_2_IRQHandler, [35] = USB_HP_CAN1_TX_IRQHandler,
+  [36] = USB_LP_CAN1_RX0_IRQHandler, [37] = CAN1_RX1_IRQHandler, [38] = CAN1_SCE_IRQHandler,
+  [39] = EXTI9_5_IRQHandler, [40] = TIM1_BRK_IRQHandler, [41] = TIM1_UP_IRQHandler,
+  [42] = TIM1_TRG_COM_IRQHandler, [43] = TIM1_CC_IRQHandler, [44] = TIM2_IRQHandler,
+  [45] = TIM3_IRQHandler, [47] = I2C1_EV_IRQHandler, [48] = I2C1_ER_IRQHandler, [51] = SPI1_IRQHandler,
+  [53] = USART1_IRQHandler, [54] = USART2_IRQHandler, [56] = EXTI15_10_IRQHandler,
+  [57] = RTC_Alarm_IRQHandler, [58] = USBWakeUp_IRQHandler
+};
+
+/* Unique ID of the simulated device, read by the lock's password hash */
+const uint8_t DEVICE_UID[12] = { 0x33, 0xFF, 0xD7, 0x05, 0x4E, 0x50, 0x37, 0x31, 0x22, 0x67, 0x13, 0x43 };
+
+struct Window windows[WINDOWS_COUNT] =
+{
+  [WINDOW_PERIPHERALS] = { PERIPH_BASE, 0x30000, PROT_NONE, NULL },
+  [WINDOW_BIT_BAND] = { PERIPH_BB_BASE, 0x30000 * 32, PROT_NONE, NULL },
+  [WINDOW_CORE] = { CORE_PERIPHERALS_BASE, 0x100000, PROT_NONE, NULL },
+  [WINDOW_FLASH] = { FLASH_BASE, FLASH_BANK1_END + 1 - FLASH_BASE, PROT_READ, NULL },
+  [WINDOW_SYSTEM_MEMORY] = { SYSTEM_MEMORY_BASE, PAGE_SIZE, PROT_READ, NULL }
+};
+
+SimTime simNow;
+struct SimStats simStats;
+SimTime runEndTime;
+sigjmp_buf runEnd;
+struct ScheduledEvent *scheduledEvents;
+struct Step step;
+bool isStopped;
+uint32_t stallDepth;
+
+/* Exceptions by number, the IRQ enables are bits 16 and up */
+uint64_t exceptionsEnabled;
+uint64_t exceptionsLatched;
+uint64_t exceptionsActive;
+uint64_t exceptionsPending;
+/* Levels of the IRQ lines, whose rising edges the NVIC latches */
+uint64_t irqLines;
+SimTime pendingSince[SIM_EXCEPTIONS_COUNT];
+
+/* SysTick counts down from sysTickBaseValue since sysTickBaseTime */
+SimTime sysTickBaseTime;
+uint64_t sysTickFrequency;
+uint32_t sysTickBaseValue;
+bool sysTickCountFlag;
+
+/* DWT cycle counter, counting HCLK cycles from cycleCountBase */
+SimTime cycleCountBaseTime;
+uint64_t cycleCountFrequency;
+uint32_t cycleCountBase;
+
+/* Private function prototypes -----------------------------------------------*/
+void Advance(SimTime target);
+void Charge(uint32_t cycles);
+void TakeInterrupts(void);
+void EndRun(void);
+
+/* Private user code ---------------------------------------------------------*/
+uint64_t SimTicksAt(SimTime time, SimTime baseTime, uint64_t frequency)
+{
+  if ((frequency == 0) || (time <= baseTime))
+  {
+    return 0;
+  }
+  return (uint64_t)(((unsigned __int128)(time - baseTime) * frequency) / PS_PER_S);
+}
+
+/* Earliest time at which SimTicksAt reaches ticks */
+SimTime SimTimeOfTicks(uint64_t ticks, SimTime baseTime, uint64_t frequency)
+{
+  if (ticks == 0)
+  {
+    return baseTime;
+  }
+  if (frequency == 0)
+  {
+    return SIM_NEVER;
+  }
+  const unsigned __int128 span = ((unsigned __int128)ticks * PS_PER_S + frequency - 1) / frequency;
+  return (span >= SIM_NEVER - baseTime) ? SIM_NEVER : baseTime + (SimTime)span;
+}
+
+/* Where a counter rebases to: its last edge if it keeps its clock, so no
+   fraction of a tick is lost, or now if the clock changes */
+SimTime SimLastTickTime(SimTime baseTime, uint64_t frequency, uint64_t newFrequency)
+{
+  if ((frequency == 0) || (frequency != newFrequency))
+  {
+    return simNow;
+  }
+  return SimTimeOfTicks(SimTicksAt(simNow, baseTime, frequency), baseTime, frequency);
+}
+
+void SimError(const char *format, ...)
+{
+  va_list arguments;
+  va_start(arguments, format);
+  fprintf(stderr, "sim: error at %llu us: ", (unsigned long long)SIM_TO_US(simNow));
+  vfprintf(stderr, format, arguments);
+  fputc('\n', stderr);
+  va_end(arguments);
+  fflush(NULL);
+  _exit(RUN_ERROR_STATUS);
+}
+
+struct Window *FindWindow(uintptr_t address)
+{
+  for (uint8_t i = 0; i < WINDOWS_COUNT; ++i)
+  {
+    if ((address >= windows[i].base) && (address - windows[i].base < windows[i].size))
+    {
+      return &windows[i];
+    }
+  }
+  return NULL;
+}
+
+uint32_t *SimShadow(uint32_t address)
+{
+  struct Window *window = FindWindow(address);
+  if ((window == NULL) || (window->shadow == NULL))
+  {
+    SimError("no register at 0x%08X", address);
+  }
+  return &window->shadow[(address - window->base) / 4];
+}
+
+/* Core peripherals --------------------------------------------------------*/
+uint8_t GetPriorityGroupMask(void)
+{
+  const uint32_t priorityGroup = (*SimShadow((uint32_t)&SCB->AIRCR) & SCB_AIRCR_PRIGROUP_Msk) >> SCB_AIRCR_PRIGROUP_Pos;
+  return (uint8_t)(0xFF << (priorityGroup + 1));
+}
+
+uint8_t GetExceptionPriority(uint8_t exception)
+{
+  if (exception >= 16)
+  {
+    return ((const uint8_t *)SimShadow((uint32_t)&NVIC->IP[0]))[exception - 16];
+  }
+  if (exception >= 4)
+  {
+    return ((const uint8_t *)SimShadow((uint32_t)&SCB->SHP[0]))[exception - 4];
+  }
+  return 0;
+}
+
+/* Group priority the core runs at, 256 in thread mode */
+int GetExecutionPriority(bool withPrimask)
+{
+  int priority = 256;
+  const uint8_t groupMask = GetPriorityGroupMask();
+  for (uint8_t exception = 0; exception < SIM_EXCEPTIONS_COUNT; ++exception)
+  {
+    if ((exceptionsActive & (1ULL << exception)) != 0)
+    {
+      const int group = GetExceptionPriority(exception) & groupMask;
+      if (group < priority)
+      {
+        priority = group;
+      }
+    }
+  }
+  if (withPrimask && (hostPrimask != 0))
+  {
+    priority = 0;
+  }
+  return priority;
+}
+
+bool IsExceptionPending(uint8_t exception)
+{
+  if ((exceptionsLatched & (1ULL << exception)) != 0)
+  {
+    return true;
+  }
+  return (exception >= 16) && GetIrqLine(exception - 16);
+}
+
+/* Enabled pending exception of the highest priority, -1 if none */
+int SelectPendingException(void)
+{
+  int selected = -1;
+  for (uint8_t exception = 0; exception < SIM_EXCEPTIONS_COUNT; ++exception)
+  {
+    const uint64_t bit = 1ULL << exception;
+    if (((exceptionsPending & bit) != 0) && ((exceptionsActive & bit) == 0) && ((exceptionsEnabled & bit) != 0)
+        && ((selected < 0) || (GetExceptionPriority(exception) < GetExceptionPriority(selected))))
+    {
+      selected = exception;
+    }
+  }
+  return selected;
+}
+
+/* Notes when every request became pending, for the latency statistics */
+void SimUpdateInterrupts(void)
+{
+  for (uint8_t exception = 0; exception < SIM_EXCEPTIONS_COUNT; ++exception)
+  {
+    const uint64_t bit = 1ULL << exception;
+    /* A pulse stays pending, as an EXTI request the firmware masks before
+       its handler runs */
+    const bool isLineHigh = (exception >= 16) && GetIrqLine(exception - 16);
+    if (isLineHigh && ((irqLines & bit) == 0))
+    {
+      exceptionsLatched |= bit;
+    }
+    irqLines = isLineHigh ? (irqLines | bit) : (irqLines & ~bit);
+    const bool isPending = IsExceptionPending(exception);
+    if (isPending && ((exceptionsPending & bit) == 0))
+    {
+      pendingSince[exception] = simNow;
+      exceptionsPending |= bit;
+    }
+    else if (!isPending)
+    {
+      exceptionsPending &= ~bit;
+    }
+  }
+}
+
+bool IsPreemptionPending(bool withPrimask)
+{
+  const int exception = SelectPendingException();
+  return (exception >= 0) && ((GetExceptionPriority(exception) & GetPriorityGroupMask()) < GetExecutionPriority(withPrimask));
+}
+
+void EnterException(uint8_t exception)
+{
+  const uint64_t bit = 1ULL << exception;
+  if (VECTORS[exception] == NULL)
+  {
+    SimError("no handler for exception %u", exception);
+  }
+  exceptionsLatched &= ~bit;
+  exceptionsActive |= bit;
+  Charge(EXCEPTION_ENTRY_CYCLES);
+  struct SimIrqStats *stats = &simStats.exceptions[exception];
+  const SimTime latency = simNow - pendingSince[exception];
+  ++stats->count;
+  stats->totalLatency += latency;
+  if (latency > stats->maxLatency)
+  {
+    stats->maxLatency = latency;
+  }
+  /* A request raised again during the handler counts from its own time */
+  exceptionsPending &= ~bit;
+  VECTORS[exception]();
+  Charge(EXCEPTION_EXIT_CYCLES);
+  exceptionsActive &= ~bit;
+  SimUpdateInterrupts();
+}
+
+void TakeInterrupts(void)
+{
+  while ((stallDepth == 0) && IsPreemptionPending(true))
+  {
+    EnterException((uint8_t)SelectPendingException());
+  }
+}
+
+uint32_t GetSysTickValue(void)
+{
+  const uint32_t load = *SimShadow((uint32_t)&SysTick->LOAD) & SysTick_LOAD_RELOAD_Msk;
+  const uint64_t ticks = SimTicksAt(simNow, sysTickBaseTime, sysTickFrequency);
+  if (ticks <= sysTickBaseValue)
+  {
+    return sysTickBaseValue - (uint32_t)ticks;
+  }
+  return load - (uint32_t)((ticks - sysTickBaseValue - 1) % ((uint64_t)load + 1));
+}
+
+uint64_t GetSysTickFrequency(void)
+{
+  const uint32_t control = *SimShadow((uint32_t)&SysTick->CTRL);
+  if ((control & SysTick_CTRL_ENABLE_Msk) == 0)
+  {
+    return 0;
+  }
+  const uint32_t hclk = GetHclkFrequency();
+  return ((control & SysTick_CTRL_CLKSOURCE_Msk) != 0) ? hclk : hclk / 8;
+}
+
+/* Recounts from now, at the clock of the current configuration */
+void RebaseSysTick(void)
+{
+  const uint64_t frequency = GetSysTickFrequency();
+  sysTickBaseValue = GetSysTickValue();
+  sysTickBaseTime = SimLastTickTime(sysTickBaseTime, sysTickFrequency, frequency);
+  sysTickFrequency = frequency;
+}
+
+SimTime GetSysTickNextEvent(void)
+{
+  const uint32_t load = *SimShadow((uint32_t)&SysTick->LOAD) & SysTick_LOAD_RELOAD_Msk;
+  if ((sysTickBaseValue == 0) && (load == 0))
+  {
+    return SIM_NEVER;
+  }
+  const uint64_t ticks = (sysTickBaseValue != 0) ? sysTickBaseValue : (uint64_t)load + 1;
+  return SimTimeOfTicks(ticks, sysTickBaseTime, sysTickFrequency);
+}
+
+/* The counter reached zero */
+void ProcessSysTick(void)
+{
+  sysTickBaseTime = GetSysTickNextEvent();
+  sysTickBaseValue = 0;
+  sysTickCountFlag = true;
+  if ((*SimShadow((uint32_t)&SysTick->CTRL) & SysTick_CTRL_TICKINT_Msk) != 0)
+  {
+    exceptionsLatched |= 1ULL << (SysTick_IRQn + 16);
+  }
+}
+
+uint32_t GetCycleCount(void)
+{
+  return cycleCountBase + (uint32_t)SimTicksAt(simNow, cycleCountBaseTime, cycleCountFrequency);
+}
+
+void RebaseCycleCount(void)
+{
+  const bool isEnabled = ((*SimShadow((uint32_t)&CoreDebug->DEMCR) & CoreDebug_DEMCR_TRCENA_Msk) != 0)
+                      && ((*SimShadow((uint32_t)&DWT->CTRL) & DWT_CTRL_CYCCNTENA_Msk) != 0);
+  const uint64_t frequency = isEnabled ? GetHclkFrequency() : 0;
+  cycleCountBase = GetCycleCount();
+  cycleCountBaseTime = SimLastTickTime(cycleCountBaseTime, cycleCountFrequency, frequency);
+  cycleCountFrequency = frequency;
+}
+
+void SimClocksChanged(void)
+{
+  RebaseSysTick();
+  RebaseCycleCount();
+  UpdateDeviceClocks();
+}
+
+uint32_t CoreRead(uint32_t address, bool sideEffects)
+{
+  uint32_t *shadow = SimShadow(address);
+  if (address == (uint32_t)&SysTick->CTRL)
+  {
+    const uint32_t value = *shadow | (sysTickCountFlag ? SysTick_CTRL_COUNTFLAG_Msk : 0);
+    if (sideEffects)
+    {
+      sysTickCountFlag = false;
+    }
+    return value;
+  }
+  if (address == (uint32_t)&SysTick->VAL)
+  {
+    return GetSysTickValue();
+  }
+  if (address == (uint32_t)&DWT->CYCCNT)
+  {
+    return GetCycleCount();
+  }
+  if (address == (uint32_t)&SCB->ICSR)
+  {
+    uint32_t value = 0;
+    for (uint8_t exception = 0; exception < SIM_EXCEPTIONS_COUNT; ++exception)
+    {
+      if ((exceptionsActive & (1ULL << exception)) != 0)
+      {
+        value = (value & ~SCB_ICSR_VECTACTIVE_Msk) | exception;
+      }
+    }
+    const int pending = SelectPendingException();
+    if (pending >= 0)
+    {
+      value |= (uint32_t)pending << SCB_ICSR_VECTPENDING_Pos;
+    }
+    if ((exceptionsPending >> 16) != 0)
+    {
+      value |= SCB_ICSR_ISRPENDING_Msk;
+    }
+    if (IsExceptionPending(SysTick_IRQn + 16))
+    {
+      value |= SCB_ICSR_PENDSTSET_Msk;
+    }
+    if (IsExceptionPending(PendSV_IRQn + 16))
+    {
+      value |= SCB_ICSR_PENDSVSET_Msk;
+    }
+    return value;
+  }
+  if ((address >= (uint32_t)&NVIC->ISER[0]) && (address < (uint32_t)&NVIC->ISER[2]))
+  {
+    return (uint32_t)(exceptionsEnabled >> (16 + 32 * ((address - (uint32_t)&NVIC->ISER[0]) / 4)));
+  }
+  if ((address >= (uint32_t)&NVIC->ICER[0]) && (address < (uint32_t)&NVIC->ICER[2]))
+  {
+    return (uint32_t)(exceptionsEnabled >> (16 + 32 * ((address - (uint32_t)&NVIC->ICER[0]) / 4)));
+  }
+  if ((address >= (uint32_t)&NVIC->ISPR[0]) && (address < (uint32_t)&NVIC->ICPR[2]))
+  {
+    const uint32_t word = ((address - (uint32_t)&NVIC->ISPR[0]) / 4) % 32;
+    return (uint32_t)(exceptionsPending >> (16 + 32 * word));
+  }
+  if ((address >= (uint32_t)&NVIC->IABR[0]) && (address < (uint32_t)&NVIC->IABR[2]))
+  {
+    return (uint32_t)(exceptionsActive >> (16 + 32 * ((address - (uint32_t)&NVIC->IABR[0]) / 4)));
+  }
+  return *shadow;
+}
+
+void CoreWrite(uint32_t address, uint32_t value, uint32_t mask)
+{
+  uint32_t *shadow = SimShadow(address);
+  if (address == (uint32_t)&SysTick->CTRL)
+  {
+    RebaseSysTick();
+    *shadow = value & (SysTick_CTRL_ENABLE_Msk | SysTick_CTRL_TICKINT_Msk | SysTick_CTRL_CLKSOURCE_Msk);
+    sysTickFrequency = GetSysTickFrequency();
+  }
+  else if (address == (uint32_t)&SysTick->LOAD)
+  {
+    RebaseSysTick();
+    *shadow = value & SysTick_LOAD_RELOAD_Msk;
+  }
+  else if (address == (uint32_t)&SysTick->VAL)
+  {
+    RebaseSysTick();
+    sysTickBaseValue = 0;
+    sysTickCountFlag = false;
+  }
+  else if (address == (uint32_t)&SysTick->CALIB)
+  {
+  }
+  else if (address == (uint32_t)&SCB->ICSR)
+  {
+    const uint64_t sysTick = 1ULL << (SysTick_IRQn + 16), pendSv = 1ULL << (PendSV_IRQn + 16);
+    exceptionsLatched |= ((value & SCB_ICSR_PENDSTSET_Msk) != 0) ? sysTick : 0;
+    exceptionsLatched &= ((value & SCB_ICSR_PENDSTCLR_Msk) != 0) ? ~sysTick : ~0ULL;
+    exceptionsLatched |= ((value & SCB_ICSR_PENDSVSET_Msk) != 0) ? pendSv : 0;
+    exceptionsLatched &= ((value & SCB_ICSR_PENDSVCLR_Msk) != 0) ? ~pendSv : ~0ULL;
+  }
+  else if (address == (uint32_t)&SCB->AIRCR)
+  {
+    if ((value >> SCB_AIRCR_VECTKEY_Pos) == 0x05FA)
+    {
+      if ((value & SCB_AIRCR_SYSRESETREQ_Msk) != 0)
+      {
+        SimError("system reset requested");
+      }
+      *shadow = (0xFA05UL << SCB_AIRCR_VECTKEYSTAT_Pos) | (value & SCB_AIRCR_PRIGROUP_Msk);
+    }
+  }
+  else if ((address >= (uint32_t)&SCB->SHP[0]) && (address < (uint32_t)&SCB->SHP[12]))
+  {
+    /* The STM32F1 implements the top four priority bits */
+    *shadow = value & 0xF0F0F0F0;
+  }
+  else if ((address >= (uint32_t)&NVIC->IP[0]) && (address < (uint32_t)&NVIC->IP[240]))
+  {
+    *shadow = value & 0xF0F0F0F0;
+  }
+  else if ((address >= (uint32_t)&NVIC->ISER[0]) && (address < (uint32_t)&NVIC->ISER[2]))
+  {
+    exceptionsEnabled |= (uint64_t)(value & mask) << (16 + 32 * ((address - (uint32_t)&NVIC->ISER[0]) / 4));
+  }
+  else if ((address >= (uint32_t)&NVIC->ICER[0]) && (address < (uint32_t)&NVIC->ICER[2]))
+  {
+    exceptionsEnabled &= ~((uint64_t)(value & mask) << (16 + 32 * ((address - (uint32_t)&NVIC->ICER[0]) / 4)));
+  }
+  else if ((address >= (uint32_t)&NVIC->ISPR[0]) && (address < (uint32_t)&NVIC->ISPR[2]))
+  {
+    exceptionsLatched |= (uint64_t)(value & mask) << (16 + 32 * ((address - (uint32_t)&NVIC->ISPR[0]) / 4));
+  }
+  else if ((address >= (uint32_t)&NVIC->ICPR[0]) && (address < (uint32_t)&NVIC->ICPR[2]))
+  {
+    exceptionsLatched &= ~((uint64_t)(value & mask) << (16 + 32 * ((address - (uint32_t)&NVIC->ICPR[0]) / 4)));
+  }
+  else if (address == (uint32_t)&NVIC->STIR)
+  {
+    exceptionsLatched |= 1ULL << (16 + (value & 0x3F));
+  }
+  else if ((address == (uint32_t)&DWT->CTRL) || (address == (uint32_t)&CoreDebug->DEMCR))
+  {
+    RebaseCycleCount();
+    *shadow = value;
+    RebaseCycleCount();
+  }
+  else if (address == (uint32_t)&DWT->CYCCNT)
+  {
+    RebaseCycleCount();
+    cycleCountBase = value;
+  }
+  else
+  {
+    *shadow = value;
+  }
+}
+
+void ResetCore(void)
+{
+  memset(windows[WINDOW_CORE].shadow, 0, windows[WINDOW_CORE].size);
+  *SimShadow((uint32_t)&SCB->CPUID) = 0x411FC231;
+  *SimShadow((uint32_t)&SCB->AIRCR) = 0xFA05UL << SCB_AIRCR_VECTKEYSTAT_Pos;
+  *SimShadow((uint32_t)&SysTick->CALIB) = 0x40000000 | (HSI_FREQUENCY / 8 / 100 - 1);
+  *SimShadow(DBGMCU_BASE) = 0x20036412;
+  /* System exceptions are always enabled */
+  exceptionsEnabled = 0xFFFF;
+  exceptionsLatched = 0;
+  exceptionsActive = 0;
+  exceptionsPending = 0;
+  irqLines = 0;
+  sysTickBaseTime = 0;
+  sysTickBaseValue = 0;
+  sysTickFrequency = 0;
+  sysTickCountFlag = false;
+  cycleCountBase = 0;
+  cycleCountBaseTime = 0;
+  cycleCountFrequency = 0;
+}
+
+/* Bus -----------------------------------------------------------------------*/
+uint32_t ReadWord(uint32_t address, bool sideEffects)
+{
+  if ((address >= PERIPH_BB_BASE) && (address - PERIPH_BB_BASE < windows[WINDOW_BIT_BAND].size))
+  {
+    const uint32_t offset = address - PERIPH_BB_BASE;
+    const uint32_t word = PERIPH_BASE + ((offset >> 5) & ~3U);
+    return (DeviceRead(word, sideEffects) >> ((offset >> 2) & 31)) & 1;
+  }
+  if (address >= CORE_PERIPHERALS_BASE)
+  {
+    return CoreRead(address, sideEffects);
+  }
+  return DeviceRead(address, sideEffects);
+}
+
+/* Only the bytes of mask are written, the others keep their value */
+void WriteWord(uint32_t address, uint32_t value, uint32_t mask)
+{
+  if ((address >= PERIPH_BB_BASE) && (address - PERIPH_BB_BASE < windows[WINDOW_BIT_BAND].size))
+  {
+    const uint32_t offset = address - PERIPH_BB_BASE;
+    const uint32_t word = PERIPH_BASE + ((offset >> 5) & ~3U);
+    const uint32_t bit = 1U << ((offset >> 2) & 31);
+    const uint32_t current = DeviceRead(word, false);
+    DeviceWrite(word, ((value & 1) != 0) ? (current | bit) : (current & ~bit), 0xFFFFFFFF);
+    return;
+  }
+  const uint32_t merged = (ReadWord(address, false) & ~mask) | (value & mask);
+  if (address >= CORE_PERIPHERALS_BASE)
+  {
+    CoreWrite(address, merged, mask);
+  }
+  else
+  {
+    DeviceWrite(address, merged, mask);
+  }
+}
+
+uint64_t ReadRegisters(uintptr_t address, uint8_t size)
+{
+  uint64_t value = 0;
+  for (uint8_t i = 0; i < size; )
+  {
+    const uint32_t byteAddress = (uint32_t)(address + i);
+    const uint32_t shift = 8 * (byteAddress & 3);
+    const uint8_t count = ((4 - (byteAddress & 3)) < (uint32_t)(size - i)) ? (uint8_t)(4 - (byteAddress & 3)) : (uint8_t)(size - i);
+    const uint32_t word = ReadWord(byteAddress & ~3U, true) >> shift;
+    value |= (uint64_t)(word & ((count == 4) ? 0xFFFFFFFF : ((1U << (8 * count)) - 1))) << (8 * i);
+    i += count;
+  }
+  return value;
+}
+
+void WriteRegisters(uintptr_t address, uint8_t size, uint64_t value)
+{
+  for (uint8_t i = 0; i < size; )
+  {
+    const uint32_t byteAddress = (uint32_t)(address + i);
+    const uint32_t shift = 8 * (byteAddress & 3);
+    const uint8_t count = ((4 - (byteAddress & 3)) < (uint32_t)(size - i)) ? (uint8_t)(4 - (byteAddress & 3)) : (uint8_t)(size - i);
+    const uint32_t mask = ((count == 4) ? 0xFFFFFFFF : ((1U << (8 * count)) - 1)) << shift;
+    WriteWord(byteAddress & ~3U, (uint32_t)(value >> (8 * i)) << shift, mask);
+    i += count;
+  }
+}
+
+uint32_t SimBusRead(uint32_t address, uint8_t size)
+{
+  struct Window *window = FindWindow(address);
+  if ((window != NULL) && (window->shadow != NULL))
+  {
+    return (uint32_t)ReadRegisters(address, size);
+  }
+  const uint8_t *memory = (const uint8_t *)(uintptr_t)address;
+  uint32_t value = 0;
+  memcpy(&value, memory, size);
+  return value;
+}
+
+void SimBusWrite(uint32_t address, uint8_t size, uint32_t value)
+{
+  struct Window *window = FindWindow(address);
+  if ((window != NULL) && (window->shadow != NULL))
+  {
+    WriteRegisters(address, size, value);
+  }
+  else if (window != NULL)
+  {
+    SimError("bus write to read-only memory at 0x%08X", address);
+  }
+  else
+  {
+    memcpy((uint8_t *)(uintptr_t)address, &value, size);
+  }
+}
+
+/* Access decoding -----------------------------------------------------------*/
+bool DecodeMove(const uint8_t *code, struct Move *move)
+{
+  const uint8_t *p = code;
+  bool isOperand16 = false;
+  uint8_t rex = 0;
+  memset(move, 0, sizeof(*move));
+  while ((*p == 0x66) || (*p == 0x2E) || (*p == 0x3E) || (*p == 0x26) || (*p == 0x36))
+  {
+    isOperand16 |= *p == 0x66;
+    ++p;
+  }
+  if ((*p & 0xF0) == 0x40)
+  {
+    rex = *p++;
+  }
+  const uint8_t operandSize = ((rex & 8) != 0) ? 8 : (isOperand16 ? 2 : 4);
+  const uint8_t opcode = *p++;
+  uint8_t immediateSize = 0;
+  switch (opcode)
+  {
+  case 0x88:
+  case 0x89:
+    move->isStore = true;
+    move->size = (opcode == 0x88) ? 1 : operandSize;
+    break;
+  case 0x8A:
+  case 0x8B:
+    move->size = (opcode == 0x8A) ? 1 : operandSize;
+    move->registerSize = move->size;
+    break;
+  case 0x63:
+    move->size = 4;
+    move->registerSize = operandSize;
+    move->isSigned = true;
+    break;
+  case 0xC6:
+  case 0xC7:
+    move->isStore = true;
+    move->isImmediate = true;
+    move->size = (opcode == 0xC6) ? 1 : operandSize;
+    immediateSize = (move->size > 4) ? 4 : move->size;
+    break;
+  case 0xA0:
+  case 0xA1:
+  case 0xA2:
+  case 0xA3:
+    /* Absolute 64-bit address, no ModRM */
+    move->isStore = opcode >= 0xA2;
+    move->size = ((opcode & 1) == 0) ? 1 : operandSize;
+    move->registerSize = move->size;
+    move->reg = 0;
+    move->length = (uint8_t)(p - code) + 8;
+    return true;
+  case 0x0F:
+    switch (*p++)
+    {
+    case 0xB6:
+      move->size = 1;
+      break;
+    case 0xB7:
+      move->size = 2;
+      break;
+    case 0xBE:
+      move->size = 1;
+      move->isSigned = true;
+      break;
+    case 0xBF:
+      move->size = 2;
+      move->isSigned = true;
+      break;
+    default:
+      return false;
+    }
+    move->registerSize = operandSize;
+    break;
+  default:
+    return false;
+  }
+
+  const uint8_t modRm = *p++;
+  const uint8_t mod = modRm >> 6, rm = modRm & 7;
+  move->reg = ((modRm >> 3) & 7) | ((rex & 4) << 1);
+  if ((mod == 3) || (move->isImmediate && (move->reg != 0)))
+  {
+    return false;
+  }
+  /* AH to BH without a REX prefix */
+  move->isHighByte = (rex == 0) && (move->size == 1) && (move->registerSize <= 1) && (move->reg >= 4) && !move->isImmediate;
+  if (rm == 4)
+  {
+    const uint8_t sib = *p++;
+    if ((mod == 0) && ((sib & 7) == 5))
+    {
+      p += 4;
+    }
+  }
+  else if ((mod == 0) && (rm == 5))
+  {
+    p += 4;
+  }
+  p += (mod == 1) ? 1 : ((mod == 2) ? 4 : 0);
+  if (immediateSize != 0)
+  {
+    int64_t immediate = 0;
+    if (immediateSize == 1)
+    {
+      immediate = (int8_t)*p;
+    }
+    else if (immediateSize == 2)
+    {
+      int16_t value;
+      memcpy(&value, p, 2);
+      immediate = value;
+    }
+    else
+    {
+      int32_t value;
+      memcpy(&value, p, 4);
+      immediate = value;
+    }
+    move->immediate = (uint64_t)immediate;
+    p += immediateSize;
+  }
+  move->length = (uint8_t)(p - code);
+  return true;
+}
+
+greg_t *GetRegister(ucontext_t *context, uint8_t reg)
+{
+  static const int REGISTERS[16] =
+  {
+    REG_RAX, REG_RCX, REG_RDX, REG_RBX, REG_RSP, REG_RBP, REG_RSI, REG_RDI,
+    REG_R8, REG_R9, REG_R10, REG_R11, REG_R12, REG_R13, REG_R14, REG_R15
+  };
+  return &context->uc_mcontext.gregs[REGISTERS[reg & 15]];
+}
+
+void EmulateMove(ucontext_t *context, const struct Move *move, uintptr_t address)
+{
+  greg_t *reg = GetRegister(context, move->isHighByte ? move->reg - 4 : move->reg);
+  const uint64_t sizeMask = (move->size == 8) ? ~0ULL : ((1ULL << (8 * move->size)) - 1);
+  if (move->isStore)
+  {
+    uint64_t value = move->isImmediate ? move->immediate : (uint64_t)*reg;
+    if (move->isHighByte)
+    {
+      value >>= 8;
+    }
+    if (FindWindow(address) == &windows[WINDOW_FLASH])
+    {
+      FlashWrite((uint32_t)address, move->size, (uint32_t)(value & sizeMask));
+    }
+    else
+    {
+      WriteRegisters(address, move->size, value & sizeMask);
+    }
+    return;
+  }
+  uint64_t value = ReadRegisters(address, move->size);
+  if (move->isSigned && ((value >> (8 * move->size - 1)) & 1))
+  {
+    value |= ~sizeMask;
+  }
+  uint64_t current = (uint64_t)*reg;
+  switch (move->registerSize)
+  {
+  case 1:
+    current = move->isHighByte ? ((current & ~0xFF00ULL) | ((value & 0xFF) << 8)) : ((current & ~0xFFULL) | (value & 0xFF));
+    break;
+  case 2:
+    current = (current & ~0xFFFFULL) | (value & 0xFFFF);
+    break;
+  case 4:
+    current = value & 0xFFFFFFFF;
+    break;
+  default:
+    current = value;
+    break;
+  }
+  *reg = (greg_t)current;
+}
+
+/* Opens the page for one instruction, filled with the register values */
+void StartStep(ucontext_t *context, struct Window *window, uintptr_t address, bool isWrite)
+{
+  step.isActive = true;
+  step.isWrite = isWrite;
+  step.address = address & ~(uintptr_t)3;
+  step.page = (uint8_t *)(address & ~(uintptr_t)(PAGE_SIZE - 1));
+  if ((step.address + sizeof(step.before)) > (uintptr_t)step.page + PAGE_SIZE)
+  {
+    SimError("access across a page at 0x%08lX", (unsigned long)address);
+  }
+  mprotect(step.page, PAGE_SIZE, PROT_READ | PROT_WRITE);
+  if (window->shadow != NULL)
+  {
+    for (uint8_t i = 0; i < sizeof(step.before); i += 4)
+    {
+      const uint32_t value = ReadWord((uint32_t)step.address + i, false);
+      memcpy((uint8_t *)step.address + i, &value, 4);
+    }
+  }
+  memcpy(step.before, (const void *)step.address, sizeof(step.before));
+  context->uc_mcontext.gregs[REG_EFL] |= EFLAGS_TRAP;
+}
+
+/* Applies the bytes the instruction changed and closes the page again */
+void FinishStep(ucontext_t *context)
+{
+  struct Window *window = FindWindow(step.address);
+  uint8_t after[sizeof(step.before)];
+  context->uc_mcontext.gregs[REG_EFL] &= ~EFLAGS_TRAP;
+  memcpy(after, (const void *)step.address, sizeof(after));
+  if (window->shadow == NULL)
+  {
+    memcpy((void *)step.address, step.before, sizeof(step.before));
+  }
+  mprotect(step.page, PAGE_SIZE, window->protection);
+  step.isActive = false;
+  for (uint8_t i = 0; i < sizeof(after); ++i)
+  {
+    if (after[i] == step.before[i])
+    {
+      continue;
+    }
+    if (window->shadow == NULL)
+    {
+      FlashWrite((uint32_t)step.address + (i & ~1U), 2, after[i & ~1U] | ((uint32_t)after[(i & ~1U) + 1] << 8));
+      i |= 1;
+    }
+    else
+    {
+      WriteRegisters(step.address + i, 1, after[i]);
+    }
+  }
+  if (!step.isWrite && (window->shadow != NULL))
+  {
+    (void)ReadWord((uint32_t)step.address, true);
+  }
+}
+
+/* After every access the core is charged and interrupts are taken */
+void FinishAccess(void)
+{
+  ++simStats.accessesCount;
+  SimUpdateInterrupts();
+  Charge(ACCESS_CYCLES);
+  TakeInterrupts();
+}
+
+void HandleFault(int number, siginfo_t *info, void *data)
+{
+  ucontext_t *context = data;
+  const uintptr_t address = (uintptr_t)info->si_addr;
+  struct Window *window = FindWindow(address);
+  const bool isWrite = (context->uc_mcontext.gregs[REG_ERR] & 2) != 0;
+  if ((window == NULL) || step.isActive || ((window->shadow == NULL) && !isWrite) || (window == &windows[WINDOW_SYSTEM_MEMORY]))
+  {
+    fprintf(stderr, "sim: segmentation fault at 0x%lx, rip 0x%llx\n", (unsigned long)address,
+            (unsigned long long)context->uc_mcontext.gregs[REG_RIP]);
+    fflush(NULL);
+    _exit(RUN_ERROR_STATUS);
+  }
+  struct Move move;
+  if (DecodeMove((const uint8_t *)context->uc_mcontext.gregs[REG_RIP], &move))
+  {
+    EmulateMove(context, &move, address);
+    context->uc_mcontext.gregs[REG_RIP] += move.length;
+    FinishAccess();
+  }
+  else
+  {
+    StartStep(context, window, address, isWrite);
+  }
+}
+
+void HandleTrap(int number, siginfo_t *info, void *data)
+{
+  if (!step.isActive)
+  {
+    signal(SIGTRAP, SIG_DFL);
+    return;
+  }
+  FinishStep(data);
+  FinishAccess();
+}
+
+/* Time ----------------------------------------------------------------------*/
+SimTime GetNextEvent(void)
+{
+  SimTime next = GetSysTickNextEvent();
+  const SimTime devices = GetDevicesNextEvent();
+  if (devices < next)
+  {
+    next = devices;
+  }
+  if ((scheduledEvents != NULL) && (scheduledEvents->time < next))
+  {
+    next = scheduledEvents->time;
+  }
+  return next;
+}
+
+/* Runs every event up to target, in order */
+void Advance(SimTime target)
+{
+  for (;;)
+  {
+    const SimTime next = GetNextEvent();
+    if (next > target)
+    {
+      break;
+    }
+    if (next > runEndTime)
+    {
+      simNow = runEndTime;
+      EndRun();
+    }
+    if (next > simNow)
+    {
+      simNow = next;
+    }
+    if (GetSysTickNextEvent() <= simNow)
+    {
+      ProcessSysTick();
+    }
+    else if (GetDevicesNextEvent() <= simNow)
+    {
+      ProcessDeviceEvents();
+    }
+    else
+    {
+      struct ScheduledEvent *event = scheduledEvents;
+      scheduledEvents = event->next;
+      event->callback(event->argument);
+      free(event);
+    }
+    SimUpdateInterrupts();
+  }
+  if (target >= runEndTime)
+  {
+    simNow = runEndTime;
+    EndRun();
+  }
+  if (target > simNow)
+  {
+    simNow = target;
+  }
+}
+
+void Charge(uint32_t cycles)
+{
+  const uint32_t hclk = GetHclkFrequency();
+  if (hclk != 0)
+  {
+    Advance(SimTimeOfTicks(cycles, simNow, hclk));
+  }
+}
+
+void SimStall(SimTime duration)
+{
+  ++stallDepth;
+  Advance(simNow + duration);
+  --stallDepth;
+}
+
+bool SimIsStopped(void)
+{
+  return isStopped;
+}
+
+/* Host hooks ----------------------------------------------------------------*/
+void HostInterruptsUnmasked(void)
+{
+  TakeInterrupts();
+}
+
+/* SLEEP or, with SLEEPDEEP set, STOP until an interrupt is pending */
+void HostWaitForInterrupt(void)
+{
+  const bool isDeep = (*SimShadow((uint32_t)&SCB->SCR) & SCB_SCR_SLEEPDEEP_Msk) != 0;
+  const SimTime start = simNow;
+  if (isDeep)
+  {
+    isStopped = true;
+    ++simStats.stopCount;
+    SimClocksChanged();
+  }
+  SimUpdateInterrupts();
+  while (!IsPreemptionPending(false))
+  {
+    const SimTime next = GetNextEvent();
+    /* The firmware may well stay asleep until the end of the run */
+    if ((next == SIM_NEVER) && (runEndTime == SIM_NEVER))
+    {
+      SimError("WFI with nothing left to wake the core up");
+    }
+    Advance(next);
+  }
+  if (isDeep)
+  {
+    isStopped = false;
+    WakeUpClocks();
+    SimClocksChanged();
+    simStats.stopTime += simNow - start;
+    SimStall(STOP_WAKEUP_TIME);
+  }
+  else
+  {
+    simStats.sleepTime += simNow - start;
+  }
+  TakeInterrupts();
+}
+
+/* A strong definition over the weak one of the HAL, so polling loops on
+   the tick move the time on */
+uint32_t HAL_GetTick(void)
+{
+  Charge(TICK_READ_CYCLES);
+  TakeInterrupts();
+  return uwTick;
+}
+
+/* Run control ---------------------------------------------------------------*/
+void EndRun(void)
+{
+  siglongjmp(runEnd, 1);
+}
+
+void InstallHandler(int number, void (*handler)(int, siginfo_t *, void *))
+{
+  struct sigaction action;
+  memset(&action, 0, sizeof(action));
+  action.sa_sigaction = handler;
+  /* Handlers run the firmware's interrupt handlers, which fault in turn */
+  action.sa_flags = SA_SIGINFO | SA_NODEFER;
+  sigemptyset(&action.sa_mask);
+  sigaction(number, &action, NULL);
+}
+
+void SimInit(void)
+{
+  for (uint8_t i = 0; i < WINDOWS_COUNT; ++i)
+  {
+    struct Window *window = &windows[i];
+    /* The flash is shared, so it keeps its contents over the forked runs */
+    const int flags = MAP_FIXED_NOREPLACE | MAP_ANONYMOUS | ((i == WINDOW_FLASH) ? MAP_SHARED : MAP_PRIVATE);
+    if (mmap((void *)(uintptr_t)window->base, window->size, PROT_READ | PROT_WRITE, flags, -1, 0) == MAP_FAILED)
+    {
+      perror("sim: mmap");
+      exit(EXIT_FAILURE);
+    }
+    if ((i == WINDOW_PERIPHERALS) || (i == WINDOW_CORE))
+    {
+      window->shadow = calloc(window->size / 4, 4);
+    }
+  }
+  memcpy((uint8_t *)UID_BASE, DEVICE_UID, sizeof(DEVICE_UID));
+  const uint16_t flashSize = (FLASH_BANK1_END + 1 - FLASH_BASE) / 1024;
+  memcpy((uint8_t *)FLASHSIZE_BASE, &flashSize, sizeof(flashSize));
+  /* Option bytes of a new device, read protection off */
+  memset((uint8_t *)OB_BASE, 0xFF, 16);
+  *(uint16_t *)OB_BASE = 0x5AA5;
+  SimEraseFlash();
+  for (uint8_t i = 0; i < WINDOWS_COUNT; ++i)
+  {
+    mprotect((void *)(uintptr_t)windows[i].base, windows[i].size, windows[i].protection);
+  }
+  InstallHandler(SIGSEGV, HandleFault);
+  InstallHandler(SIGTRAP, HandleTrap);
+}
+
+void SimEraseFlashRange(uint32_t start, uint32_t size)
+{
+  struct Window *flash = &windows[WINDOW_FLASH];
+  mprotect((void *)(uintptr_t)flash->base, flash->size, PROT_READ | PROT_WRITE);
+  memset((void *)(uintptr_t)start, 0xFF, size);
+  mprotect((void *)(uintptr_t)flash->base, flash->size, flash->protection);
+}
+
+void SimProgramFlash(uint32_t address, uint16_t data)
+{
+  struct Window *flash = &windows[WINDOW_FLASH];
+  mprotect((void *)(uintptr_t)flash->base, flash->size, PROT_READ | PROT_WRITE);
+  memcpy((void *)(uintptr_t)address, &data, sizeof(data));
+  mprotect((void *)(uintptr_t)flash->base, flash->size, flash->protection);
+}
+
+void SimEraseFlash(void)
+{
+  SimEraseFlashRange(windows[WINDOW_FLASH].base, windows[WINDOW_FLASH].size);
+}
+
+unsigned SimRun(SimTime duration, void (*setup)(void), void (*finish)(void))
+{
+  fflush(NULL);
+  const pid_t pid = fork();
+  if (pid < 0)
+  {
+    perror("sim: fork");
+    return 1;
+  }
+  if (pid == 0)
+  {
+    ResetCore();
+    ResetDevices();
+    runEndTime = duration;
+    if (setup != NULL)
+    {
+      setup();
+    }
+    if (sigsetjmp(runEnd, 1) == 0)
+    {
+      SystemInit();
+      FirmwareMain();
+      SimError("main returned");
+    }
+    /* The checks may read registers, which must not end the run again */
+    runEndTime = SIM_NEVER;
+    if (finish != NULL)
+    {
+      finish();
+    }
+    fflush(NULL);
+    _exit((testsFailedCount < RUN_FAILURES_MAX) ? (int)testsFailedCount : RUN_FAILURES_MAX);
+  }
+  int status;
+  if (waitpid(pid, &status, 0) < 0)
+  {
+    perror("sim: waitpid");
+    return 1;
+  }
+  if (WIFSIGNALED(status))
+  {
+    fprintf(stderr, "sim: run killed by signal %d\n", WTERMSIG(status));
+    return 1;
+  }
+  const int code = WEXITSTATUS(status);
+  return (code == RUN_ERROR_STATUS) ? 1 : (unsigned)code;
+}
+
+SimTime SimNow(void)
+{
+  return simNow;
+}
+
+void SimSchedule(SimTime time, SimEventCallback callback, void *argument)
+{
+  struct ScheduledEvent *event = malloc(sizeof(*event));
+  struct ScheduledEvent **slot = &scheduledEvents;
+  event->time = (time > simNow) ? time : simNow;
+  event->callback = callback;
+  event->argument = argument;
+  while ((*slot != NULL) && ((*slot)->time <= event->time))
+  {
+    slot = &(*slot)->next;
+  }
+  event->next = *slot;
+  *slot = event;
+}
+
+const struct SimStats *SimGetStats(void)
+{
+  return &simStats;
+}
+
+const struct SimIrqStats *SimGetIrqStats(IRQn_Type irq)
+{
+  return &simStats.exceptions[irq + 16];
+}
+
+uint32_t SimGetHclkFrequency(void)
+{
+  return GetHclkFrequency();
+}
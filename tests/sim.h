@@ -0,0 +1,109 @@
+/**
+  ******************************************************************************
+  * @file           : sim.h
+  * @brief          : Register level simulator of the STM32F103x6.
+  *
+  *                   A simulator program links a firmware's own sources and
+  *                   HAL drivers unmodified, with main renamed FirmwareMain.
+  *                   The peripheral, bit-band, core peripheral, flash and
+  *                   system memory ranges are mapped at their device
+  *                   addresses, and every load and store to a register
+  *                   faults into the models of sim.c and sim_devices.c.
+  *
+  *                   Time is virtual and kept in picoseconds. Register
+  *                   accesses, exception entry and exit, flash programming
+  *                   and the HAL tick reads are charged to the core at the
+  *                   HCLK of the moment, the code in between takes no time.
+  *                   A WFI jumps to the next peripheral or script event, so
+  *                   runs go much faster than real time.
+  *
+  *                   Every SimRun starts the firmware from reset in a forked
+  *                   process, with fresh RAM and the flash contents left by
+  *                   the runs before. The setup callback schedules the pin
+  *                   and serial stimulus, the finish callback checks the
+  *                   outputs, traces and statistics once the time is up.
+  ******************************************************************************
+  */
+
+#ifndef __SIM_H
+#define __SIM_H
+
+#include "stm32f1xx_hal.h"
+#include <stdbool.h>
+
+/* Virtual time in picoseconds since reset */
+typedef uint64_t SimTime;
+
+#define SIM_NEVER UINT64_MAX
+#define SIM_NS(t) ((SimTime)(t) * 1000ULL)
+#define SIM_US(t) ((SimTime)(t) * 1000000ULL)
+#define SIM_MS(t) ((SimTime)(t) * 1000000000ULL)
+#define SIM_S(t) ((SimTime)(t) * 1000000000000ULL)
+#define SIM_TO_US(t) ((t) / 1000000ULL)
+
+static inline bool SimIsNear(SimTime time, SimTime expected, SimTime tolerance)
+{
+  return (time + tolerance >= expected) && (time <= expected + tolerance);
+}
+
+/* Exception numbers, IRQn + 16 */
+#define SIM_EXCEPTIONS_COUNT 64
+
+typedef void (*SimEventCallback)(void *argument);
+/* Output levels of a port once they changed */
+typedef void (*SimPinsListener)(GPIO_TypeDef *port, uint16_t changedPins, uint16_t levels);
+/* A byte once its stop bit is on the TX line of USART1 */
+typedef void (*SimUartListener)(uint8_t byte);
+/* A timer counter that overflowed, forced updates aside */
+typedef void (*SimTimerListener)(TIM_TypeDef *instance);
+/* 12-bit conversion result of an ADC channel */
+typedef uint16_t (*SimAdcSource)(uint8_t channel);
+
+struct SimIrqStats
+{
+  uint32_t count;
+  /* From the pending request to the first instruction of the handler */
+  SimTime totalLatency;
+  SimTime maxLatency;
+};
+
+struct SimStats
+{
+  uint64_t accessesCount;
+  SimTime sleepTime;
+  SimTime stopTime;
+  uint32_t stopCount;
+  /* Serial bytes that came while the receiver was off or unclocked */
+  uint32_t uartLostCount;
+  struct SimIrqStats exceptions[SIM_EXCEPTIONS_COUNT];
+};
+
+/* Maps the device address ranges and erases the flash, once per program */
+void SimInit(void);
+/* Runs the firmware from reset for duration and returns the failed checks
+   count of the run, a crash or a simulation error counts as one */
+unsigned SimRun(SimTime duration, void (*setup)(void), void (*finish)(void));
+SimTime SimNow(void);
+/* Calls back at an absolute time, in order of time then of scheduling */
+void SimSchedule(SimTime time, SimEventCallback callback, void *argument);
+void SimEraseFlash(void);
+const struct SimStats *SimGetStats(void);
+const struct SimIrqStats *SimGetIrqStats(IRQn_Type irq);
+uint32_t SimGetHclkFrequency(void);
+
+/* Drives input pins from outside, or lets them float again */
+void SimSetPins(GPIO_TypeDef *port, uint16_t pins, bool level);
+void SimReleasePins(GPIO_TypeDef *port, uint16_t pins);
+/* Levels on the pins of a port, as the IDR reads them */
+uint16_t SimGetPins(GPIO_TypeDef *port);
+void SimSetPinsListener(SimPinsListener listener);
+
+/* Sends bytes back to back to the RX pin of USART1, after any already sent */
+void SimSendUart(const uint8_t *data, uint16_t length, uint32_t baudRate);
+void SimSetUartListener(SimUartListener listener);
+void SimSetTimerListener(SimTimerListener listener);
+void SimSetAdcSource(SimAdcSource source);
+/* The LSI is only known to within 30 to 60 kHz, 40 kHz by default */
+void SimSetLsiFrequency(uint32_t frequency);
+
+#endif /* __SIM_H */
@@ -0,0 +1,200 @@
+/**
+  ******************************************************************************
+  * @file           : sim_counter.c
+  * @brief          : The counter firmware on the simulator, driven from its
+  *                   buttons and read back from its display. Built once per
+  *                   DISPLAY_MODE: sim_counter reads the multiplexed digits,
+  *                   sim_counter_binary the bus of the binary display.
+  ******************************************************************************
+  */
+
+#include "sim.h"
+#include "test.h"
+#include "glyphs.h"
+
+#define INCREMENT_PIN GPIO_PIN_0
+#define RESET_PIN GPIO_PIN_1
+#define OVERFLOW_PIN GPIO_PIN_7
+#define PRESS_TIME SIM_MS(100)
+#define PRESS_PERIOD SIM_MS(250)
+#define DIGITS_COUNT 4
+/* 20 ms of debounce, then up to a 4 ms display frame */
+#define DISPLAY_LATENCY_MAX SIM_MS(30)
+#define BUTTON_DEBOUNCE SIM_MS(20)
+#define LONG_PRESS_TIME SIM_S(3)
+/* The auto-repeat steps by 1 every 1000, 250 then 100 ms, then by 5 every
+   20 ms and by 25 every 10 ms from 9 s on, at 531. It wraps past 0xD4A
+   after 115 more steps, past 9999 after 379 */
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+#define SIM_NAME "sim_counter"
+#define SWEEP_TIME SIM_MS(12790)
+#define LAST_SWEPT_NUMBER 9981
+#else
+#define SIM_NAME "sim_counter_binary"
+#define SWEEP_TIME SIM_MS(10150)
+#define LAST_SWEPT_NUMBER 3381
+#endif
+/* The timers tick every millisecond */
+#define SWEEP_TIME_TOLERANCE SIM_MS(2)
+
+/* Digits units first, as DISPLAY_DIGIT_PINS of main.c */
+const uint16_t DIGIT_PINS[DIGITS_COUNT] = { DISPLAY_4_Pin, DISPLAY_3_Pin, DISPLAY_2_Pin, DISPLAY_1_Pin };
+const uint16_t SEGMENT_PINS = DISPLAY_A_Pin | DISPLAY_B_Pin | DISPLAY_C_Pin | DISPLAY_D_Pin
+                            | DISPLAY_E_Pin | DISPLAY_F_Pin | DISPLAY_G_Pin;
+const uint16_t GLYPHS[GLYPH_COUNT] = GLYPH_PINS_TABLE;
+
+int8_t shownDigits[DIGITS_COUNT] = { -1, -1, -1, -1 };
+int32_t shownNumber = -1;
+int32_t overflowedNumber = -1;
+SimTime shownTime;
+SimTime lastReleaseTime;
+SimTime lastPressTime;
+SimTime overflowTime;
+
+void ShowNumber(int32_t number)
+{
+  if (number != shownNumber)
+  {
+    shownNumber = number;
+    shownTime = SimNow();
+  }
+}
+
+#if DISPLAY_MODE == DISPLAY_DECIMAL
+/* The segments are lit low, while their digit is selected high */
+void ReadDisplay(uint16_t levels)
+{
+  for (uint8_t i = 0; i < DIGITS_COUNT; ++i)
+  {
+    if ((levels & (DIGIT_PINS[0] | DIGIT_PINS[1] | DIGIT_PINS[2] | DIGIT_PINS[3])) != DIGIT_PINS[i])
+    {
+      continue;
+    }
+    shownDigits[i] = -1;
+    for (uint8_t glyph = GLYPH_0; glyph <= GLYPH_9; ++glyph)
+    {
+      if (GLYPHS[glyph] == (~levels & SEGMENT_PINS))
+      {
+        shownDigits[i] = (int8_t)glyph;
+      }
+    }
+  }
+  int32_t number = 0;
+  for (int8_t i = DIGITS_COUNT - 1; i >= 0; --i)
+  {
+    if (shownDigits[i] < 0)
+    {
+      return;
+    }
+    number = 10 * number + shownDigits[i];
+  }
+  ShowNumber(number);
+}
+#else
+void ReadDisplay(uint16_t levels)
+{
+  ShowNumber(levels & 0x0FFF);
+}
+#endif
+
+void HandlePins(GPIO_TypeDef *port, uint16_t changed, uint16_t levels)
+{
+  if (port == GPIOA)
+  {
+    ReadDisplay(levels);
+  }
+  else if ((port == GPIOB) && ((changed & levels & OVERFLOW_PIN) != 0) && (overflowTime == 0))
+  {
+    /* Raised before the wrapped value is shown */
+    overflowTime = SimNow();
+    overflowedNumber = shownNumber;
+  }
+}
+
+void PressButton(void *pin)
+{
+  SimSetPins(GPIOB, (uint16_t)(uintptr_t)pin, false);
+  lastPressTime = SimNow();
+}
+
+void ReleaseButton(void *pin)
+{
+  SimSetPins(GPIOB, (uint16_t)(uintptr_t)pin, true);
+  lastReleaseTime = SimNow();
+}
+
+void ClickButton(SimTime time, uint16_t pin)
+{
+  SimSchedule(time, PressButton, (void *)(uintptr_t)pin);
+  SimSchedule(time + PRESS_TIME, ReleaseButton, (void *)(uintptr_t)pin);
+}
+
+void SetUpButtons(void)
+{
+  SimSetPinsListener(HandlePins);
+  SimSetPins(GPIOB, INCREMENT_PIN | RESET_PIN, true);
+}
+
+void SetUpIncrements(void)
+{
+  SetUpButtons();
+  for (uint8_t i = 0; i < 3; ++i)
+  {
+    ClickButton(SIM_MS(100) + i * PRESS_PERIOD, INCREMENT_PIN);
+  }
+}
+
+void CheckIncrements(void)
+{
+  CHECK_EQUAL(3, shownNumber);
+  CHECK((shownTime > lastReleaseTime) && (shownTime - lastReleaseTime <= DISPLAY_LATENCY_MAX));
+  printf("%s: display updated %llu us after the release\n", SIM_NAME,
+         (unsigned long long)SIM_TO_US(shownTime - lastReleaseTime));
+}
+
+/* The count is saved once the clicks are classified, and shown again
+   after a reset */
+void CheckRestored(void)
+{
+  CHECK_EQUAL(3, shownNumber);
+}
+
+void SetUpReset(void)
+{
+  SetUpButtons();
+  ClickButton(SIM_MS(100), RESET_PIN);
+}
+
+void CheckReset(void)
+{
+  CHECK_EQUAL(0, shownNumber);
+}
+
+void SetUpAutoRepeat(void)
+{
+  SetUpButtons();
+  SimSchedule(SIM_MS(100), PressButton, (void *)(uintptr_t)INCREMENT_PIN);
+}
+
+/* Held down from 0, the increment button sweeps the whole range and wraps */
+void CheckAutoRepeat(void)
+{
+  const SimTime repeatStart = lastPressTime + BUTTON_DEBOUNCE + LONG_PRESS_TIME;
+  CHECK(overflowTime > repeatStart);
+  CHECK(SimIsNear(overflowTime - repeatStart, SWEEP_TIME, SWEEP_TIME_TOLERANCE));
+  CHECK_EQUAL(LAST_SWEPT_NUMBER, overflowedNumber);
+  printf("%s: swept up to %d in %llu ms of auto-repeat\n", SIM_NAME, (int)overflowedNumber,
+         (unsigned long long)SIM_TO_US(overflowTime - repeatStart) / 1000);
+}
+
+int main(void)
+{
+  SimInit();
+  testsFailedCount += SimRun(SIM_S(2), SetUpIncrements, CheckIncrements);
+  testsFailedCount += SimRun(SIM_MS(200), SetUpButtons, CheckRestored);
+  testsFailedCount += SimRun(SIM_MS(500), SetUpReset, CheckReset);
+  SimEraseFlash();
+  testsFailedCount += SimRun(SIM_MS(100) + BUTTON_DEBOUNCE + LONG_PRESS_TIME + SWEEP_TIME + SIM_MS(100),
+                             SetUpAutoRepeat, CheckAutoRepeat);
+  return FinishTests(SIM_NAME);
+}
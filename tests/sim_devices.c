@@ -0,0 +1,1475 @@
+/**
+  ******************************************************************************
+  * @file           : sim_devices.c
+  * @brief          : Models of the STM32F103x6 peripherals the firmwares use:
+  *                   RCC, FLASH, GPIO with EXTI and AFIO, TIM1 to TIM3, DMA1,
+  *                   USART1, ADC1, PWR and the RTC.
+  *
+  *                   Registers without side effects are plain shadow words.
+  *                   The counters are computed from the time and clock they
+  *                   last started from, and rebased whenever their clock or
+  *                   configuration changes, so nothing runs between two
+  *                   accesses or events. The timers count up only, and the
+  *                   DMA moves its data as soon as a request is raised.
+  ******************************************************************************
+  */
+
+/* Includes ------------------------------------------------------------------*/
+#include "sim_devices.h"
+#include <string.h>
+
+/* Private define ------------------------------------------------------------*/
+#define HSE_FREQUENCY 8000000U
+#define LSI_FREQUENCY 40000U
+#define GPIO_PORTS_COUNT 4
+#define TIMERS_COUNT 3
+#define DMA_CHANNELS_COUNT 7
+#define UART_QUEUE_SIZE 1024
+/* Receivers sample the middle of the bits, so a larger gap breaks the frame */
+#define UART_BAUD_TOLERANCE_PERCENT 3
+/* Flash programming and page erase times, typical */
+#define FLASH_PROGRAM_TIME SIM_US(52)
+#define FLASH_ERASE_TIME SIM_MS(20)
+#define FLASH_PAGE_SIZE 0x400U
+#define FLASH_KEY_1 0x45670123U
+#define FLASH_KEY_2 0xCDEF89ABU
+/* Default readings of the temperature sensor and of VREFINT, 25 C and 1.2 V
+   at 3.3 V */
+#define ADC_VREFINT_CHANNEL 17
+#define ADC_TEMPERATURE_READING 1774
+#define ADC_VREFINT_READING 1489
+#define TIM_MMS_UPDATE (2U << TIM_CR2_MMS_Pos)
+#define ADC_EXTSEL_TIM3_TRGO (4U << ADC_CR2_EXTSEL_Pos)
+#define ADC_EXTSEL_SWSTART (7U << ADC_CR2_EXTSEL_Pos)
+#define RTC_SYNCHRONIZATION_CYCLES 2
+
+#define REG(register) (*SimShadow((uint32_t)&(register)))
+#define IS_IN(address, base, size) (((address) >= (base)) && ((address) - (base) < (size)))
+
+/* Private typedef -----------------------------------------------------------*/
+struct Timer
+{
+  TIM_TypeDef *instance;
+  bool isOnApb2;
+  uint8_t dmaChannel;
+  /* Counts from baseCount and basePrescalerCount at baseTime, at frequency */
+  uint64_t frequency;
+  SimTime baseTime;
+  uint32_t baseCount;
+  uint32_t basePrescalerCount;
+  uint32_t prescaler;
+  uint32_t autoReload;
+};
+
+struct DmaChannel
+{
+  uint32_t count;
+  uint32_t peripheralAddress;
+  uint32_t memoryAddress;
+};
+
+struct UartByte
+{
+  SimTime start;
+  uint32_t baudRate;
+  uint8_t data;
+};
+
+enum UartRxPhase
+{
+  UART_RX_START_BIT,
+  UART_RX_DATA_BITS,
+  UART_RX_STOP_BIT
+};
+
+/* Private variables ---------------------------------------------------------*/
+const uint8_t AHB_SHIFTS[16] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 2, 3, 4, 6, 7, 8, 9 };
+const uint8_t APB_SHIFTS[8] = { 0, 0, 0, 0, 1, 2, 3, 4 };
+/* Sample times in half ADC cycles */
+const uint16_t ADC_SAMPLE_HALF_CYCLES[8] = { 3, 15, 27, 57, 83, 111, 143, 479 };
+GPIO_TypeDef *const GPIO_PORTS[GPIO_PORTS_COUNT] = { GPIOA, GPIOB, GPIOC, GPIOD };
+
+uint32_t lsiFrequency = LSI_FREQUENCY;
+SimPinsListener pinsListener;
+SimUartListener uartListener;
+SimAdcSource adcSource;
+SimTimerListener timerListener;
+
+uint16_t drivenPins[GPIO_PORTS_COUNT];
+uint16_t drivenLevels[GPIO_PORTS_COUNT];
+uint16_t pinLevels[GPIO_PORTS_COUNT];
+
+bool isFlashKeyAccepted;
+
+struct Timer timers[TIMERS_COUNT] =
+{
+  { .instance = TIM1, .isOnApb2 = true, .dmaChannel = 5 },
+  { .instance = TIM2, .isOnApb2 = false, .dmaChannel = 2 },
+  { .instance = TIM3, .isOnApb2 = false, .dmaChannel = 3 }
+};
+
+struct DmaChannel dmaChannels[DMA_CHANNELS_COUNT];
+bool isServicingDma;
+
+/* Transmitter: shift register and data register */
+bool isUartShifting;
+uint8_t uartShiftData;
+SimTime uartShiftEnd;
+bool isUartTdrFull;
+uint8_t uartTdr;
+bool isUartTcClearArmed;
+/* Receiver: the bytes on their way, sent back to back */
+struct UartByte uartQueue[UART_QUEUE_SIZE];
+uint16_t uartQueueHead;
+uint16_t uartQueueLength;
+SimTime uartQueueEnd;
+enum UartRxPhase uartRxPhase;
+bool isUartRxClocked;
+SimTime uartIdleTime;
+uint32_t uartErrorsReadMask;
+
+/* Regular sequence of ADC1, converting rank adcRank until adcConversionEnd */
+bool isAdcConverting;
+uint8_t adcRank;
+SimTime adcConversionEnd;
+
+/* RTC counter */
+uint64_t rtcFrequency;
+SimTime rtcBaseTime;
+uint32_t rtcBaseCount;
+SimTime rtcSynchronizedTime;
+
+/* Private function prototypes -----------------------------------------------*/
+void ServiceDmaRequests(void);
+void RequestDma(uint8_t channel);
+void TriggerAdc(uint32_t source);
+void UpdatePins(uint8_t port);
+
+/* Private user code ---------------------------------------------------------*/
+/* Clocks --------------------------------------------------------------------*/
+uint32_t GetSysclkFrequency(void)
+{
+  if (SimIsStopped())
+  {
+    return 0;
+  }
+  const uint32_t configuration = REG(RCC->CFGR);
+  switch (configuration & RCC_CFGR_SWS)
+  {
+  case RCC_CFGR_SWS_HSE:
+    return HSE_FREQUENCY;
+  case RCC_CFGR_SWS_PLL:
+  {
+    uint32_t multiplier = ((configuration & RCC_CFGR_PLLMULL) >> RCC_CFGR_PLLMULL_Pos) + 2;
+    if (multiplier > 16)
+    {
+      multiplier = 16;
+    }
+    uint32_t source = HSI_FREQUENCY / 2;
+    if ((configuration & RCC_CFGR_PLLSRC) != 0)
+    {
+      source = ((configuration & RCC_CFGR_PLLXTPRE) != 0) ? HSE_FREQUENCY / 2 : HSE_FREQUENCY;
+    }
+    return source * multiplier;
+  }
+  default:
+    return HSI_FREQUENCY;
+  }
+}
+
+uint32_t GetHclkFrequency(void)
+{
+  return GetSysclkFrequency() >> AHB_SHIFTS[(REG(RCC->CFGR) & RCC_CFGR_HPRE) >> RCC_CFGR_HPRE_Pos];
+}
+
+uint32_t GetPclkFrequency(bool isApb2)
+{
+  const uint32_t configuration = REG(RCC->CFGR);
+  const uint32_t prescaler = isApb2 ? (configuration & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos
+                                    : (configuration & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos;
+  return GetHclkFrequency() >> APB_SHIFTS[prescaler];
+}
+
+/* A divided APB clocks its timers at twice its own rate */
+uint32_t GetTimerFrequency(bool isApb2)
+{
+  const uint32_t configuration = REG(RCC->CFGR);
+  const uint32_t prescaler = isApb2 ? (configuration & RCC_CFGR_PPRE2) >> RCC_CFGR_PPRE2_Pos
+                                    : (configuration & RCC_CFGR_PPRE1) >> RCC_CFGR_PPRE1_Pos;
+  const uint32_t pclk = GetPclkFrequency(isApb2);
+  return (APB_SHIFTS[prescaler] == 0) ? pclk : 2 * pclk;
+}
+
+uint32_t GetAdcFrequency(void)
+{
+  const uint32_t prescaler = (REG(RCC->CFGR) & RCC_CFGR_ADCPRE) >> RCC_CFGR_ADCPRE_Pos;
+  return GetPclkFrequency(true) / (2 * (prescaler + 1));
+}
+
+void WriteRcc(uint32_t address, uint32_t value)
+{
+  uint32_t *shadow = SimShadow(address);
+  if (address == (uint32_t)&RCC->CR)
+  {
+    value &= ~(RCC_CR_HSIRDY | RCC_CR_HSERDY | RCC_CR_PLLRDY);
+    value |= ((value & RCC_CR_HSION) != 0) ? RCC_CR_HSIRDY : 0;
+    value |= ((value & RCC_CR_HSEON) != 0) ? RCC_CR_HSERDY : 0;
+    value |= ((value & RCC_CR_PLLON) != 0) ? RCC_CR_PLLRDY : 0;
+    *shadow = value;
+  }
+  else if (address == (uint32_t)&RCC->CFGR)
+  {
+    /* The switch only happens to a ready source */
+    const uint32_t source = value & RCC_CFGR_SW;
+    const uint32_t control = REG(RCC->CR);
+    const bool isReady = ((source == RCC_CFGR_SW_HSI) && ((control & RCC_CR_HSIRDY) != 0))
+                      || ((source == RCC_CFGR_SW_HSE) && ((control & RCC_CR_HSERDY) != 0))
+                      || ((source == RCC_CFGR_SW_PLL) && ((control & RCC_CR_PLLRDY) != 0));
+    const uint32_t status = isReady ? source << 2 : (*shadow & RCC_CFGR_SWS);
+    *shadow = (value & ~RCC_CFGR_SWS) | status;
+  }
+  else if (address == (uint32_t)&RCC->CSR)
+  {
+    value = (value & ~RCC_CSR_LSIRDY) | (((value & RCC_CSR_LSION) != 0) ? RCC_CSR_LSIRDY : 0);
+    if ((value & RCC_CSR_RMVF) != 0)
+    {
+      value &= ~(RCC_CSR_RMVF | 0xFC000000);
+    }
+    *shadow = value;
+  }
+  else if (address == (uint32_t)&RCC->BDCR)
+  {
+    *shadow = (value & ~RCC_BDCR_LSERDY) | (((value & RCC_BDCR_LSEON) != 0) ? RCC_BDCR_LSERDY : 0);
+  }
+  else
+  {
+    *shadow = value;
+  }
+  SimClocksChanged();
+}
+
+/* The core wakes up from STOP on HSI, with the PLL and the HSE off */
+void WakeUpClocks(void)
+{
+  REG(RCC->CR) = (REG(RCC->CR) & ~(RCC_CR_PLLON | RCC_CR_PLLRDY | RCC_CR_HSEON | RCC_CR_HSERDY))
+                 | RCC_CR_HSION | RCC_CR_HSIRDY;
+  REG(RCC->CFGR) &= ~(RCC_CFGR_SW | RCC_CFGR_SWS);
+}
+
+/* Flash ---------------------------------------------------------------------*/
+void WriteFlashController(uint32_t address, uint32_t value, uint32_t mask)
+{
+  uint32_t *shadow = SimShadow(address);
+  if (address == (uint32_t)&FLASH->KEYR)
+  {
+    if (value == FLASH_KEY_1)
+    {
+      isFlashKeyAccepted = true;
+    }
+    else if (isFlashKeyAccepted && (value == FLASH_KEY_2))
+    {
+      REG(FLASH->CR) &= ~FLASH_CR_LOCK;
+    }
+    else
+    {
+      isFlashKeyAccepted = false;
+    }
+  }
+  else if (address == (uint32_t)&FLASH->SR)
+  {
+    *shadow &= ~(value & mask & (FLASH_SR_EOP | FLASH_SR_PGERR | FLASH_SR_WRPRTERR));
+  }
+  else if (address == (uint32_t)&FLASH->CR)
+  {
+    if ((*shadow & FLASH_CR_LOCK) != 0)
+    {
+      return;
+    }
+    *shadow = value & ~FLASH_CR_STRT;
+    if ((value & FLASH_CR_STRT) == 0)
+    {
+      return;
+    }
+    uint32_t start = FLASH_BASE, size = FLASH_BANK1_END + 1 - FLASH_BASE;
+    if ((value & FLASH_CR_PER) != 0)
+    {
+      start = REG(FLASH->AR) & ~(FLASH_PAGE_SIZE - 1);
+      size = FLASH_PAGE_SIZE;
+    }
+    else if ((value & FLASH_CR_MER) == 0)
+    {
+      return;
+    }
+    if (!IS_IN(start, FLASH_BASE, FLASH_BANK1_END + 1 - FLASH_BASE))
+    {
+      SimError("flash erase at 0x%08X", start);
+    }
+    /* The core stalls on its next fetch from the flash */
+    SimStall(FLASH_ERASE_TIME);
+    SimEraseFlashRange(start, size);
+    REG(FLASH->SR) |= FLASH_SR_EOP;
+  }
+  else if (address != (uint32_t)&FLASH->OBR)
+  {
+    *shadow = value;
+  }
+}
+
+/* A store to the flash memory itself */
+void FlashWrite(uint32_t address, uint8_t size, uint32_t value)
+{
+  const uint32_t control = REG(FLASH->CR);
+  if (((control & FLASH_CR_PG) == 0) || ((control & FLASH_CR_LOCK) != 0))
+  {
+    SimError("flash store to 0x%08X outside of programming", address);
+  }
+  if ((size != 2) || ((address & 1) != 0))
+  {
+    SimError("flash programmed with %u bytes at 0x%08X", size, address);
+  }
+  const uint16_t data = (uint16_t)value;
+  const uint16_t current = *(const uint16_t *)(uintptr_t)address;
+  SimStall(FLASH_PROGRAM_TIME);
+  /* Only an erased half-word can be programmed, or any zeroed */
+  if ((current != 0xFFFF) && (data != 0))
+  {
+    REG(FLASH->SR) |= FLASH_SR_PGERR;
+    return;
+  }
+  SimProgramFlash(address, data);
+  REG(FLASH->SR) |= FLASH_SR_EOP;
+}
+
+/* GPIO, AFIO and EXTI -------------------------------------------------------*/
+int8_t GetPortIndex(const GPIO_TypeDef *port)
+{
+  for (int8_t i = 0; i < GPIO_PORTS_COUNT; ++i)
+  {
+    if (GPIO_PORTS[i] == port)
+    {
+      return i;
+    }
+  }
+  SimError("no GPIO port at %p", (const void *)port);
+}
+
+uint16_t GetPinLevels(uint8_t port)
+{
+  GPIO_TypeDef *gpio = GPIO_PORTS[port];
+  const uint32_t output = REG(gpio->ODR);
+  uint16_t levels = 0;
+  for (uint8_t pin = 0; pin < 16; ++pin)
+  {
+    const uint32_t configuration = ((pin < 8) ? REG(gpio->CRL) >> (4 * pin) : REG(gpio->CRH) >> (4 * (pin - 8))) & 0xF;
+    const uint16_t bit = 1U << pin;
+    const bool isDriven = (drivenPins[port] & bit) != 0;
+    const bool drivenLevel = (drivenLevels[port] & bit) != 0;
+    bool level;
+    if ((configuration & 3) != 0)
+    {
+      /* Outputs, an alternate function one idles high like the USART TX */
+      if ((configuration & 8) != 0)
+      {
+        level = true;
+      }
+      else if ((configuration & 4) != 0)
+      {
+        level = ((output & bit) != 0) && (!isDriven || drivenLevel);
+      }
+      else
+      {
+        level = (output & bit) != 0;
+      }
+    }
+    else if (isDriven)
+    {
+      level = drivenLevel;
+    }
+    else
+    {
+      /* Pulled inputs follow ODR, floating and analog ones read low */
+      level = ((configuration >> 2) == 2) && ((output & bit) != 0);
+    }
+    levels |= level ? bit : 0;
+  }
+  return levels;
+}
+
+void RaiseExtiLine(uint8_t line)
+{
+  const uint32_t bit = 1U << line;
+  if ((REG(EXTI->IMR) & bit) != 0)
+  {
+    REG(EXTI->PR) |= bit;
+  }
+}
+
+/* Edges go to the EXTI lines the AFIO routes the port to */
+void UpdatePins(uint8_t port)
+{
+  const uint16_t levels = GetPinLevels(port);
+  const uint16_t changed = levels ^ pinLevels[port];
+  if (changed == 0)
+  {
+    return;
+  }
+  pinLevels[port] = levels;
+  for (uint8_t pin = 0; pin < 16; ++pin)
+  {
+    const uint16_t bit = 1U << pin;
+    if (((changed & bit) == 0) || (((REG(AFIO->EXTICR[pin / 4]) >> (4 * (pin % 4))) & 0xF) != port))
+    {
+      continue;
+    }
+    const uint32_t edges = ((levels & bit) != 0) ? REG(EXTI->RTSR) : REG(EXTI->FTSR);
+    if ((edges & bit) != 0)
+    {
+      RaiseExtiLine(pin);
+    }
+  }
+  if (pinsListener != NULL)
+  {
+    pinsListener(GPIO_PORTS[port], changed, levels);
+  }
+}
+
+void WriteGpio(uint32_t address, uint32_t value, uint32_t mask)
+{
+  const uint8_t port = (uint8_t)((address - GPIOA_BASE) / 0x400);
+  GPIO_TypeDef *gpio = GPIO_PORTS[port];
+  const uint32_t offset = address - (uint32_t)(uintptr_t)gpio;
+  if (offset == offsetof(GPIO_TypeDef, BSRR))
+  {
+    value &= mask;
+    REG(gpio->ODR) = (REG(gpio->ODR) & ~(value >> 16)) | (value & 0xFFFF);
+  }
+  else if (offset == offsetof(GPIO_TypeDef, BRR))
+  {
+    REG(gpio->ODR) &= ~(value & mask & 0xFFFF);
+  }
+  else if (offset != offsetof(GPIO_TypeDef, IDR))
+  {
+    *SimShadow(address) = value;
+  }
+  UpdatePins(port);
+}
+
+void WriteExti(uint32_t address, uint32_t value, uint32_t mask)
+{
+  if (address == (uint32_t)&EXTI->PR)
+  {
+    /* Clearing a pending bit clears its software request too */
+    REG(EXTI->PR) &= ~(value & mask);
+    REG(EXTI->SWIER) &= ~(value & mask);
+  }
+  else if (address == (uint32_t)&EXTI->SWIER)
+  {
+    const uint32_t raised = value & ~REG(EXTI->SWIER);
+    REG(EXTI->SWIER) = value;
+    for (uint8_t line = 0; line < 20; ++line)
+    {
+      if ((raised & (1U << line)) != 0)
+      {
+        RaiseExtiLine(line);
+      }
+    }
+  }
+  else
+  {
+    *SimShadow(address) = value;
+  }
+}
+
+/* Timers --------------------------------------------------------------------*/
+struct Timer *FindTimer(uint32_t address)
+{
+  for (uint8_t i = 0; i < TIMERS_COUNT; ++i)
+  {
+    if (IS_IN(address, (uint32_t)(uintptr_t)timers[i].instance, 0x400))
+    {
+      return &timers[i];
+    }
+  }
+  return NULL;
+}
+
+bool IsTimerRunning(const struct Timer *timer)
+{
+  return ((REG(timer->instance->CR1) & TIM_CR1_CEN) != 0) && (timer->frequency != 0);
+}
+
+uint32_t GetTimerAutoReload(const struct Timer *timer)
+{
+  /* Without preload, ARR takes effect at once */
+  return ((REG(timer->instance->CR1) & TIM_CR1_ARPE) != 0) ? timer->autoReload : REG(timer->instance->ARR);
+}
+
+/* Brings the count to the last timer clock edge */
+void SyncTimer(struct Timer *timer)
+{
+  if (IsTimerRunning(timer))
+  {
+    const uint64_t ticks = SimTicksAt(simNow, timer->baseTime, timer->frequency);
+    const uint64_t prescalerTicks = timer->basePrescalerCount + ticks;
+    timer->baseCount = (uint32_t)((timer->baseCount + prescalerTicks / (timer->prescaler + 1)) & 0xFFFF);
+    timer->basePrescalerCount = (uint32_t)(prescalerTicks % (timer->prescaler + 1));
+    timer->baseTime = SimTimeOfTicks(ticks, timer->baseTime, timer->frequency);
+  }
+  else
+  {
+    timer->baseTime = simNow;
+  }
+}
+
+SimTime GetTimerNextUpdate(const struct Timer *timer)
+{
+  if (!IsTimerRunning(timer))
+  {
+    return SIM_NEVER;
+  }
+  /* Past a lowered ARR, the counter goes round through 0xFFFF first */
+  const uint32_t autoReload = GetTimerAutoReload(timer);
+  const uint64_t steps = (timer->baseCount <= autoReload) ? autoReload - timer->baseCount + 1
+                                                          : 0x10000 - timer->baseCount + autoReload + 1;
+  return SimTimeOfTicks(steps * (timer->prescaler + 1) - timer->basePrescalerCount, timer->baseTime, timer->frequency);
+}
+
+void RaiseTimerUpdate(struct Timer *timer, bool isInterruptRaised)
+{
+  TIM_TypeDef *instance = timer->instance;
+  timer->prescaler = REG(instance->PSC) & 0xFFFF;
+  timer->autoReload = REG(instance->ARR) & 0xFFFF;
+  if (isInterruptRaised)
+  {
+    REG(instance->SR) |= TIM_SR_UIF;
+    if ((REG(instance->DIER) & TIM_DIER_UDE) != 0)
+    {
+      RequestDma(timer->dmaChannel);
+    }
+  }
+  if ((instance == TIM3) && ((REG(instance->CR2) & TIM_CR2_MMS) == TIM_MMS_UPDATE))
+  {
+    TriggerAdc(ADC_EXTSEL_TIM3_TRGO);
+  }
+}
+
+void ProcessTimerUpdate(struct Timer *timer)
+{
+  TIM_TypeDef *instance = timer->instance;
+  timer->baseTime = GetTimerNextUpdate(timer);
+  timer->baseCount = 0;
+  timer->basePrescalerCount = 0;
+  if (timerListener != NULL)
+  {
+    timerListener(instance);
+  }
+  if ((REG(instance->CR1) & TIM_CR1_OPM) != 0)
+  {
+    REG(instance->CR1) &= ~TIM_CR1_CEN;
+  }
+  if ((REG(instance->CR1) & TIM_CR1_UDIS) == 0)
+  {
+    RaiseTimerUpdate(timer, true);
+  }
+}
+
+void WriteTimer(struct Timer *timer, uint32_t address, uint32_t value, uint32_t mask)
+{
+  TIM_TypeDef *instance = timer->instance;
+  SyncTimer(timer);
+  if (address == (uint32_t)&instance->SR)
+  {
+    REG(instance->SR) &= value;
+  }
+  else if (address == (uint32_t)&instance->EGR)
+  {
+    if ((value & TIM_EGR_UG) != 0)
+    {
+      /* Reinitializes the counter and the prescaler counter. The update
+         flag and request are only raised without URS */
+      timer->baseCount = 0;
+      timer->basePrescalerCount = 0;
+      if ((REG(instance->CR1) & TIM_CR1_UDIS) == 0)
+      {
+        RaiseTimerUpdate(timer, (REG(instance->CR1) & TIM_CR1_URS) == 0);
+      }
+    }
+  }
+  else if (address == (uint32_t)&instance->CNT)
+  {
+    timer->baseCount = value & 0xFFFF;
+  }
+  else
+  {
+    *SimShadow(address) = value;
+  }
+}
+
+uint32_t ReadTimer(struct Timer *timer, uint32_t address)
+{
+  if (address == (uint32_t)&timer->instance->CNT)
+  {
+    SyncTimer(timer);
+    return timer->baseCount;
+  }
+  return *SimShadow(address);
+}
+
+bool GetTimerIrqLine(const struct Timer *timer, uint32_t flags)
+{
+  return (REG(timer->instance->SR) & REG(timer->instance->DIER) & flags) != 0;
+}
+
+/* DMA -----------------------------------------------------------------------*/
+DMA_Channel_TypeDef *GetDmaChannel(uint8_t channel)
+{
+  return (DMA_Channel_TypeDef *)(uintptr_t)(DMA1_Channel1_BASE + 20U * (channel - 1));
+}
+
+void SetDmaFlags(uint8_t channel, uint32_t flags)
+{
+  REG(DMA1->ISR) |= (flags | DMA_ISR_GIF1) << (4 * (channel - 1));
+}
+
+/* One transfer of the channel, as its request is served */
+void RequestDma(uint8_t channel)
+{
+  DMA_Channel_TypeDef *registers = GetDmaChannel(channel);
+  struct DmaChannel *state = &dmaChannels[channel - 1];
+  const uint32_t control = REG(registers->CCR);
+  if (((control & DMA_CCR_EN) == 0) || (state->count == 0))
+  {
+    return;
+  }
+  const uint8_t peripheralSize = 1U << ((control & DMA_CCR_PSIZE) >> DMA_CCR_PSIZE_Pos);
+  const uint8_t memorySize = 1U << ((control & DMA_CCR_MSIZE) >> DMA_CCR_MSIZE_Pos);
+  if ((control & DMA_CCR_DIR) != 0)
+  {
+    SimBusWrite(state->peripheralAddress, peripheralSize, SimBusRead(state->memoryAddress, memorySize));
+  }
+  else
+  {
+    SimBusWrite(state->memoryAddress, memorySize, SimBusRead(state->peripheralAddress, peripheralSize));
+  }
+  state->peripheralAddress += ((control & DMA_CCR_PINC) != 0) ? peripheralSize : 0;
+  state->memoryAddress += ((control & DMA_CCR_MINC) != 0) ? memorySize : 0;
+  --state->count;
+  const uint32_t total = REG(registers->CNDTR) & 0xFFFF;
+  if (state->count == total / 2)
+  {
+    SetDmaFlags(channel, DMA_ISR_HTIF1);
+  }
+  if (state->count == 0)
+  {
+    SetDmaFlags(channel, DMA_ISR_TCIF1);
+    if ((control & DMA_CCR_CIRC) != 0)
+    {
+      state->count = total;
+      state->peripheralAddress = REG(registers->CPAR);
+      state->memoryAddress = REG(registers->CMAR);
+    }
+  }
+}
+
+/* Requests held for as long as their flag is set */
+void ServiceDmaRequests(void)
+{
+  if (isServicingDma)
+  {
+    return;
+  }
+  isServicingDma = true;
+  for (bool isServed = true; isServed; )
+  {
+    isServed = false;
+    const uint32_t uartStatus = REG(USART1->SR), uartControl = REG(USART1->CR3);
+    if (((uartStatus & USART_SR_TXE) != 0) && ((uartControl & USART_CR3_DMAT) != 0) && (dmaChannels[3].count != 0)
+        && ((REG(DMA1_Channel4->CCR) & DMA_CCR_EN) != 0))
+    {
+      RequestDma(4);
+      isServed = true;
+    }
+    if (((uartStatus & USART_SR_RXNE) != 0) && ((uartControl & USART_CR3_DMAR) != 0) && (dmaChannels[4].count != 0)
+        && ((REG(DMA1_Channel5->CCR) & DMA_CCR_EN) != 0))
+    {
+      RequestDma(5);
+      isServed = true;
+    }
+    if (((REG(ADC1->SR) & ADC_SR_EOC) != 0) && ((REG(ADC1->CR2) & ADC_CR2_DMA) != 0) && (dmaChannels[0].count != 0)
+        && ((REG(DMA1_Channel1->CCR) & DMA_CCR_EN) != 0))
+    {
+      RequestDma(1);
+      isServed = true;
+    }
+  }
+  isServicingDma = false;
+}
+
+void WriteDma(uint32_t address, uint32_t value, uint32_t mask)
+{
+  if (address == (uint32_t)&DMA1->IFCR)
+  {
+    uint32_t cleared = value & mask;
+    /* CGIFx clears all the flags of its channel */
+    for (uint8_t channel = 0; channel < DMA_CHANNELS_COUNT; ++channel)
+    {
+      if ((cleared & (DMA_IFCR_CGIF1 << (4 * channel))) != 0)
+      {
+        cleared |= 0xFU << (4 * channel);
+      }
+    }
+    REG(DMA1->ISR) &= ~cleared;
+    return;
+  }
+  if (address == (uint32_t)&DMA1->ISR)
+  {
+    return;
+  }
+  const uint8_t channel = (uint8_t)((address - DMA1_Channel1_BASE) / 20 + 1);
+  DMA_Channel_TypeDef *registers = GetDmaChannel(channel);
+  const uint32_t previous = *SimShadow(address);
+  if ((address != (uint32_t)&registers->CCR) && ((REG(registers->CCR) & DMA_CCR_EN) != 0))
+  {
+    /* Read-only while the channel is enabled */
+    return;
+  }
+  *SimShadow(address) = value;
+  if ((address == (uint32_t)&registers->CCR) && ((value & ~previous & DMA_CCR_EN) != 0))
+  {
+    struct DmaChannel *state = &dmaChannels[channel - 1];
+    state->count = REG(registers->CNDTR) & 0xFFFF;
+    state->peripheralAddress = REG(registers->CPAR);
+    state->memoryAddress = REG(registers->CMAR);
+  }
+}
+
+uint32_t ReadDma(uint32_t address)
+{
+  if (IS_IN(address, DMA1_Channel1_BASE, 20 * DMA_CHANNELS_COUNT) && ((address - DMA1_Channel1_BASE) % 20 == 4))
+  {
+    const uint8_t channel = (uint8_t)((address - DMA1_Channel1_BASE) / 20 + 1);
+    if ((REG(GetDmaChannel(channel)->CCR) & DMA_CCR_EN) != 0)
+    {
+      return dmaChannels[channel - 1].count;
+    }
+  }
+  if (address == (uint32_t)&DMA1->IFCR)
+  {
+    return 0;
+  }
+  return *SimShadow(address);
+}
+
+bool GetDmaIrqLine(uint8_t channel)
+{
+  const uint32_t flags = (REG(DMA1->ISR) >> (4 * (channel - 1))) & 0xF;
+  const uint32_t control = REG(GetDmaChannel(channel)->CCR);
+  return (((flags & DMA_ISR_TCIF1) != 0) && ((control & DMA_CCR_TCIE) != 0))
+      || (((flags & DMA_ISR_HTIF1) != 0) && ((control & DMA_CCR_HTIE) != 0))
+      || (((flags & DMA_ISR_TEIF1) != 0) && ((control & DMA_CCR_TEIE) != 0));
+}
+
+/* USART1 --------------------------------------------------------------------*/
+/* In half bits, start and data bits plus the stop bits of CR2 */
+uint32_t GetUartFrameHalfBits(void)
+{
+  static const uint8_t STOP_HALF_BITS[4] = { 2, 1, 4, 3 };
+  const uint32_t dataBits = ((REG(USART1->CR1) & USART_CR1_M) != 0) ? 9 : 8;
+  return 2 * (1 + dataBits) + STOP_HALF_BITS[(REG(USART1->CR2) & USART_CR2_STOP) >> USART_CR2_STOP_Pos];
+}
+
+bool IsUartEnabled(uint32_t direction)
+{
+  const uint32_t control = REG(USART1->CR1);
+  return ((control & USART_CR1_UE) != 0) && ((control & direction) != 0) && (GetPclkFrequency(true) != 0)
+      && ((REG(USART1->BRR) & 0xFFFF) != 0);
+}
+
+uint32_t GetUartBaudRate(void)
+{
+  return GetPclkFrequency(true) / (REG(USART1->BRR) & 0xFFFF);
+}
+
+void StartUartShift(uint8_t data)
+{
+  isUartShifting = true;
+  uartShiftData = data;
+  /* A bit lasts BRR cycles of PCLK2 */
+  const uint64_t halfBitTicks = (uint64_t)(REG(USART1->BRR) & 0xFFFF) * GetUartFrameHalfBits();
+  uartShiftEnd = SimTimeOfTicks(halfBitTicks, simNow, 2ULL * GetPclkFrequency(true));
+}
+
+void ProcessUartTransmit(void)
+{
+  isUartShifting = false;
+  const uint8_t data = uartShiftData;
+  if (isUartTdrFull)
+  {
+    isUartTdrFull = false;
+    StartUartShift(uartTdr);
+    REG(USART1->SR) |= USART_SR_TXE;
+  }
+  else
+  {
+    REG(USART1->SR) |= USART_SR_TC;
+  }
+  if (uartListener != NULL)
+  {
+    uartListener(data);
+  }
+}
+
+void WriteUartData(uint8_t data)
+{
+  if (isUartTcClearArmed)
+  {
+    REG(USART1->SR) &= ~USART_SR_TC;
+    isUartTcClearArmed = false;
+  }
+  if (!IsUartEnabled(USART_CR1_TE))
+  {
+    return;
+  }
+  if (!isUartShifting)
+  {
+    StartUartShift(data);
+  }
+  else
+  {
+    uartTdr = data;
+    isUartTdrFull = true;
+    REG(USART1->SR) &= ~USART_SR_TXE;
+  }
+}
+
+uint32_t ReadUart(uint32_t address, bool sideEffects)
+{
+  const uint32_t status = REG(USART1->SR);
+  if (address == (uint32_t)&USART1->SR)
+  {
+    if (sideEffects)
+    {
+      isUartTcClearArmed = (status & USART_SR_TC) != 0;
+      uartErrorsReadMask = status & (USART_SR_IDLE | USART_SR_ORE | USART_SR_NE | USART_SR_FE | USART_SR_PE);
+    }
+    return status;
+  }
+  if ((address == (uint32_t)&USART1->DR) && sideEffects)
+  {
+    /* Reading SR then DR clears the error and idle flags SR showed */
+    REG(USART1->SR) &= ~(USART_SR_RXNE | uartErrorsReadMask);
+    uartErrorsReadMask = 0;
+  }
+  return *SimShadow(address);
+}
+
+void WriteUart(uint32_t address, uint32_t value, uint32_t mask)
+{
+  if (address == (uint32_t)&USART1->SR)
+  {
+    /* Only TC and RXNE can be cleared by writing 0 */
+    REG(USART1->SR) &= value | ~(USART_SR_TC | USART_SR_RXNE);
+  }
+  else if (address == (uint32_t)&USART1->DR)
+  {
+    WriteUartData((uint8_t)value);
+  }
+  else
+  {
+    *SimShadow(address) = value;
+  }
+}
+
+/* The time of the next edge or end of the byte at the head of the queue */
+SimTime GetUartRxNextEvent(void)
+{
+  if (uartQueueLength == 0)
+  {
+    return SIM_NEVER;
+  }
+  const struct UartByte *byte = &uartQueue[uartQueueHead];
+  switch (uartRxPhase)
+  {
+  case UART_RX_START_BIT:
+    return byte->start;
+  case UART_RX_DATA_BITS:
+    return SimTimeOfTicks(1, byte->start, byte->baudRate);
+  default:
+    return SimTimeOfTicks(10, byte->start, byte->baudRate);
+  }
+}
+
+void ReceiveUartByte(const struct UartByte *byte)
+{
+  if (!isUartRxClocked || !IsUartEnabled(USART_CR1_RE))
+  {
+    ++simStats.uartLostCount;
+    return;
+  }
+  const uint32_t baudRate = GetUartBaudRate();
+  const uint32_t gap = (baudRate > byte->baudRate) ? baudRate - byte->baudRate : byte->baudRate - baudRate;
+  if ((REG(USART1->SR) & USART_SR_RXNE) != 0)
+  {
+    REG(USART1->SR) |= USART_SR_ORE;
+    return;
+  }
+  REG(USART1->DR) = byte->data;
+  REG(USART1->SR) |= USART_SR_RXNE | ((gap * 100 > (uint64_t)byte->baudRate * UART_BAUD_TOLERANCE_PERCENT) ? USART_SR_FE : 0);
+  uartIdleTime = SimTimeOfTicks(GetUartFrameHalfBits(), simNow, 2ULL * baudRate);
+}
+
+void ProcessUartReceive(void)
+{
+  const struct UartByte *byte = &uartQueue[uartQueueHead];
+  GPIO_TypeDef *const port = GPIOA;
+  switch (uartRxPhase)
+  {
+  case UART_RX_START_BIT:
+    /* The receiver only catches a byte it was clocked for from the start bit */
+    isUartRxClocked = IsUartEnabled(USART_CR1_RE);
+    uartIdleTime = SIM_NEVER;
+    SimSetPins(port, GPIO_PIN_10, false);
+    uartRxPhase = UART_RX_DATA_BITS;
+    break;
+  case UART_RX_DATA_BITS:
+    SimSetPins(port, GPIO_PIN_10, true);
+    uartRxPhase = UART_RX_STOP_BIT;
+    break;
+  default:
+    ReceiveUartByte(byte);
+    uartQueueHead = (uartQueueHead + 1) % UART_QUEUE_SIZE;
+    --uartQueueLength;
+    uartRxPhase = UART_RX_START_BIT;
+    break;
+  }
+}
+
+bool GetUartIrqLine(void)
+{
+  const uint32_t status = REG(USART1->SR), control = REG(USART1->CR1);
+  const uint32_t errors = USART_SR_ORE | USART_SR_NE | USART_SR_FE;
+  return ((status & control & (USART_SR_TXE | USART_SR_TC | USART_SR_RXNE | USART_SR_IDLE)) != 0)
+      || (((status & USART_SR_PE) != 0) && ((control & USART_CR1_PEIE) != 0))
+      || (((status & USART_SR_ORE) != 0) && ((control & USART_CR1_RXNEIE) != 0))
+      || (((status & errors) != 0) && ((REG(USART1->CR3) & (USART_CR3_EIE | USART_CR3_DMAR)) == (USART_CR3_EIE | USART_CR3_DMAR)));
+}
+
+/* ADC1 ----------------------------------------------------------------------*/
+uint8_t GetAdcSequenceLength(void)
+{
+  if ((REG(ADC1->CR1) & ADC_CR1_SCAN) == 0)
+  {
+    return 1;
+  }
+  return (uint8_t)(((REG(ADC1->SQR1) & ADC_SQR1_L) >> ADC_SQR1_L_Pos) + 1);
+}
+
+uint8_t GetAdcChannel(uint8_t rank)
+{
+  if (rank < 6)
+  {
+    return (REG(ADC1->SQR3) >> (5 * rank)) & 0x1F;
+  }
+  if (rank < 12)
+  {
+    return (REG(ADC1->SQR2) >> (5 * (rank - 6))) & 0x1F;
+  }
+  return (REG(ADC1->SQR1) >> (5 * (rank - 12))) & 0x1F;
+}
+
+void StartAdcConversion(void)
+{
+  const uint8_t channel = GetAdcChannel(adcRank);
+  const uint32_t sampleTime = (channel < 10) ? REG(ADC1->SMPR2) >> (3 * channel) : REG(ADC1->SMPR1) >> (3 * (channel - 10));
+  /* Sampling plus 12.5 cycles of conversion */
+  const uint32_t halfCycles = ADC_SAMPLE_HALF_CYCLES[sampleTime & 7] + 25;
+  isAdcConverting = true;
+  adcConversionEnd = SimTimeOfTicks(halfCycles, simNow, 2ULL * GetAdcFrequency());
+  REG(ADC1->SR) |= ADC_SR_STRT;
+}
+
+void StartAdcSequence(void)
+{
+  if (!isAdcConverting && ((REG(ADC1->CR2) & ADC_CR2_ADON) != 0) && (GetAdcFrequency() != 0))
+  {
+    adcRank = 0;
+    StartAdcConversion();
+  }
+}
+
+void TriggerAdc(uint32_t source)
+{
+  const uint32_t control = REG(ADC1->CR2);
+  if (((control & ADC_CR2_EXTTRIG) != 0) && ((control & ADC_CR2_EXTSEL) == source))
+  {
+    StartAdcSequence();
+  }
+}
+
+void ProcessAdcConversion(void)
+{
+  const uint8_t channel = GetAdcChannel(adcRank);
+  uint16_t value;
+  if (adcSource != NULL)
+  {
+    value = adcSource(channel);
+  }
+  else
+  {
+    value = (channel == ADC_VREFINT_CHANNEL) ? ADC_VREFINT_READING : ADC_TEMPERATURE_READING;
+  }
+  value &= 0xFFF;
+  REG(ADC1->DR) = ((REG(ADC1->CR2) & ADC_CR2_ALIGN) != 0) ? (uint32_t)value << 4 : value;
+  REG(ADC1->SR) |= ADC_SR_EOC;
+  isAdcConverting = false;
+  if (++adcRank < GetAdcSequenceLength())
+  {
+    StartAdcConversion();
+  }
+  else if ((REG(ADC1->CR2) & ADC_CR2_CONT) != 0)
+  {
+    StartAdcSequence();
+  }
+}
+
+void WriteAdc(uint32_t address, uint32_t value, uint32_t mask)
+{
+  if (address == (uint32_t)&ADC1->SR)
+  {
+    REG(ADC1->SR) &= value;
+    return;
+  }
+  if (address == (uint32_t)&ADC1->DR)
+  {
+    return;
+  }
+  if (address != (uint32_t)&ADC1->CR2)
+  {
+    *SimShadow(address) = value;
+    return;
+  }
+  const uint32_t previous = REG(ADC1->CR2);
+  /* ADON written to 1 again, with no other change, starts a conversion */
+  const bool isStarted = ((previous & value & ADC_CR2_ADON) != 0) && (previous == value);
+  REG(ADC1->CR2) = value & ~(ADC_CR2_CAL | ADC_CR2_RSTCAL | ADC_CR2_SWSTART);
+  if ((value & ADC_CR2_ADON) == 0)
+  {
+    isAdcConverting = false;
+  }
+  else if (isStarted)
+  {
+    StartAdcSequence();
+  }
+  else if ((value & ADC_CR2_SWSTART) != 0)
+  {
+    TriggerAdc(ADC_EXTSEL_SWSTART);
+  }
+}
+
+uint32_t ReadAdc(uint32_t address, bool sideEffects)
+{
+  if ((address == (uint32_t)&ADC1->DR) && sideEffects)
+  {
+    REG(ADC1->SR) &= ~ADC_SR_EOC;
+  }
+  return *SimShadow(address);
+}
+
+/* RTC -----------------------------------------------------------------------*/
+uint32_t GetRtcCount(void)
+{
+  return rtcBaseCount + (uint32_t)SimTicksAt(simNow, rtcBaseTime, rtcFrequency);
+}
+
+/* The RTC counts on the LSI once enabled, at LSI / (PRL + 1) */
+void RebaseRtc(void)
+{
+  const uint32_t bdcr = REG(RCC->BDCR);
+  const bool isRunning = ((bdcr & RCC_BDCR_RTCEN) != 0) && ((bdcr & RCC_BDCR_RTCSEL) == RCC_BDCR_RTCSEL_1)
+                      && ((REG(RCC->CSR) & RCC_CSR_LSION) != 0);
+  const uint32_t prescaler = ((REG(RTC->PRLH) & 0xF) << 16) | (REG(RTC->PRLL) & 0xFFFF);
+  const uint64_t ticks = SimTicksAt(simNow, rtcBaseTime, rtcFrequency);
+  rtcBaseCount += (uint32_t)ticks;
+  rtcBaseTime = (rtcFrequency != 0) ? SimTimeOfTicks(ticks, rtcBaseTime, rtcFrequency) : simNow;
+  const uint64_t frequency = isRunning ? lsiFrequency / (prescaler + 1) : 0;
+  if (frequency != rtcFrequency)
+  {
+    rtcBaseTime = simNow;
+    rtcFrequency = frequency;
+  }
+}
+
+uint32_t ReadRtc(uint32_t address)
+{
+  if (address == (uint32_t)&RTC->CRL)
+  {
+    const bool isSynchronized = simNow >= rtcSynchronizedTime;
+    return (REG(RTC->CRL) & ~RTC_CRL_RSF) | RTC_CRL_RTOFF | (isSynchronized ? RTC_CRL_RSF : 0);
+  }
+  if (address == (uint32_t)&RTC->CNTH)
+  {
+    return GetRtcCount() >> 16;
+  }
+  if (address == (uint32_t)&RTC->CNTL)
+  {
+    return GetRtcCount() & 0xFFFF;
+  }
+  return *SimShadow(address);
+}
+
+void WriteRtc(uint32_t address, uint32_t value)
+{
+  const bool isConfiguring = (REG(RTC->CRL) & RTC_CRL_CNF) != 0;
+  if (address == (uint32_t)&RTC->CRL)
+  {
+    if ((value & RTC_CRL_RSF) == 0)
+    {
+      /* Set again on the next synchronization of the APB1 interface */
+      rtcSynchronizedTime = (rtcFrequency != 0) ? SimTimeOfTicks(RTC_SYNCHRONIZATION_CYCLES, simNow, lsiFrequency) : SIM_NEVER;
+    }
+    REG(RTC->CRL) = value & (RTC_CRL_CNF | RTC_CRL_SECF | RTC_CRL_ALRF | RTC_CRL_OWF);
+  }
+  else if (!isConfiguring)
+  {
+    if (address == (uint32_t)&RTC->CRH)
+    {
+      REG(RTC->CRH) = value;
+    }
+  }
+  else if ((address == (uint32_t)&RTC->CNTH) || (address == (uint32_t)&RTC->CNTL))
+  {
+    RebaseRtc();
+    const uint32_t count = GetRtcCount();
+    rtcBaseCount = (address == (uint32_t)&RTC->CNTH) ? ((value & 0xFFFF) << 16) | (count & 0xFFFF)
+                                                     : (count & 0xFFFF0000) | (value & 0xFFFF);
+    rtcBaseTime = simNow;
+  }
+  else
+  {
+    *SimShadow(address) = value;
+    RebaseRtc();
+  }
+}
+
+/* Bus interface -------------------------------------------------------------*/
+void ResetDevices(void)
+{
+  for (uint32_t address = PERIPH_BASE; address < AHBPERIPH_BASE + 0x10000; address += 4)
+  {
+    *SimShadow(address) = 0;
+  }
+  REG(RCC->CR) = RCC_CR_HSION | RCC_CR_HSIRDY | (16U << RCC_CR_HSITRIM_Pos);
+  REG(RCC->CSR) = RCC_CSR_PINRSTF | RCC_CSR_PORRSTF;
+  REG(FLASH->CR) = FLASH_CR_LOCK;
+  REG(FLASH->OBR) = 0x03FFFFFC;
+  REG(FLASH->WRPR) = 0xFFFFFFFF;
+  for (uint8_t port = 0; port < GPIO_PORTS_COUNT; ++port)
+  {
+    REG(GPIO_PORTS[port]->CRL) = 0x44444444;
+    REG(GPIO_PORTS[port]->CRH) = 0x44444444;
+    drivenPins[port] = 0;
+    drivenLevels[port] = 0;
+    pinLevels[port] = 0;
+  }
+  for (uint8_t i = 0; i < TIMERS_COUNT; ++i)
+  {
+    REG(timers[i].instance->ARR) = 0xFFFF;
+    timers[i].frequency = GetTimerFrequency(timers[i].isOnApb2);
+    timers[i].baseTime = 0;
+    timers[i].baseCount = 0;
+    timers[i].basePrescalerCount = 0;
+    timers[i].prescaler = 0;
+    timers[i].autoReload = 0xFFFF;
+  }
+  memset(dmaChannels, 0, sizeof(dmaChannels));
+  REG(USART1->SR) = USART_SR_TXE | USART_SR_TC;
+  isUartShifting = false;
+  isUartTdrFull = false;
+  isUartTcClearArmed = false;
+  uartQueueHead = 0;
+  uartQueueLength = 0;
+  uartQueueEnd = 0;
+  uartRxPhase = UART_RX_START_BIT;
+  uartIdleTime = SIM_NEVER;
+  uartErrorsReadMask = 0;
+  isAdcConverting = false;
+  REG(RTC->CRL) = RTC_CRL_RTOFF;
+  REG(RTC->PRLL) = 0x8000;
+  rtcFrequency = 0;
+  rtcBaseTime = 0;
+  rtcBaseCount = 0;
+  rtcSynchronizedTime = SIM_NEVER;
+  isFlashKeyAccepted = false;
+}
+
+uint32_t DeviceRead(uint32_t address, bool sideEffects)
+{
+  struct Timer *timer = FindTimer(address);
+  uint32_t value;
+  if (timer != NULL)
+  {
+    value = ReadTimer(timer, address);
+  }
+  else if (IS_IN(address, GPIOA_BASE, 0x400 * GPIO_PORTS_COUNT) && ((address & 0x3FF) == offsetof(GPIO_TypeDef, IDR)))
+  {
+    value = GetPinLevels((uint8_t)((address - GPIOA_BASE) / 0x400));
+  }
+  else if (IS_IN(address, GPIOA_BASE, 0x400 * GPIO_PORTS_COUNT)
+           && (((address & 0x3FF) == offsetof(GPIO_TypeDef, BSRR)) || ((address & 0x3FF) == offsetof(GPIO_TypeDef, BRR))))
+  {
+    value = 0;
+  }
+  else if (IS_IN(address, DMA1_BASE, 0x400))
+  {
+    value = ReadDma(address);
+  }
+  else if (IS_IN(address, USART1_BASE, 0x400))
+  {
+    value = ReadUart(address, sideEffects);
+  }
+  else if (IS_IN(address, ADC1_BASE, 0x400))
+  {
+    value = ReadAdc(address, sideEffects);
+  }
+  else if (IS_IN(address, RTC_BASE, 0x400))
+  {
+    value = ReadRtc(address);
+  }
+  else
+  {
+    value = *SimShadow(address);
+  }
+  if (sideEffects)
+  {
+    ServiceDmaRequests();
+  }
+  return value;
+}
+
+void DeviceWrite(uint32_t address, uint32_t value, uint32_t mask)
+{
+  struct Timer *timer = FindTimer(address);
+  if (timer != NULL)
+  {
+    WriteTimer(timer, address, value, mask);
+  }
+  else if (IS_IN(address, RCC_BASE, 0x400))
+  {
+    WriteRcc(address, value);
+  }
+  else if (IS_IN(address, FLASH_R_BASE, 0x400))
+  {
+    WriteFlashController(address, value, mask);
+  }
+  else if (IS_IN(address, GPIOA_BASE, 0x400 * GPIO_PORTS_COUNT))
+  {
+    WriteGpio(address, value, mask);
+  }
+  else if (IS_IN(address, EXTI_BASE, 0x400))
+  {
+    WriteExti(address, value, mask);
+  }
+  else if (IS_IN(address, DMA1_BASE, 0x400))
+  {
+    WriteDma(address, value, mask);
+  }
+  else if (IS_IN(address, USART1_BASE, 0x400))
+  {
+    WriteUart(address, value, mask);
+  }
+  else if (IS_IN(address, ADC1_BASE, 0x400))
+  {
+    WriteAdc(address, value, mask);
+  }
+  else if (IS_IN(address, RTC_BASE, 0x400))
+  {
+    WriteRtc(address, value);
+  }
+  else
+  {
+    *SimShadow(address) = value;
+  }
+  ServiceDmaRequests();
+}
+
+bool GetIrqLine(uint8_t irq)
+{
+  const uint32_t pending = REG(EXTI->PR) & REG(EXTI->IMR);
+  switch (irq)
+  {
+  case EXTI0_IRQn:
+  case EXTI1_IRQn:
+  case EXTI2_IRQn:
+  case EXTI3_IRQn:
+  case EXTI4_IRQn:
+    return (pending & (1U << (irq - EXTI0_IRQn))) != 0;
+  case EXTI9_5_IRQn:
+    return (pending & 0x03E0) != 0;
+  case EXTI15_10_IRQn:
+    return (pending & 0xFC00) != 0;
+  case DMA1_Channel1_IRQn:
+  case DMA1_Channel2_IRQn:
+  case DMA1_Channel3_IRQn:
+  case DMA1_Channel4_IRQn:
+  case DMA1_Channel5_IRQn:
+  case DMA1_Channel6_IRQn:
+  case DMA1_Channel7_IRQn:
+    return GetDmaIrqLine((uint8_t)(irq - DMA1_Channel1_IRQn + 1));
+  case ADC1_2_IRQn:
+    return ((REG(ADC1->SR) & ADC_SR_EOC) != 0) && ((REG(ADC1->CR1) & ADC_CR1_EOCIE) != 0);
+  case TIM1_UP_IRQn:
+    return GetTimerIrqLine(&timers[0], TIM_SR_UIF);
+  case TIM1_CC_IRQn:
+    return GetTimerIrqLine(&timers[0], TIM_SR_CC1IF | TIM_SR_CC2IF | TIM_SR_CC3IF | TIM_SR_CC4IF);
+  case TIM2_IRQn:
+    return GetTimerIrqLine(&timers[1], 0xFF);
+  case TIM3_IRQn:
+    return GetTimerIrqLine(&timers[2], 0xFF);
+  case USART1_IRQn:
+    return GetUartIrqLine();
+  case RTC_IRQn:
+    return (REG(RTC->CRL) & REG(RTC->CRH) & (RTC_CRL_SECF | RTC_CRL_ALRF | RTC_CRL_OWF)) != 0;
+  default:
+    return false;
+  }
+}
+
+SimTime GetDevicesNextEvent(void)
+{
+  SimTime next = GetUartRxNextEvent();
+  for (uint8_t i = 0; i < TIMERS_COUNT; ++i)
+  {
+    const SimTime update = GetTimerNextUpdate(&timers[i]);
+    next = (update < next) ? update : next;
+  }
+  if (isUartShifting && (uartShiftEnd < next))
+  {
+    next = uartShiftEnd;
+  }
+  if (uartIdleTime < next)
+  {
+    next = uartIdleTime;
+  }
+  if (isAdcConverting && (adcConversionEnd < next))
+  {
+    next = adcConversionEnd;
+  }
+  return next;
+}
+
+/* Serves one of the events due now */
+void ProcessDeviceEvents(void)
+{
+  for (uint8_t i = 0; i < TIMERS_COUNT; ++i)
+  {
+    if (GetTimerNextUpdate(&timers[i]) <= simNow)
+    {
+      ProcessTimerUpdate(&timers[i]);
+      ServiceDmaRequests();
+      return;
+    }
+  }
+  if (isUartShifting && (uartShiftEnd <= simNow))
+  {
+    ProcessUartTransmit();
+  }
+  else if (GetUartRxNextEvent() <= simNow)
+  {
+    ProcessUartReceive();
+  }
+  else if (uartIdleTime <= simNow)
+  {
+    uartIdleTime = SIM_NEVER;
+    REG(USART1->SR) |= USART_SR_IDLE;
+  }
+  else if (isAdcConverting && (adcConversionEnd <= simNow))
+  {
+    ProcessAdcConversion();
+  }
+  ServiceDmaRequests();
+}
+
+/* Counters move on at their old rate up to now, then at the new one */
+void UpdateDeviceClocks(void)
+{
+  for (uint8_t i = 0; i < TIMERS_COUNT; ++i)
+  {
+    SyncTimer(&timers[i]);
+    timers[i].frequency = GetTimerFrequency(timers[i].isOnApb2);
+  }
+  RebaseRtc();
+}
+
+/* Script interface ----------------------------------------------------------*/
+void SimSetPins(GPIO_TypeDef *port, uint16_t pins, bool level)
+{
+  const int8_t index = GetPortIndex(port);
+  drivenPins[index] |= pins;
+  drivenLevels[index] = level ? (drivenLevels[index] | pins) : (drivenLevels[index] & ~pins);
+  UpdatePins((uint8_t)index);
+  SimUpdateInterrupts();
+}
+
+void SimReleasePins(GPIO_TypeDef *port, uint16_t pins)
+{
+  const int8_t index = GetPortIndex(port);
+  drivenPins[index] &= ~pins;
+  UpdatePins((uint8_t)index);
+  SimUpdateInterrupts();
+}
+
+uint16_t SimGetPins(GPIO_TypeDef *port)
+{
+  return GetPinLevels((uint8_t)GetPortIndex(port));
+}
+
+void SimSetPinsListener(SimPinsListener listener)
+{
+  pinsListener = listener;
+}
+
+void SimSendUart(const uint8_t *data, uint16_t length, uint32_t baudRate)
+{
+  if ((drivenPins[0] & GPIO_PIN_10) == 0)
+  {
+    /* The line idles high */
+    SimSetPins(GPIOA, GPIO_PIN_10, true);
+  }
+  if (uartQueueEnd < simNow)
+  {
+    uartQueueEnd = simNow;
+  }
+  for (uint16_t i = 0; i < length; ++i)
+  {
+    if (uartQueueLength == UART_QUEUE_SIZE)
+    {
+      SimError("more than %u serial bytes queued", UART_QUEUE_SIZE);
+    }
+    struct UartByte *byte = &uartQueue[(uartQueueHead + uartQueueLength) % UART_QUEUE_SIZE];
+    byte->start = uartQueueEnd;
+    byte->baudRate = baudRate;
+    byte->data = data[i];
+    ++uartQueueLength;
+    uartQueueEnd = SimTimeOfTicks(10, byte->start, baudRate);
+  }
+}
+
+void SimSetUartListener(SimUartListener listener)
+{
+  uartListener = listener;
+}
+
+void SimSetTimerListener(SimTimerListener listener)
+{
+  timerListener = listener;
+}
+
+void SimSetAdcSource(SimAdcSource source)
+{
+  adcSource = source;
+}
+
+void SimSetLsiFrequency(uint32_t frequency)
+{
+  lsiFrequency = frequency;
+}
@@ -0,0 +1,63 @@
+/**
+  ******************************************************************************
+  * @file           : sim_devices.h
+  * @brief          : Interface between the simulator core and the peripheral
+  *                   models.
+  *
+  *                   sim.c owns the time, the bus, the Cortex-M3 core
+  *                   peripherals and the exceptions. sim_devices.c models the
+  *                   STM32F1 peripherals on its APB and AHB buses. A model
+  *                   keeps its registers in the shadow words of the bus and
+  *                   its hidden state in its own variables, and exposes the
+  *                   time of its next event for the core to advance to.
+  ******************************************************************************
+  */
+
+#ifndef __SIM_DEVICES_H
+#define __SIM_DEVICES_H
+
+#include "sim.h"
+
+#define PS_PER_S 1000000000000ULL
+#define HSI_FREQUENCY 8000000U
+
+/* Core ------------------------------------------------------------------------*/
+extern SimTime simNow;
+extern struct SimStats simStats;
+
+/* Register words of the peripheral and core peripheral ranges */
+uint32_t *SimShadow(uint32_t address);
+/* Bus accesses of the DMA, which may target RAM or a register */
+uint32_t SimBusRead(uint32_t address, uint8_t size);
+void SimBusWrite(uint32_t address, uint8_t size, uint32_t value);
+/* Stalls the core, as flash programming does, while the peripherals run */
+void SimStall(SimTime duration);
+bool SimIsStopped(void);
+/* Peripheral state changed, so must the pending interrupts */
+void SimUpdateInterrupts(void);
+/* The clock tree changed, the counters move on at the new rates */
+void SimClocksChanged(void);
+__attribute__((noreturn, format(printf, 1, 2))) void SimError(const char *format, ...);
+/* Programs and erases the flash memory, which the firmware can only read */
+void SimProgramFlash(uint32_t address, uint16_t data);
+void SimEraseFlashRange(uint32_t start, uint32_t size);
+uint64_t SimTicksAt(SimTime time, SimTime baseTime, uint64_t frequency);
+SimTime SimTimeOfTicks(uint64_t ticks, SimTime baseTime, uint64_t frequency);
+SimTime SimLastTickTime(SimTime baseTime, uint64_t frequency, uint64_t newFrequency);
+
+/* Peripherals -----------------------------------------------------------------*/
+void ResetDevices(void);
+uint32_t DeviceRead(uint32_t address, bool sideEffects);
+void DeviceWrite(uint32_t address, uint32_t value, uint32_t mask);
+void FlashWrite(uint32_t address, uint8_t size, uint32_t value);
+/* Level of the request line of an interrupt of the NVIC */
+bool GetIrqLine(uint8_t irq);
+SimTime GetDevicesNextEvent(void);
+void ProcessDeviceEvents(void);
+/* The clock tree or the STOP state changed */
+void UpdateDeviceClocks(void);
+/* STOP exit falls back to HSI with the PLL off */
+void WakeUpClocks(void);
+uint32_t GetHclkFrequency(void);
+
+#endif /* __SIM_DEVICES_H */
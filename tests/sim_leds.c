@@ -0,0 +1,205 @@
+/**
+  ******************************************************************************
+  * @file           : sim_leds.c
+  * @brief          : The leds firmware on the simulator, driven from its
+  *                   serial port and read back from its LED bus, its replies
+  *                   and its acquisition of the internal ADC channels.
+  ******************************************************************************
+  */
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sim.h"
+#include "test.h"
+#include "acquisition.h"
+#include "clock.h"
+
+#define BAUD_RATE 115200
+/* Start, 8 data and stop bits */
+#define UART_FRAME_TIME (SIM_S(10) / BAUD_RATE)
+#define LEDS_PINS 0xFF
+/* Pulled up on the board, pressed low */
+#define BUTTON_PIN GPIO_PIN_0
+#define CONVERGE_FIRST_LEDS 0x81
+/* The IDLE line interrupt comes one frame after the command */
+#define REPLY_LATENCY_MAX (UART_FRAME_TIME + SIM_US(100))
+/* The reply leaves the DMA back to back, up to a CPU turn between the
+   name and the line end. BRR rounds the baud rate, so frames can be a bit
+   shorter */
+#define REPLY_GAP_MAX SIM_US(20)
+#define REPLY_MAX_LENGTH 32
+#define COMMAND_TIME SIM_MS(100)
+#define STOP_COMMAND_TIME SIM_MS(400)
+/* 3.3 V supply, the sensor at 1.43 V reads 25 C */
+#define SUPPLY_VOLTAGE 3300
+#define ROOM_TEMPERATURE 250
+
+#define CLOCK_COMMAND_TIME SIM_MS(200)
+#define CLOCK_COMMAND_PERIOD SIM_MS(100)
+#define OVERFLOWS_MAX_COUNT 1000
+/* TIM3 overflows every millisecond to trigger the ADC. It runs on the old
+   prescaler while SYSCLK is switched, a reset count would cost up to a
+   whole period */
+#define ACQUISITION_PERIOD SIM_MS(1)
+#define SWITCH_DEVIATION_MAX SIM_US(50)
+/* BRR rounds the baud rate divider in every profile */
+#define BAUD_RATE_TOLERANCE_PERCENT 2
+
+extern int16_t chipTemperature;
+extern uint16_t supplyVoltage;
+extern const uint32_t ACQUISITION_TIMER_TICK_FREQUENCY;
+
+char reply[REPLY_MAX_LENGTH + 1];
+uint8_t replyLength;
+SimTime replyTimes[REPLY_MAX_LENGTH];
+SimTime ledsOnTime;
+uint32_t stopCountBeforeStop;
+SimTime overflowTimes[OVERFLOWS_MAX_COUNT];
+uint16_t overflowsCount;
+uint8_t clockSwitchesCount;
+
+void HandleUartByte(uint8_t byte)
+{
+  if (replyLength < REPLY_MAX_LENGTH)
+  {
+    replyTimes[replyLength] = SimNow();
+    reply[replyLength++] = (char)byte;
+  }
+}
+
+void HandlePins(GPIO_TypeDef *port, uint16_t changed, uint16_t levels)
+{
+  if ((port == GPIOB) && (ledsOnTime == 0) && ((levels & LEDS_PINS) == CONVERGE_FIRST_LEDS))
+  {
+    ledsOnTime = SimNow();
+  }
+}
+
+uint16_t ReadAdcChannel(uint8_t channel)
+{
+  switch (channel)
+  {
+  case (uint8_t)ADC_CHANNEL_TEMPSENSOR:
+    return 1430 * 4095 / SUPPLY_VOLTAGE;
+  case (uint8_t)ADC_CHANNEL_VREFINT:
+    return 1200 * 4095 / SUPPLY_VOLTAGE;
+  default:
+    return 0;
+  }
+}
+
+/* A byte sent to the firmware in STOP only wakes it up */
+void SendCommand(void *command)
+{
+  static const uint8_t WAKE_UP = ' ';
+  SimSendUart(&WAKE_UP, 1, BAUD_RATE);
+  SimSendUart((const uint8_t *)command, 1, BAUD_RATE);
+}
+
+void HandleTimerOverflow(TIM_TypeDef *instance)
+{
+  if ((instance == TIM3) && (overflowsCount < OVERFLOWS_MAX_COUNT))
+  {
+    overflowTimes[overflowsCount++] = SimNow();
+  }
+}
+
+void RecordStops(void *argument)
+{
+  stopCountBeforeStop = SimGetStats()->stopCount;
+}
+
+void SetUpCommands(void)
+{
+  SimSetUartListener(HandleUartByte);
+  SimSetPinsListener(HandlePins);
+  SimSetAdcSource(ReadAdcChannel);
+  SimSetPins(GPIOA, BUTTON_PIN, true);
+  SimSchedule(COMMAND_TIME, SendCommand, "n");
+  SimSchedule(STOP_COMMAND_TIME, RecordStops, NULL);
+  SimSchedule(STOP_COMMAND_TIME, SendCommand, "s");
+}
+
+void CheckCommands(void)
+{
+  const SimTime commandEnd = COMMAND_TIME + 2 * UART_FRAME_TIME;
+  const char *const EXPECTED_REPLY = "converge\r\noff\r\n";
+  const uint8_t firstLength = strlen("converge\r\n");
+  CHECK(strcmp(reply, EXPECTED_REPLY) == 0);
+  CHECK(ledsOnTime > commandEnd);
+  CHECK((replyTimes[0] > commandEnd) && (replyTimes[0] - UART_FRAME_TIME - commandEnd <= REPLY_LATENCY_MAX));
+  const SimTime replySpan = replyTimes[firstLength - 1] - replyTimes[0];
+  CHECK(replySpan <= (firstLength - 1) * UART_FRAME_TIME + REPLY_GAP_MAX);
+  /* The firmware was in STOP before the command, and went back to it after */
+  CHECK(stopCountBeforeStop > 0);
+  CHECK(SimGetStats()->stopCount > stopCountBeforeStop);
+  /* Only the byte that woke the core up was lost, the receiver is
+     unclocked in STOP */
+  CHECK_EQUAL(1, SimGetStats()->uartLostCount);
+  CHECK(acquisitionStats.blocksCount > 0);
+  CHECK_EQUAL(0, acquisitionStats.droppedCount);
+  CHECK(abs(supplyVoltage - SUPPLY_VOLTAGE) <= 5);
+  CHECK(abs(chipTemperature - ROOM_TEMPERATURE) <= 5);
+  printf("sim_leds: reply %llu us after the command, %llu bytes/s, LEDs lit %llu us after it, in STOP %llu%% of the time\n",
+         (unsigned long long)SIM_TO_US(replyTimes[0] - UART_FRAME_TIME - commandEnd),
+         (unsigned long long)((firstLength - 1) * SIM_S(1) / replySpan),
+         (unsigned long long)SIM_TO_US(ledsOnTime - commandEnd),
+         (unsigned long long)(SimGetStats()->stopTime * 100 / SimNow()));
+}
+
+/* Switches the clock profile while a pattern plays, so the core never
+   stops, then restarts the pattern for a report at the new baud divider */
+void SetUpClockSwitches(void)
+{
+  SimSetUartListener(HandleUartByte);
+  SimSetTimerListener(HandleTimerOverflow);
+  SimSetPins(GPIOA, BUTTON_PIN, true);
+  SimSchedule(COMMAND_TIME, SendCommand, "n");
+  for (uint8_t i = 0; i < clockSwitchesCount; ++i)
+  {
+    SimSchedule(CLOCK_COMMAND_TIME + i * CLOCK_COMMAND_PERIOD, SendCommand, "c");
+  }
+  SimSchedule(CLOCK_COMMAND_TIME + clockSwitchesCount * CLOCK_COMMAND_PERIOD, SendCommand, "r");
+}
+
+void CheckClockSwitches(void)
+{
+  /* 8 MHz HSI, 24 MHz and 64 MHz with APB1 and its timers at 32 and 64 MHz */
+  const uint32_t HCLK_FREQUENCIES[CLOCK_PROFILES_COUNT] = { 8000000, 24000000, 64000000 };
+  const uint32_t TIM3_PRESCALERS[CLOCK_PROFILES_COUNT] = { 7, 23, 63 };
+  const enum ClockProfile profile = (enum ClockProfile)(clockSwitchesCount % CLOCK_PROFILES_COUNT);
+  CHECK_EQUAL(profile, GetClockProfile());
+  CHECK_EQUAL(HCLK_FREQUENCIES[profile], SimGetHclkFrequency());
+  CHECK_EQUAL(TIM3_PRESCALERS[profile], GetTimerPrescaler(TIM3, ACQUISITION_TIMER_TICK_FREQUENCY));
+  CHECK_EQUAL(TIM3_PRESCALERS[profile], TIM3->PSC);
+  SimTime deviationMax = 0;
+  for (uint16_t i = 1; i < overflowsCount; ++i)
+  {
+    const SimTime period = overflowTimes[i] - overflowTimes[i - 1];
+    const SimTime deviation = (period > ACQUISITION_PERIOD) ? period - ACQUISITION_PERIOD : ACQUISITION_PERIOD - period;
+    deviationMax = (deviation > deviationMax) ? deviation : deviationMax;
+  }
+  CHECK(overflowsCount > 0);
+  CHECK(deviationMax <= SWITCH_DEVIATION_MAX);
+  /* The report of the restart went out at the right baud rate */
+  const uint8_t reportLength = strlen("converge\r\n");
+  CHECK(strcmp(reply, "converge\r\nconverge\r\n") == 0);
+  const SimTime reportSpan = replyTimes[2 * reportLength - 1] - replyTimes[reportLength];
+  CHECK(SimIsNear(reportSpan, (reportLength - 1) * UART_FRAME_TIME,
+                  (reportLength - 1) * UART_FRAME_TIME * BAUD_RATE_TOLERANCE_PERCENT / 100));
+  printf("sim_leds: TIM3 period within %llu ns of 1 ms over %u clock switches\n",
+         (unsigned long long)(deviationMax / SIM_NS(1)), clockSwitchesCount);
+}
+
+int main(void)
+{
+  SimInit();
+  testsFailedCount += SimRun(SIM_MS(600), SetUpCommands, CheckCommands);
+  for (clockSwitchesCount = 1; clockSwitchesCount <= CLOCK_PROFILES_COUNT; ++clockSwitchesCount)
+  {
+    const SimTime duration = CLOCK_COMMAND_TIME + clockSwitchesCount * CLOCK_COMMAND_PERIOD + SIM_MS(50);
+    testsFailedCount += SimRun(duration, SetUpClockSwitches, CheckClockSwitches);
+  }
+  return FinishTests("sim_leds");
+}
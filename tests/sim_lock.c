@@ -0,0 +1,294 @@
+/**
+  ******************************************************************************
+  * @file           : sim_lock.c
+  * @brief          : The lock firmware on the simulator, driven from its
+  *                   keypad. The failed attempts count stays in the
+  *                   simulated flash from one run to the next, like across
+  *                   a reset.
+  *
+  *                   The keypad model closes the switch of the pressed key,
+  *                   so its column follows the row the firmware drives.
+  ******************************************************************************
+  */
+
+#include "sim.h"
+#include "test.h"
+#include "timers.h"
+#include "storage.h"
+
+/* Time between two key presses and time a key is held */
+#define KEY_PERIOD SIM_MS(150)
+#define KEY_HOLD SIM_MS(80)
+#define ROWS_PINS (GPIO_PIN_0 | GPIO_PIN_1 | GPIO_PIN_2 | GPIO_PIN_3)
+#define COLUMNS_PINS (GPIO_PIN_5 | GPIO_PIN_6 | GPIO_PIN_7)
+#define DIGITS_PINS (GPIO_PIN_8 | GPIO_PIN_9 | GPIO_PIN_10 | GPIO_PIN_11)
+#define LED_RED_PIN GPIO_PIN_13
+#define LED_GREEN_PIN GPIO_PIN_15
+/* Debounced over 3 samples, every 4 ms as the 4 rows are scanned in turn */
+#define KEY_LATENCY_MAX SIM_MS(16)
+#define LED_SIGNAL_TIME SIM_MS(2000)
+/* Software timers run from the 1 ms SysTick */
+#define LED_TIME_TOLERANCE SIM_MS(2)
+/* The LEDs of a new state are written one after the other */
+#define LEDS_WRITE_TIME_MAX SIM_US(10)
+/* The lockout doubles from its base with every failed attempt from the
+   threshold on, up to a cap */
+#define LOCKOUT_THRESHOLD 3
+#define LOCKOUT_BASE_TIME SIM_MS(5000)
+#define LOCKOUT_MAX_SHIFT 6
+/* Comes after the legacy password and the 4 user slots, as in enum
+   StorageKey of main.c */
+#define STORAGE_FAILED_ATTEMPTS 5
+/* The lockout a reset resumes starts as the firmware boots */
+#define BOOT_TIME_MAX SIM_MS(5)
+#define RED_PULSES_MAX 8
+
+struct LedEdges
+{
+  SimTime on;
+  SimTime off;
+};
+
+int8_t pressedKey = -1;
+SimTime lastPressTime;
+struct LedEdges greenEdges, redEdges;
+uint32_t digitSelectsCount;
+struct LedEdges redPulses[RED_PULSES_MAX];
+uint8_t redPulsesCount;
+uint32_t storedFailedAttempts;
+
+extern struct Timer ledsTimer;
+extern struct Timer inputTimer;
+extern uint32_t timersTick;
+extern uint32_t failedAttempts;
+
+/* Keys are numbered row by row, from 1 2 3 to * 0 # */
+int8_t GetKey(char symbol)
+{
+  switch (symbol)
+  {
+  case '*':
+    return 9;
+  case '0':
+    return 10;
+  case '#':
+    return 11;
+  default:
+    return (int8_t)(symbol - '1');
+  }
+}
+
+void UpdateColumns(uint16_t levels)
+{
+  const uint16_t column = GPIO_PIN_5 << (pressedKey % 3);
+  if ((pressedKey >= 0) && ((levels & (GPIO_PIN_0 << (pressedKey / 3))) != 0))
+  {
+    SimSetPins(GPIOB, column, true);
+    SimReleasePins(GPIOB, COLUMNS_PINS & ~column);
+  }
+  else
+  {
+    SimReleasePins(GPIOB, COLUMNS_PINS);
+  }
+}
+
+void RecordLedEdge(struct LedEdges *edges, uint16_t pin, uint16_t changed, uint16_t levels)
+{
+  if ((changed & pin) != 0)
+  {
+    *(((levels & pin) != 0) ? &edges->on : &edges->off) = SimNow();
+  }
+}
+
+void HandlePins(GPIO_TypeDef *port, uint16_t changed, uint16_t levels)
+{
+  if ((port == GPIOB) && ((changed & ROWS_PINS) != 0))
+  {
+    UpdateColumns(levels);
+  }
+  else if (port == GPIOA)
+  {
+    RecordLedEdge(&greenEdges, LED_GREEN_PIN, changed, levels);
+    RecordLedEdge(&redEdges, LED_RED_PIN, changed, levels);
+    if (((changed & levels & LED_RED_PIN) != 0) && (redPulsesCount < RED_PULSES_MAX))
+    {
+      ++redPulsesCount;
+    }
+    if (redPulsesCount > 0)
+    {
+      RecordLedEdge(&redPulses[redPulsesCount - 1], LED_RED_PIN, changed, levels);
+    }
+    digitSelectsCount += __builtin_popcount(changed & levels & DIGITS_PINS);
+  }
+}
+
+void PressKey(void *key)
+{
+  pressedKey = (int8_t)(intptr_t)key;
+  lastPressTime = SimNow();
+  UpdateColumns(SimGetPins(GPIOB));
+}
+
+void ReleaseKey(void *key)
+{
+  pressedKey = -1;
+  UpdateColumns(SimGetPins(GPIOB));
+}
+
+/* Returns the time of the last press */
+SimTime TypeKeys(SimTime start, const char *symbols)
+{
+  SimTime time = start;
+  for (; *symbols != '\0'; ++symbols, time += KEY_PERIOD)
+  {
+    SimSchedule(time, PressKey, (void *)(intptr_t)GetKey(*symbols));
+    SimSchedule(time + KEY_HOLD, ReleaseKey, NULL);
+  }
+  return time - KEY_PERIOD;
+}
+
+void SetUpAcceptedPassword(void)
+{
+  SimSetPinsListener(HandlePins);
+  TypeKeys(SIM_MS(100), "*1852");
+}
+
+void CheckAcceptedPassword(void)
+{
+  const SimTime latency = greenEdges.on - lastPressTime;
+  CHECK((greenEdges.on > lastPressTime) && (latency <= KEY_LATENCY_MAX));
+  CHECK(SimIsNear(greenEdges.off - greenEdges.on, LED_SIGNAL_TIME, LED_TIME_TOLERANCE));
+  CHECK_EQUAL(0, redEdges.on);
+  /* The entered digits were shown while typing */
+  CHECK(digitSelectsCount > 0);
+  printf("sim_lock: green LED %llu us after the last key, asleep %llu%% of the time\n",
+         (unsigned long long)SIM_TO_US(latency), (unsigned long long)(SimGetStats()->sleepTime * 100 / SimNow()));
+}
+
+void SetUpWrongPassword(void)
+{
+  SimSetPinsListener(HandlePins);
+  TypeKeys(SIM_MS(100), "*1111");
+}
+
+void CheckWrongPassword(void)
+{
+  CHECK((redEdges.on > lastPressTime) && (redEdges.on - lastPressTime <= KEY_LATENCY_MAX));
+  CHECK(SimIsNear(redEdges.off - redEdges.on, LED_SIGNAL_TIME, LED_TIME_TOLERANCE));
+  CHECK_EQUAL(0, greenEdges.on);
+}
+
+/* The accepted password comes while the red signal of the wrong one is
+   still on */
+void SetUpSignalOverride(void)
+{
+  SimSetPinsListener(HandlePins);
+  TypeKeys(SIM_MS(100), "*1111");
+  TypeKeys(SIM_MS(1000), "*1852");
+}
+
+/* The green signal replaced the red one and got its whole time, the
+   pending restore of the red signal didn't cut it short */
+void CheckSignalOverride(void)
+{
+  CHECK((redEdges.on > 0) && (redEdges.on < greenEdges.on));
+  CHECK((greenEdges.on > lastPressTime) && (greenEdges.on - lastPressTime <= KEY_LATENCY_MAX));
+  CHECK(SimIsNear(redEdges.off, greenEdges.on, LEDS_WRITE_TIME_MAX));
+  CHECK(SimIsNear(greenEdges.off - greenEdges.on, LED_SIGNAL_TIME, LED_TIME_TOLERANCE));
+  CHECK(!ledsTimer.isArmed);
+}
+
+SimTime GetLockoutTime(uint32_t failedAttemptsCount)
+{
+  const uint32_t shift = failedAttemptsCount - LOCKOUT_THRESHOLD;
+  return LOCKOUT_BASE_TIME << ((shift < LOCKOUT_MAX_SHIFT) ? shift : LOCKOUT_MAX_SHIFT);
+}
+
+/* Time left of the running lockout, from the virtual ticks of the timer */
+SimTime GetLockoutTimeLeft(void)
+{
+  return inputTimer.isArmed ? SIM_MS(inputTimer.expiryTick - timersTick) : 0;
+}
+
+/* Three wrong passwords, then the right one while locked out */
+void SetUpAttack(void)
+{
+  SimSetPinsListener(HandlePins);
+  TypeKeys(SIM_MS(100), "*1111");
+  TypeKeys(SIM_MS(3000), "*1111");
+  TypeKeys(SIM_MS(6000), "*1111");
+  TypeKeys(SIM_MS(7000), "*1852");
+}
+
+/* The two first attempts only got the red signal, the third one locked
+   the keypad out, and the right password typed meanwhile was ignored */
+void CheckAttack(void)
+{
+  CHECK_EQUAL(3, redPulsesCount);
+  CHECK(SimIsNear(redPulses[0].off - redPulses[0].on, LED_SIGNAL_TIME, LED_TIME_TOLERANCE));
+  CHECK(SimIsNear(redPulses[1].off - redPulses[1].on, LED_SIGNAL_TIME, LED_TIME_TOLERANCE));
+  CHECK(SimIsNear(redPulses[2].off - redPulses[2].on, GetLockoutTime(LOCKOUT_THRESHOLD), LED_TIME_TOLERANCE));
+  CHECK_EQUAL(0, greenEdges.on);
+  CHECK_EQUAL(LOCKOUT_THRESHOLD, failedAttempts);
+}
+
+/* Resets with the count left by the run before, sits its lockout out and
+   fails once more */
+void SetUpLockoutAfterReset(void)
+{
+  SimSetPinsListener(HandlePins);
+  TypeKeys(GetLockoutTime(storedFailedAttempts) + SIM_MS(500), "*1111");
+}
+
+void CheckLockoutAfterReset(void)
+{
+  CHECK_EQUAL(2, redPulsesCount);
+  CHECK(redPulses[0].on <= BOOT_TIME_MAX);
+  CHECK(SimIsNear(redPulses[0].off - redPulses[0].on, GetLockoutTime(storedFailedAttempts), LED_TIME_TOLERANCE));
+  /* The next lockout is still running, its red LED on */
+  CHECK_EQUAL(0, redPulses[1].off);
+  CHECK_EQUAL(storedFailedAttempts + 1, failedAttempts);
+  const SimTime lockoutTime = SimNow() - redPulses[1].on + GetLockoutTimeLeft();
+  CHECK(SimIsNear(lockoutTime, GetLockoutTime(storedFailedAttempts + 1), LED_TIME_TOLERANCE));
+  CHECK_EQUAL(0, greenEdges.on);
+}
+
+/* Stores the count of a device that failed further, which would take
+   minutes of lockouts to reach by typing */
+void SetUpStoredFailedAttempts(void)
+{
+  SimSetPinsListener(HandlePins);
+  if ((InitStorage() != HAL_OK) || (WriteStorageValue(STORAGE_FAILED_ATTEMPTS, storedFailedAttempts) != HAL_OK))
+  {
+    CHECK(false);
+  }
+}
+
+void CheckStoredFailedAttempts(void)
+{
+  CHECK((redEdges.on > 0) && (redEdges.on <= BOOT_TIME_MAX));
+  CHECK_EQUAL(0, redEdges.off);
+  CHECK_EQUAL(storedFailedAttempts, failedAttempts);
+  CHECK(SimIsNear(SimNow() - redEdges.on + GetLockoutTimeLeft(), GetLockoutTime(storedFailedAttempts), LED_TIME_TOLERANCE));
+}
+
+int main(void)
+{
+  SimInit();
+  testsFailedCount += SimRun(SIM_S(3), SetUpAcceptedPassword, CheckAcceptedPassword);
+  testsFailedCount += SimRun(SIM_S(3), SetUpWrongPassword, CheckWrongPassword);
+  testsFailedCount += SimRun(SIM_S(4), SetUpSignalOverride, CheckSignalOverride);
+  SimEraseFlash();
+  testsFailedCount += SimRun(SIM_S(12), SetUpAttack, CheckAttack);
+  for (storedFailedAttempts = LOCKOUT_THRESHOLD; storedFailedAttempts < LOCKOUT_THRESHOLD + 2; ++storedFailedAttempts)
+  {
+    const SimTime duration = GetLockoutTime(storedFailedAttempts) + SIM_MS(500) + 5 * KEY_PERIOD + SIM_MS(500);
+    testsFailedCount += SimRun(duration, SetUpLockoutAfterReset, CheckLockoutAfterReset);
+  }
+  /* Up to the cap and past it */
+  for (; storedFailedAttempts <= LOCKOUT_THRESHOLD + LOCKOUT_MAX_SHIFT + 1; ++storedFailedAttempts)
+  {
+    testsFailedCount += SimRun(SIM_MS(100), SetUpStoredFailedAttempts, CheckStoredFailedAttempts);
+  }
+  return FinishTests("sim_lock");
+}
@@ -0,0 +1,47 @@
+/**
+  ******************************************************************************
+  * @file           : test.h
+  * @brief          : Minimal check macros of the host tests.
+  *
+  *                   A test file includes the firmware source it covers, so
+  *                   its private functions and tables are in scope, and ends
+  *                   main with FinishTests.
+  ******************************************************************************
+  */
+
+#ifndef __TEST_H
+#define __TEST_H
+
+#include <stdio.h>
+
+uint32_t hostPrimask;
+unsigned testsFailedCount;
+
+#define CHECK(condition) \
+  do \
+  { \
+    if (!(condition)) \
+    { \
+      ++testsFailedCount; \
+      fprintf(stderr, "%s:%d: check failed: %s\n", __FILE__, __LINE__, #condition); \
+    } \
+  } while (0)
+
+#define CHECK_EQUAL(expected, actual) \
+  do \
+  { \
+    const unsigned long long expectedValue = (expected), actualValue = (actual); \
+    if (expectedValue != actualValue) \
+    { \
+      ++testsFailedCount; \
+      fprintf(stderr, "%s:%d: %s is %llu, expected %llu\n", __FILE__, __LINE__, #actual, actualValue, expectedValue); \
+    } \
+  } while (0)
+
+static inline int FinishTests(const char *name)
+{
+  printf("%s: %s\n", name, (testsFailedCount == 0) ? "ok" : "FAILED");
+  return (testsFailedCount == 0) ? 0 : 1;
+}
+
+#endif /* __TEST_H */
@@ -0,0 +1,59 @@
+/**
+  ******************************************************************************
+  * @file           : test_acquisition.c
+  * @brief          : In place deinterleaving of the acquisition blocks.
+  ******************************************************************************
+  */
+
+#include "acquisition.c"
+#include <stdbool.h>
+
+#include "test.h"
+
+void TestDeinterleaveBlock(void)
+{
+  uint16_t samples[ACQUISITION_BLOCK_LENGTH * ACQUISITION_CHANNELS_MAX];
+  for (uint8_t channelsCount = 1; channelsCount <= ACQUISITION_CHANNELS_MAX; ++channelsCount)
+  {
+    /* Scan s of channel c holds (c << 8) | s, in the order the DMA stores it */
+    for (uint16_t scan = 0; scan < ACQUISITION_BLOCK_LENGTH; ++scan)
+    {
+      for (uint8_t channel = 0; channel < channelsCount; ++channel)
+      {
+        samples[scan * channelsCount + channel] = (uint16_t)((channel << 8) | scan);
+      }
+    }
+    DeinterleaveBlock(samples, channelsCount);
+    for (uint8_t channel = 0; channel < channelsCount; ++channel)
+    {
+      for (uint16_t scan = 0; scan < ACQUISITION_BLOCK_LENGTH; ++scan)
+      {
+        CHECK_EQUAL((channel << 8) | scan, samples[channel * ACQUISITION_BLOCK_LENGTH + scan]);
+      }
+    }
+  }
+}
+
+void TestGetDeinterleavedIndex(void)
+{
+  /* A permutation of the block for every channel count */
+  for (uint8_t channelsCount = 1; channelsCount <= ACQUISITION_CHANNELS_MAX; ++channelsCount)
+  {
+    const uint16_t blockSize = ACQUISITION_BLOCK_LENGTH * channelsCount;
+    bool isTaken[ACQUISITION_BLOCK_LENGTH * ACQUISITION_CHANNELS_MAX] = { false };
+    for (uint16_t index = 0; index < blockSize; ++index)
+    {
+      const uint16_t moved = GetDeinterleavedIndex(index, channelsCount);
+      CHECK(moved < blockSize);
+      CHECK(!isTaken[moved]);
+      isTaken[moved] = true;
+    }
+  }
+}
+
+int main(void)
+{
+  TestGetDeinterleavedIndex();
+  TestDeinterleaveBlock();
+  return FinishTests("acquisition");
+}
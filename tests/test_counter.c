@@ -0,0 +1,73 @@
+/**
+  ******************************************************************************
+  * @file           : test_counter.c
+  * @brief          : Decimal display digits of the counter.
+  *
+  *                   Built with DISPLAY_MODE set to DISPLAY_DECIMAL.
+  ******************************************************************************
+  */
+
+#define main FirmwareMain
+#include "main.c"
+#undef main
+
+#include "test.h"
+#include "segments.h"
+
+uint32_t GetDisplayDigitsValue(void)
+{
+  uint32_t value = 0;
+  for (uint8_t i = DISPLAY_DIGITS_COUNT; i > 0; --i)
+  {
+    value = value * 10 + displayed_digits[i - 1];
+  }
+  return value;
+}
+
+void TestAddToDisplayDigits(void)
+{
+  const uint32_t STARTS[] = { 0, 1, 9, 99, 999, 1234, 4999, 9990, 9999 };
+  const uint32_t STEPS[] = { 0, 1, 9, 10, 11, 99, 100, 250, 1000, 9999 };
+  for (uint8_t i = 0; i < sizeof(STARTS) / sizeof(STARTS[0]); ++i)
+  {
+    for (uint8_t j = 0; j < sizeof(STEPS) / sizeof(STEPS[0]); ++j)
+    {
+      SetDisplayDigits(STARTS[i]);
+      CHECK_EQUAL(STARTS[i], GetDisplayDigitsValue());
+      AddToDisplayDigits(STEPS[j]);
+      /* The carry out of the last digit is dropped, the caller wraps the number */
+      CHECK_EQUAL((STARTS[i] + STEPS[j]) % 10000, GetDisplayDigitsValue());
+      for (uint8_t digit = 0; digit < DISPLAY_DIGITS_COUNT; ++digit)
+      {
+        CHECK(displayed_digits[digit] <= 9);
+      }
+    }
+  }
+  /* Counting up one at a time across the whole range */
+  SetDisplayDigits(0);
+  for (uint32_t value = 1; value <= MAX_DISPLAYED_NUMBER; ++value)
+  {
+    AddToDisplayDigits(1);
+    if (GetDisplayDigitsValue() != value)
+    {
+      CHECK_EQUAL(value, GetDisplayDigitsValue());
+      break;
+    }
+  }
+  CHECK_EQUAL(9999, MAX_DISPLAYED_NUMBER);
+}
+
+void TestDigitSegments(void)
+{
+  /* The glyphs resolved onto the pin map of the counter */
+  CheckGlyphPins(GLYPH_PINS);
+  CHECK_EQUAL(DISPLAY_SEGMENT_PINS, GLYPH_PINS[GLYPH_8]);
+  CHECK((DISPLAY_SEGMENT_PINS & (DISPLAY_DIGIT_PINS[0] | DISPLAY_DIGIT_PINS[1] | DISPLAY_DIGIT_PINS[2] | DISPLAY_DIGIT_PINS[3])) == 0);
+}
+
+int main(void)
+{
+  TestAddToDisplayDigits();
+  TestDigitSegments();
+  return FinishTests("counter");
+}
@@ -0,0 +1,159 @@
+/**
+  ******************************************************************************
+  * @file           : test_lock.c
+  * @brief          : Input state machine, display glyphs and display frame
+  *                   of the lock.
+  ******************************************************************************
+  */
+
+#define main FirmwareMain
+#include "main.c"
+#undef main
+
+#include <string.h>
+
+#include "test.h"
+#include "segments.h"
+
+/* Only reached through the actions of TRANSITIONS, which are never run here */
+HAL_StatusTypeDef HAL_DMA_Start(DMA_HandleTypeDef *hdma, uint32_t SrcAddress, uint32_t DstAddress, uint32_t DataLength)
+{
+  return HAL_ERROR;
+}
+
+HAL_StatusTypeDef HAL_DMA_Abort(DMA_HandleTypeDef *hdma)
+{
+  return HAL_ERROR;
+}
+
+void StartTimer(struct Timer *timer, const uint32_t delay, const TimerCallback callback)
+{
+}
+
+void StopTimer(struct Timer *timer)
+{
+}
+
+void EndProfile(const uint8_t slot, const uint32_t startCycles)
+{
+}
+
+bool ReadStorageValue(uint8_t key, uint32_t *value)
+{
+  return false;
+}
+
+HAL_StatusTypeDef WriteStorageValue(uint8_t key, uint32_t value)
+{
+  return HAL_ERROR;
+}
+
+/* States reachable from IDLE over any sequence of events */
+uint32_t GetReachableStates(void)
+{
+  uint32_t reached = 1U << IDLE;
+  uint32_t previous = 0;
+  while (reached != previous)
+  {
+    previous = reached;
+    for (uint8_t state = 0; state < INPUT_STATES_COUNT; ++state)
+    {
+      for (uint8_t event = 0; (reached & (1U << state)) && (event < INPUT_EVENTS_COUNT); ++event)
+      {
+        if (TRANSITIONS[state][event].action != NULL)
+        {
+          reached |= 1U << TRANSITIONS[state][event].nextState;
+        }
+      }
+    }
+  }
+  return reached;
+}
+
+void TestTransitions(void)
+{
+  for (uint8_t state = 0; state < INPUT_STATES_COUNT; ++state)
+  {
+    /* EVENT_NONE ends the dispatch loop and never has an action */
+    CHECK(TRANSITIONS[state][EVENT_NONE].action == NULL);
+    for (uint8_t event = 0; event < INPUT_EVENTS_COUNT; ++event)
+    {
+      CHECK(TRANSITIONS[state][event].nextState < INPUT_STATES_COUNT);
+    }
+    /* Every state but IDLE falls back to it once the input times out */
+    if (state != IDLE)
+    {
+      CHECK(TRANSITIONS[state][EVENT_TIMEOUT].action != NULL);
+      CHECK_EQUAL(IDLE, TRANSITIONS[state][EVENT_TIMEOUT].nextState);
+    }
+  }
+  CHECK_EQUAL((1U << INPUT_STATES_COUNT) - 1, GetReachableStates());
+  CHECK(TRANSITIONS[IDLE][EVENT_STAR].action == StartPasswordInput);
+  CHECK(TRANSITIONS[FIRST_PASSWORD_INPUT][EVENT_INPUT_COMPLETE].action == CheckPassword);
+  CHECK_EQUAL(USER_SLOT_SELECTION, TRANSITIONS[FIRST_PASSWORD_INPUT][EVENT_MASTER_PASSWORD].nextState);
+  CHECK_EQUAL(LOCKED_OUT, TRANSITIONS[IDLE][EVENT_LOCKOUT].nextState);
+}
+
+void TestGlyphPins(void)
+{
+  CheckGlyphPins(GLYPH_PINS);
+  for (uint8_t glyph = 0; glyph < GLYPH_COUNT; ++glyph)
+  {
+    CHECK((GLYPH_PINS[glyph] & ~DISPLAY_SEGMENTS) == 0);
+    CHECK_EQUAL(GLYPH_PINS[glyph], GetPinsForGlyph(glyph));
+    for (uint8_t other = 0; other < glyph; ++other)
+    {
+      CHECK(GLYPH_PINS[glyph] != GLYPH_PINS[other]);
+    }
+  }
+  CHECK_EQUAL(0, GetPinsForGlyph(GLYPH_COUNT));
+}
+
+/* Plays the frame the DMA streams to GPIOA->BSRR, word by word, for every
+   count of entered digits */
+void TestDisplayFrame(void)
+{
+  const uint8_t DIGITS[PASSWORD_LENGTH] = { 1, 8, 5, 2 };
+  const uint16_t DIGIT_PINS[PASSWORD_LENGTH] = { DISPLAY_1_Pin, DISPLAY_2_Pin, DISPLAY_3_Pin, DISPLAY_4_Pin };
+  CHECK_EQUAL(PASSWORD_LENGTH, sizeof(displayFrame) / sizeof(displayFrame[0]));
+  for (enteredSymbolsCount = 0; enteredSymbolsCount <= PASSWORD_LENGTH; ++enteredSymbolsCount)
+  {
+    memcpy(enteredSymbols, DIGITS, sizeof(DIGITS));
+    UpdateDisplayFrame();
+    uint16_t levels = 0;
+    uint8_t selectionsCount[PASSWORD_LENGTH] = { 0 };
+    for (uint8_t word = 0; word < PASSWORD_LENGTH; ++word)
+    {
+      const uint16_t setPins = (uint16_t)displayFrame[word];
+      const uint16_t resetPins = (uint16_t)(displayFrame[word] >> 16);
+      /* A pin both set and reset would be set, and each word drives every
+         display pin, so nothing of the previous digit is left on */
+      CHECK_EQUAL(0, setPins & resetPins);
+      CHECK_EQUAL(DISPLAY_DIGITS | DISPLAY_SEGMENTS, setPins | resetPins);
+      CHECK_EQUAL(displayFrame[word], GetDisplayFrameWord(word, GetPinsForGlyph((word < enteredSymbolsCount) ? DIGITS[word] : GLYPH_BLANK)));
+      levels = (levels | setPins) & ~resetPins;
+      /* The digit is selected high and its segments are lit low */
+      CHECK_EQUAL(DIGIT_PINS[word], levels & DISPLAY_DIGITS);
+      const char *segments = (word < enteredSymbolsCount) ? GLYPH_SEGMENTS[DIGITS[word]] : GLYPH_SEGMENTS[GLYPH_BLANK];
+      CHECK_EQUAL(GetSegmentsPins(segments), ~levels & DISPLAY_SEGMENTS);
+      for (uint8_t digit = 0; digit < PASSWORD_LENGTH; ++digit)
+      {
+        selectionsCount[digit] += ((levels & DIGIT_PINS[digit]) != 0) ? 1 : 0;
+      }
+    }
+    /* Each digit is lit for one TIM1 update in four */
+    for (uint8_t digit = 0; digit < PASSWORD_LENGTH; ++digit)
+    {
+      CHECK_EQUAL(1, selectionsCount[digit]);
+    }
+  }
+  enteredSymbolsCount = 0;
+}
+
+int main(void)
+{
+  TestTransitions();
+  TestGlyphPins();
+  TestDisplayFrame();
+  return FinishTests("lock");
+}
@@ -0,0 +1,101 @@
+/**
+  ******************************************************************************
+  * @file           : test_recorder.c
+  * @brief          : Varint records of the input trace recorder.
+  ******************************************************************************
+  */
+
+#include "recorder.c"
+
+#include "test.h"
+
+uint32_t testTick;
+
+uint32_t HAL_GetTick(void)
+{
+  return testTick;
+}
+
+/* Decodes the record at *position and moves past it, returns its length */
+uint8_t ReadRecord(uint32_t *position, uint32_t *delta, uint8_t *event)
+{
+  const uint32_t start = *position;
+  uint8_t shift = 0;
+  uint8_t byte;
+  *delta = 0;
+  do
+  {
+    byte = recorder.bytes[(*position)++ % RECORDER_CAPACITY];
+    *delta |= (uint32_t)(byte & 0x7F) << shift;
+    shift += 7;
+  } while ((byte & 0x80) != 0);
+  *event = recorder.bytes[(*position)++ % RECORDER_CAPACITY];
+  return *position - start;
+}
+
+void TestRecordLengths(void)
+{
+  /* Two bytes below 128 ms, one more for every further 7 bits */
+  const uint32_t DELTAS[] = { 0, 1, 127, 128, 16383, 16384, 2097151, 2097152, 0xFFFFFFFF };
+  const uint8_t LENGTHS[] = { 2, 2, 2, 3, 3, 4, 4, 5, 6 };
+  const uint8_t count = sizeof(DELTAS) / sizeof(DELTAS[0]);
+  testTick = 1000;
+  InitRecorder();
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    testTick += DELTAS[i];
+    RecordEvent(i, (i & 1) != 0);
+  }
+  uint32_t position = recorder.tail;
+  for (uint8_t i = 0; i < count; ++i)
+  {
+    uint32_t delta;
+    uint8_t event;
+    CHECK_EQUAL(LENGTHS[i], ReadRecord(&position, &delta, &event));
+    CHECK_EQUAL(DELTAS[i], delta);
+    CHECK_EQUAL(i | (((i & 1) != 0) ? RECORDER_EVENT_HIGH : 0), event);
+  }
+  CHECK_EQUAL(recorder.head, position);
+  CHECK_EQUAL(0, recorder.droppedCount);
+  /* The source keeps 7 bits, the level is the top one */
+  RecordEvent(0xFF, false);
+  CHECK_EQUAL(RECORDER_EVENT_SOURCE_MASK, recorder.bytes[(recorder.head - 1) % RECORDER_CAPACITY]);
+}
+
+void TestOldestRecordsDropped(void)
+{
+  testTick = 0;
+  InitRecorder();
+  /* Three byte records, the ring ends up holding the latest ones whole */
+  const uint32_t recordsCount = 1000;
+  for (uint32_t i = 0; i < recordsCount; ++i)
+  {
+    testTick += 200;
+    RecordEvent(i % 100, false);
+  }
+  CHECK(recorder.head - recorder.tail <= RECORDER_CAPACITY);
+  CHECK(recorder.head - recorder.tail > RECORDER_CAPACITY - 6);
+  uint32_t position = recorder.tail;
+  uint32_t keptCount = 0;
+  while (position != recorder.head)
+  {
+    uint32_t delta;
+    uint8_t event;
+    CHECK_EQUAL(3, ReadRecord(&position, &delta, &event));
+    CHECK_EQUAL(200, delta);
+    ++keptCount;
+    if (keptCount > recordsCount)
+    {
+      break;
+    }
+  }
+  CHECK_EQUAL(recordsCount, keptCount + recorder.droppedCount);
+  CHECK_EQUAL((recordsCount - 1) % 100, recorder.bytes[(recorder.head - 1) % RECORDER_CAPACITY]);
+}
+
+int main(void)
+{
+  TestRecordLengths();
+  TestOldestRecordsDropped();
+  return FinishTests("recorder");
+}
@@ -0,0 +1,280 @@
+/**
+  ******************************************************************************
+  * @file           : test_storage.c
+  * @brief          : Record CRC, boot scan and power loss recovery of the
+  *                   key-value store.
+  *
+  *                   The two storage pages are a RAM array. The flash HAL
+  *                   calls are emulated with the STM32F1 programming rules,
+  *                   and can cut the power before an operation or halfway
+  *                   through it. The test is built without PIE, so the
+  *                   array has a 32-bit address like the real flash.
+  ******************************************************************************
+  */
+
+#include "stm32f1xx_hal.h"
+#include <setjmp.h>
+#include <string.h>
+
+/* Aligned like the pages it stands for, which are erased whole */
+uint32_t flashPages[2 * FLASH_PAGE_SIZE / sizeof(uint32_t)] __attribute__((aligned(FLASH_PAGE_SIZE)));
+#define STORAGE_START_ADDRESS ((uintptr_t)flashPages)
+#include "storage.c"
+
+#include "test.h"
+
+#define OPERATIONS_MAX_COUNT 64
+#define OLD_VALUE 1000
+#define NEW_VALUE 2000
+#define OTHER_VALUE 3000
+
+enum PowerLoss
+{
+  POWER_LOSS_NONE,
+  POWER_LOSS_BEFORE,
+  POWER_LOSS_HALFWAY
+};
+
+struct FlashOperation
+{
+  uint32_t address;
+  bool isErase;
+};
+
+bool isFlashUnlocked;
+struct FlashOperation flashOperations[OPERATIONS_MAX_COUNT];
+uint16_t flashOperationsCount;
+enum PowerLoss powerLoss;
+uint16_t powerLossOperation;
+jmp_buf powerLossPoint;
+
+bool IsInFlash(uint32_t address, uint32_t size)
+{
+  return (address >= STORAGE_START_ADDRESS) && (address + size <= STORAGE_START_ADDRESS + sizeof(flashPages));
+}
+
+/* Logs the operation, and tells whether the power is lost during it */
+bool TakeFlashOperation(uint32_t address, bool isErase)
+{
+  const uint16_t index = flashOperationsCount++;
+  if (index < OPERATIONS_MAX_COUNT)
+  {
+    flashOperations[index] = (struct FlashOperation) { .address = address, .isErase = isErase };
+  }
+  return (powerLoss != POWER_LOSS_NONE) && (index == powerLossOperation);
+}
+
+HAL_StatusTypeDef HAL_FLASH_Unlock(void)
+{
+  isFlashUnlocked = true;
+  return HAL_OK;
+}
+
+HAL_StatusTypeDef HAL_FLASH_Lock(void)
+{
+  isFlashUnlocked = false;
+  return HAL_OK;
+}
+
+/* A half-word can only be programmed once erased, or to 0. Halfway
+   through, only the bits of the low byte are programmed */
+HAL_StatusTypeDef HAL_FLASH_Program(uint32_t TypeProgram, uint32_t Address, uint64_t Data)
+{
+  volatile uint16_t *halfWord = (volatile uint16_t *)(uintptr_t)Address;
+  const uint16_t data = (uint16_t)Data;
+  if (!isFlashUnlocked || (TypeProgram != FLASH_TYPEPROGRAM_HALFWORD) || ((Address % 2) != 0) || !IsInFlash(Address, 2))
+  {
+    return HAL_ERROR;
+  }
+  if (TakeFlashOperation(Address, false))
+  {
+    if (powerLoss == POWER_LOSS_HALFWAY)
+    {
+      *halfWord &= data | 0xFF00;
+    }
+    longjmp(powerLossPoint, 1);
+  }
+  if ((*halfWord != 0xFFFF) && (data != 0))
+  {
+    return HAL_ERROR;
+  }
+  *halfWord = data;
+  return HAL_OK;
+}
+
+/* Halfway through, only the second half of the page is erased, the header
+   still reads as before */
+HAL_StatusTypeDef HAL_FLASHEx_Erase(FLASH_EraseInitTypeDef *pEraseInit, uint32_t *PageError)
+{
+  *PageError = 0xFFFFFFFF;
+  if (!isFlashUnlocked || (pEraseInit->TypeErase != FLASH_TYPEERASE_PAGES))
+  {
+    return HAL_ERROR;
+  }
+  for (uint32_t i = 0; i < pEraseInit->NbPages; ++i)
+  {
+    const uint32_t address = pEraseInit->PageAddress + i * FLASH_PAGE_SIZE;
+    if (((address % FLASH_PAGE_SIZE) != 0) || !IsInFlash(address, FLASH_PAGE_SIZE))
+    {
+      *PageError = address;
+      return HAL_ERROR;
+    }
+    if (TakeFlashOperation(address, true))
+    {
+      if (powerLoss == POWER_LOSS_HALFWAY)
+      {
+        memset((void *)(uintptr_t)(address + FLASH_PAGE_SIZE / 2), 0xFF, FLASH_PAGE_SIZE / 2);
+      }
+      longjmp(powerLossPoint, 1);
+    }
+    memset((void *)(uintptr_t)address, 0xFF, FLASH_PAGE_SIZE);
+  }
+  return HAL_OK;
+}
+
+struct Record *GetRecords(const uint8_t page)
+{
+  return (struct Record *)(PAGE_ADDRESS(page) + sizeof(struct PageHeader));
+}
+
+void PutRecord(const uint8_t page, const uint16_t index, const uint16_t key, const uint32_t value)
+{
+  GetRecords(page)[index] = (struct Record) { .key = key, .crc = GetRecordCrc(key, value), .value = value };
+}
+
+void ResetStorage(const uint8_t page)
+{
+  memset(flashPages, 0xFF, sizeof(flashPages));
+  ((struct PageHeader *)PAGE_ADDRESS(page))->state = PAGE_ACTIVE;
+  memset(storageHasValue, 0, sizeof(storageHasValue));
+  activePage = page;
+}
+
+void TestGetRecordCrc(void)
+{
+  /* CRC-16/CCITT-FALSE of the little endian key and value, from Python's
+     binascii.crc_hqx(struct.pack("<HI", key, value), 0xFFFF) */
+  CHECK_EQUAL(0x0E10, GetRecordCrc(0, 0));
+  CHECK_EQUAL(0xF7F5, GetRecordCrc(1, 5));
+  CHECK_EQUAL(0x2EF4, GetRecordCrc(0x3231, 0x36353433));
+  CHECK_EQUAL(0x5F9E, GetRecordCrc(7, 0xFFFFFFFF));
+  CHECK_EQUAL(0x100A, GetRecordCrc(3, 0x12345678));
+}
+
+void TestLoadActivePage(void)
+{
+  uint32_t value;
+
+  ResetStorage(1);
+  LoadActivePage();
+  CHECK_EQUAL(0, nextRecord);
+  CHECK(!ReadStorageValue(0, &value));
+
+  ResetStorage(1);
+  PutRecord(1, 0, 0, 5);
+  PutRecord(1, 1, 1, 7);
+  /* Torn by a power loss: the key made it, the CRC is from another value */
+  PutRecord(1, 2, 0, 9);
+  GetRecords(1)[2].value = 10;
+  /* A key past STORAGE_KEYS_COUNT, from a firmware with more keys */
+  PutRecord(1, 3, STORAGE_KEYS_COUNT, 1);
+  PutRecord(1, 4, 0, 11);
+  LoadActivePage();
+  CHECK_EQUAL(5, nextRecord);
+  CHECK(ReadStorageValue(0, &value));
+  CHECK_EQUAL(11, value);
+  CHECK(ReadStorageValue(1, &value));
+  CHECK_EQUAL(7, value);
+  CHECK(!ReadStorageValue(2, &value));
+  /* The other page is not looked at */
+  CHECK(IsRecordEmpty(&GetRecords(0)[0]));
+
+  ResetStorage(0);
+  for (uint16_t i = 0; i < RECORDS_PER_PAGE; ++i)
+  {
+    PutRecord(0, i, i % STORAGE_KEYS_COUNT, i);
+  }
+  LoadActivePage();
+  CHECK_EQUAL(RECORDS_PER_PAGE, nextRecord);
+  CHECK(ReadStorageValue((RECORDS_PER_PAGE - 1) % STORAGE_KEYS_COUNT, &value));
+  CHECK_EQUAL(RECORDS_PER_PAGE - 1, value);
+}
+
+/* Forgets the RAM index, as a reset does, and boots the store again */
+HAL_StatusTypeDef RebootStorage(void)
+{
+  memset(storageValues, 0, sizeof(storageValues));
+  memset(storageHasValue, 0, sizeof(storageHasValue));
+  activePage = 0;
+  nextRecord = 0;
+  powerLoss = POWER_LOSS_NONE;
+  return InitStorage();
+}
+
+/* Formats blank flash and stores OTHER_VALUE under key 1, then OLD_VALUE
+   under key 0 in as many records as it takes to fill the page up to
+   lastRecord */
+void PrepareStorage(const uint16_t lastRecord)
+{
+  memset(flashPages, 0xFF, sizeof(flashPages));
+  CHECK_EQUAL(HAL_OK, RebootStorage());
+  CHECK_EQUAL(HAL_OK, WriteStorageValue(1, OTHER_VALUE));
+  while (nextRecord <= lastRecord)
+  {
+    CHECK_EQUAL(HAL_OK, WriteStorageValue(0, OLD_VALUE - (lastRecord - nextRecord)));
+  }
+  flashOperationsCount = 0;
+}
+
+void CheckStoredValue(const uint8_t key, const uint32_t expected)
+{
+  uint32_t value = 0;
+  CHECK(ReadStorageValue(key, &value));
+  CHECK_EQUAL(expected, value);
+}
+
+/* Cuts the power before and halfway through every flash operation of a
+   write. A reboot recovers the new value once its last program, which
+   commits it, is done, and the old one before */
+void TestPowerLoss(const uint16_t lastRecord)
+{
+  PrepareStorage(lastRecord);
+  CHECK_EQUAL(HAL_OK, WriteStorageValue(0, NEW_VALUE));
+  const uint16_t operationsCount = flashOperationsCount;
+  uint16_t commit = 0;
+  for (uint16_t i = 0; i < operationsCount; ++i)
+  {
+    commit = flashOperations[i].isErase ? commit : i;
+  }
+  for (uint16_t operation = 0; operation < operationsCount; ++operation)
+  {
+    for (enum PowerLoss loss = POWER_LOSS_BEFORE; loss <= POWER_LOSS_HALFWAY; ++loss)
+    {
+      PrepareStorage(lastRecord);
+      powerLoss = loss;
+      powerLossOperation = operation;
+      if (setjmp(powerLossPoint) == 0)
+      {
+        WriteStorageValue(0, NEW_VALUE);
+        CHECK(false);
+      }
+      CHECK_EQUAL(HAL_OK, RebootStorage());
+      CheckStoredValue(0, (operation > commit) ? NEW_VALUE : OLD_VALUE);
+      CheckStoredValue(1, OTHER_VALUE);
+      /* The store is still usable */
+      CHECK_EQUAL(HAL_OK, WriteStorageValue(0, NEW_VALUE + 1));
+      CHECK_EQUAL(HAL_OK, RebootStorage());
+      CheckStoredValue(0, NEW_VALUE + 1);
+    }
+  }
+}
+
+int main(void)
+{
+  TestGetRecordCrc();
+  TestLoadActivePage();
+  /* A record appended by ProgramRecord, then a write that needs CompactStorage */
+  TestPowerLoss(1);
+  TestPowerLoss(RECORDS_PER_PAGE - 1);
+  return FinishTests("storage");
+}
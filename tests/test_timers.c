@@ -0,0 +1,97 @@
+/**
+  ******************************************************************************
+  * @file           : test_timers.c
+  * @brief          : Expiry ticks of the two level timer wheel.
+  ******************************************************************************
+  */
+
+#include "timers.c"
+#include <string.h>
+
+#include "test.h"
+
+#define TEST_TIMERS_COUNT 64
+
+struct Timer testTimers[TEST_TIMERS_COUNT];
+uint32_t expectedTicks[TEST_TIMERS_COUNT];
+uint32_t firedTicks[TEST_TIMERS_COUNT];
+uint32_t restartsCount;
+
+void RecordExpiry(struct Timer *timer)
+{
+  firedTicks[timer - testTimers] = timersTick;
+}
+
+void RestartTimer(struct Timer *timer)
+{
+  RecordExpiry(timer);
+  ++restartsCount;
+  StartTimer(timer, 10, RestartTimer);
+}
+
+void TestTimerExpiries(void)
+{
+  /* Delays across the first level, the second one and past both */
+  const uint32_t DELAYS[] = { 0, 1, 2, 63, 64, 65, 127, 128, 1000, 4031, 4095, 4096, 4097, 5000, 10000 };
+  const uint8_t delaysCount = sizeof(DELAYS) / sizeof(DELAYS[0]);
+  /* Started at ticks that are not aligned on the wheel */
+  const uint32_t STARTS[] = { 0, 1, 63, 64, 4095, 4096, 0xFFFFFFC0U };
+  for (uint8_t s = 0; s < sizeof(STARTS) / sizeof(STARTS[0]); ++s)
+  {
+    memset(firstLevel, 0, sizeof(firstLevel));
+    memset(secondLevel, 0, sizeof(secondLevel));
+    memset(testTimers, 0, sizeof(testTimers));
+    memset(firedTicks, 0, sizeof(firedTicks));
+    timersTick = STARTS[s];
+    for (uint8_t i = 0; i < delaysCount; ++i)
+    {
+      StartTimer(&testTimers[i], DELAYS[i], RecordExpiry);
+      expectedTicks[i] = STARTS[s] + ((DELAYS[i] != 0) ? DELAYS[i] : 1);
+    }
+    /* Stopped before it expires and restarted over a running timer */
+    StartTimer(&testTimers[delaysCount], 50, RecordExpiry);
+    StopTimer(&testTimers[delaysCount]);
+    StartTimer(&testTimers[delaysCount + 1], 3000, RecordExpiry);
+    StartTimer(&testTimers[delaysCount + 1], 70, RecordExpiry);
+    expectedTicks[delaysCount + 1] = STARTS[s] + 70;
+
+    for (uint32_t tick = 0; tick <= 10001; ++tick)
+    {
+      UpdateTimers();
+    }
+    for (uint8_t i = 0; i < delaysCount; ++i)
+    {
+      CHECK_EQUAL(expectedTicks[i], firedTicks[i]);
+      CHECK(!testTimers[i].isArmed);
+      CHECK(TakeTimerExpiry(&testTimers[i]));
+      CHECK(!TakeTimerExpiry(&testTimers[i]));
+    }
+    CHECK_EQUAL(0, firedTicks[delaysCount]);
+    CHECK(!TakeTimerExpiry(&testTimers[delaysCount]));
+    CHECK_EQUAL(expectedTicks[delaysCount + 1], firedTicks[delaysCount + 1]);
+  }
+}
+
+void TestTimerRestartedFromCallback(void)
+{
+  memset(firstLevel, 0, sizeof(firstLevel));
+  memset(secondLevel, 0, sizeof(secondLevel));
+  memset(testTimers, 0, sizeof(testTimers));
+  timersTick = 0;
+  restartsCount = 0;
+  StartTimer(&testTimers[0], 10, RestartTimer);
+  for (uint32_t tick = 0; tick < 1000; ++tick)
+  {
+    UpdateTimers();
+  }
+  CHECK_EQUAL(100, restartsCount);
+  CHECK_EQUAL(1000, firedTicks[0]);
+  CHECK(testTimers[0].isArmed);
+}
+
+int main(void)
+{
+  TestTimerExpiries();
+  TestTimerRestartedFromCallback();
+  return FinishTests("timers");
+}
@@ -0,0 +1,385 @@
+#!/usr/bin/env python3
+"""Flash, RAM and stack report of the firmwares, from their Keil build outputs.
+
+Reads MDK-ARM/<project>/<project>.axf for the sizes of every object and data
+symbol, and the static call graph MDK-ARM/<project>/<project>.htm that armlink
+writes next to it for the code size and stack depth of every function. Prints
+the tables, the worst case stack of every interrupt handler and the changes
+since the stored baseline, then checks the budgets. Outputs older than the
+sources of the .uvprojx, missing one of its objects or with handlers the
+sources no longer define are reported stale and fail the run, the Keil
+project has to be rebuilt first. Run it from the repository root after a
+build:
+
+    python3 tools/footprint.py [project ...]       report, fails over budget
+    python3 tools/footprint.py --update-baseline   stores the current sizes
+
+Budgets and the baseline are kept in tools/footprint.json.
+"""
+
+import glob
+import html
+import json
+import os
+import re
+import struct
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PROJECTS = ("counter", "leds", "lock")
+SETTINGS_PATH = os.path.join(ROOT, "tools", "footprint.json")
+
+# The core stacks eight registers on exception entry, FPU-less Cortex-M3
+EXCEPTION_FRAME_SIZE = 32
+
+SHT_NOBITS = 8
+SHF_WRITE = 0x1
+SHF_EXECINSTR = 0x4
+STT_OBJECT = 1
+STT_FUNC = 2
+STT_SECTION = 3
+STT_FILE = 4
+
+FUNCTION_ENTRY = re.compile(
+    r'<P><STRONG><a name="\[\w+\]"></a>(?P<name>[^<]+)</STRONG> \((?:Thumb|ARM), '
+    r'(?P<size>\d+) bytes, Stack size (?P<stack>\d+|unknown) bytes, '
+    r'(?P<object>[^(]+)\((?P<section>[^)]*)\)\)')
+MAX_DEPTH = re.compile(r"Max Depth = (?P<depth>\d+)(?P<unknown>[^<]*)")
+MAXIMUM_STACK = re.compile(r"Maximum Stack Usage =\s*(?P<depth>\d+) bytes(?P<unknown>[^<]*)")
+FILE_PATH = re.compile(r"<FilePath>(?P<path>[^<]+)</FilePath>")
+VECTOR = re.compile(r'<LI><a href="#\[\w+\]">(?P<name>[^<]+)</a> from [^ ]+ referenced from startup_\w+\.o\(RESET\)')
+
+
+def build_path(project, extension):
+    return os.path.join(ROOT, project, project, "MDK-ARM", project, project + extension)
+
+
+def project_sources(project):
+    """The C and assembly sources of the .uvprojx, then the project headers"""
+    directory = os.path.join(ROOT, project, project, "MDK-ARM")
+    with open(os.path.join(directory, project + ".uvprojx"), encoding="latin-1") as settings:
+        paths = [os.path.normpath(os.path.join(directory, match.group("path").replace("\\", "/")))
+                 for match in FILE_PATH.finditer(settings.read())]
+    sources = [path for path in paths if path.endswith((".c", ".s"))]
+    return sources + sorted(glob.glob(os.path.join(ROOT, project, project, "Inc", "*.h")))
+
+
+# Call graph -------------------------------------------------------------------
+def read_call_graph(path):
+    """Returns {name: function}, the names in the vector table and the stack
+    usage of the whole image"""
+    with open(path, encoding="latin-1") as report:
+        text = report.read()
+    functions = {}
+    entries = list(FUNCTION_ENTRY.finditer(text))
+    for index, entry in enumerate(entries):
+        end = entries[index + 1].start() if index + 1 < len(entries) else len(text)
+        stack = entry.group("stack")
+        function = {
+            "object": entry.group("object").strip(),
+            "size": int(entry.group("size")),
+            "stack": int(stack) if stack != "unknown" else None,
+            "depth": int(stack) if stack != "unknown" else None,
+            "unbounded": stack == "unknown",
+        }
+        depth = MAX_DEPTH.search(text, entry.end(), end)
+        if depth:
+            function["depth"] = int(depth.group("depth"))
+            function["unbounded"] = function["unbounded"] or ("Unknown" in depth.group("unknown"))
+        functions[html.unescape(entry.group("name"))] = function
+    vectors = {html.unescape(vector.group("name")) for vector in VECTOR.finditer(text)}
+    maximum = MAXIMUM_STACK.search(text)
+    image = {
+        "depth": int(maximum.group("depth")) if maximum else None,
+        "unbounded": bool(maximum) and "Unknown" in maximum.group("unknown"),
+    }
+    return functions, vectors, image
+
+
+# ELF image --------------------------------------------------------------------
+def read_image(path):
+    """Returns the allocated sections and the symbols of an ELF32 image"""
+    with open(path, "rb") as image:
+        data = image.read()
+    if data[:4] != b"\x7fELF" or data[4] != 1 or data[5] != 1:
+        raise ValueError(path + " is not a little endian ELF32 image")
+    (shoff,) = struct.unpack_from("<I", data, 0x20)
+    shentsize, shnum, shstrndx = struct.unpack_from("<HHH", data, 0x2E)
+    headers = [struct.unpack_from("<IIIIIIIIII", data, shoff + i * shentsize) for i in range(shnum)]
+
+    def string(table, offset):
+        start = headers[table][4] + offset
+        return data[start:data.index(b"\0", start)].decode("latin-1")
+
+    sections = []
+    for index, (name, kind, flags, address, offset, size, link, info, align, entsize) in enumerate(headers):
+        sections.append({
+            "index": index,
+            "name": string(shstrndx, name),
+            "kind": kind,
+            "flags": flags,
+            "address": address,
+            "size": size,
+        })
+    symbols = []
+    for header in headers:
+        if header[1] != 2:  # SHT_SYMTAB
+            continue
+        offset, size, link, entsize = header[4], header[5], header[6], header[9]
+        for position in range(offset, offset + size, entsize):
+            name, value, symbol_size, info, other, section = struct.unpack_from("<IIIBBH", data, position)
+            symbols.append({
+                "name": string(link, name),
+                "value": value,
+                "size": symbol_size,
+                "type": info & 0xF,
+                "section": section,
+            })
+    return sections, symbols
+
+
+def section_class(section, name=""):
+    """code, rodata, rwdata, zidata, or None for sections not in the image"""
+    if section["flags"] & 0x2 == 0:  # SHF_ALLOC
+        return None
+    if section["kind"] == SHT_NOBITS:
+        return "zidata"
+    if section["flags"] & SHF_WRITE:
+        return "rwdata"
+    if name in ("RESET", ".constdata", ".conststring") or name.startswith(".constdata"):
+        return "rodata"
+    return "code" if section["flags"] & SHF_EXECINSTR else "rodata"
+
+
+def measure_objects(sections, symbols):
+    """Sizes per object file, from the section symbols armlink groups under
+    the FILE symbol of every object. The i.<function> sections carry no
+    size, they run up to the next section, literal pool and padding included"""
+    starts = {}
+    for symbol in symbols:
+        if symbol["type"] == STT_SECTION and 0 < symbol["section"] < len(sections):
+            starts.setdefault(symbol["section"], set()).add(symbol["value"])
+    for index in starts:
+        starts[index].add(sections[index]["address"] + sections[index]["size"])
+        starts[index] = sorted(starts[index])
+    objects = {}
+    current = None
+    for symbol in symbols:
+        if symbol["type"] == STT_FILE:
+            current = os.path.basename(symbol["name"].replace("\\", "/"))
+            current = re.sub(r"\.(c|s)$", ".o", current)
+            continue
+        if current is None or symbol["type"] != STT_SECTION or symbol["section"] >= len(sections):
+            continue
+        kind = section_class(sections[symbol["section"]], symbol["name"])
+        if kind is None:
+            continue
+        size = symbol["size"]
+        if size == 0 and symbol["name"].startswith("i."):
+            following = [start for start in starts[symbol["section"]] if start > symbol["value"]]
+            size = following[0] - symbol["value"] if following else 0
+        sizes = objects.setdefault(current, {"code": 0, "rodata": 0, "rwdata": 0, "zidata": 0})
+        sizes[kind] += size
+    return objects
+
+
+def measure_totals(sections):
+    totals = {"code": 0, "rodata": 0, "rwdata": 0, "zidata": 0}
+    for section in sections:
+        kind = section_class(section)
+        if kind in ("rwdata", "zidata"):
+            totals[kind] += section["size"]
+        elif kind is not None:
+            # Code and constants share the execution region
+            totals["code"] += section["size"]
+    return totals
+
+
+def find_stack_size(symbols):
+    for symbol in symbols:
+        if symbol["type"] == STT_SECTION and symbol["name"] == "STACK":
+            return symbol["size"]
+    return None
+
+
+# Report -----------------------------------------------------------------------
+def is_handler(name, function, vectors):
+    """Handlers the firmware defines, the weak defaults of the startup file
+    are an endless loop without a frame"""
+    return (name in vectors) and (name != "Reset_Handler") and not function["object"].startswith("startup_")
+
+
+def collect(project):
+    functions, vectors, image = read_call_graph(build_path(project, ".htm"))
+    sections, symbols = read_image(build_path(project, ".axf"))
+    objects = measure_objects(sections, symbols)
+    totals = measure_totals(sections)
+    attributed = sum(sizes["code"] + sizes["rodata"] for sizes in objects.values())
+    objects["(unattributed)"] = {"code": totals["code"] - attributed, "rodata": 0, "rwdata": 0, "zidata": 0}
+    handlers = {name: function for name, function in functions.items() if is_handler(name, function, vectors)}
+    main = functions.get("main", {"depth": 0, "unbounded": True})
+    # Without the priorities every handler may nest on top of main, so this
+    # bounds the stack from above
+    bound = (main["depth"] or 0) + sum((function["depth"] or 0) + EXCEPTION_FRAME_SIZE
+                                       for function in handlers.values())
+    return {
+        "flash": totals["code"] + totals["rwdata"],
+        "ram": totals["rwdata"] + totals["zidata"],
+        "stack_size": find_stack_size(symbols),
+        "stack_bound": bound,
+        "stack_unbounded": main["unbounded"] or any(function["unbounded"] for function in handlers.values()),
+        "image_stack": image,
+        "objects": objects,
+        "functions": functions,
+        "handlers": handlers,
+    }
+
+
+def find_staleness(project, result):
+    """Returns why the build outputs don't match the sources, if they don't"""
+    reasons = []
+    sources = project_sources(project)
+    built = min(os.path.getmtime(build_path(project, extension)) for extension in (".axf", ".htm"))
+    newer = [path for path in sources if os.path.getmtime(path) > built]
+    if newer:
+        reasons.append("%d sources are newer than the .axf and .htm, %s among them" %
+                       (len(newer), os.path.relpath(newer[0], ROOT)))
+    # armlink drops the unused HAL drivers whole, every module of Src has a use
+    own = os.path.join(ROOT, project, project, "Src")
+    objects = [re.sub(r"\.c$", ".o", os.path.basename(path)) for path in sources
+               if path.endswith(".c") and os.path.dirname(path) == own]
+    missing = [name for name in objects if name not in result["objects"]]
+    if missing:
+        reasons.append("no code of " + ", ".join(missing))
+    texts = []
+    for path in sources:
+        if path.endswith(".c"):
+            with open(path, encoding="latin-1") as source:
+                texts.append(source.read())
+    removed = [name for name in sorted(result["handlers"])
+               if not any(re.search(r"\b%s\s*\(" % re.escape(name), text) for text in texts)]
+    if removed:
+        reasons.append("handlers no longer in the sources: " + ", ".join(removed))
+    return reasons
+
+
+def print_table(title, header, rows):
+    print(title)
+    widths = [max(len(str(row[column])) for row in [header] + rows) for column in range(len(header))]
+    for row in [header] + rows:
+        cells = [str(cell).ljust(widths[0]) if column == 0 else str(cell).rjust(widths[column])
+                 for column, cell in enumerate(row)]
+        print("  " + "  ".join(cells))
+    print()
+
+
+def depth_text(function):
+    if function["depth"] is None:
+        return "?"
+    return str(function["depth"]) + ("+?" if function["unbounded"] else "")
+
+
+def report(project, result, staleness):
+    print("== %s: flash %d bytes, RAM %d bytes, stack %s bytes reserved" %
+          (project, result["flash"], result["ram"], result["stack_size"]))
+    print()
+    if staleness:
+        print("Stale build outputs, rebuild the Keil project before trusting these figures")
+        for reason in staleness:
+            print("  " + reason)
+        print()
+    rows = [[name, sizes["code"], sizes["rodata"], sizes["rwdata"], sizes["zidata"],
+             sizes["code"] + sizes["rodata"] + sizes["rwdata"], sizes["rwdata"] + sizes["zidata"]]
+            for name, sizes in sorted(result["objects"].items(), key=lambda item: item[0])]
+    print_table("Objects", ["object", "code", "ro", "rw", "zi", "flash", "ram"], rows)
+    rows = [[name, function["object"], function["size"],
+             function["stack"] if function["stack"] is not None else "?", depth_text(function)]
+            for name, function in sorted(result["functions"].items(), key=lambda item: -item[1]["size"])
+            if function["size"] != 0]
+    print_table("Functions", ["function", "object", "flash", "frame", "depth"], rows)
+    rows = [[name, depth_text(function), (function["depth"] or 0) + EXCEPTION_FRAME_SIZE]
+            for name, function in sorted(result["handlers"].items())]
+    print_table("Interrupt handlers (depth with the exception frame)", ["handler", "depth", "total"], rows)
+    print("Stack bound, main with every handler nested: %d%s bytes" %
+          (result["stack_bound"], " + unknown (function pointers or cycles)" if result["stack_unbounded"] else ""))
+    print()
+
+
+def summarize(result):
+    """What the baseline keeps of a result"""
+    return {
+        "flash": result["flash"],
+        "ram": result["ram"],
+        "stack_bound": result["stack_bound"],
+        "objects": {name: sizes["code"] + sizes["rodata"] + sizes["rwdata"]
+                    for name, sizes in result["objects"].items()},
+        "functions": {name: function["size"] for name, function in result["functions"].items()
+                      if function["size"] != 0},
+    }
+
+
+def print_changes(baseline, current):
+    if baseline is None:
+        print("No baseline, store one with --update-baseline")
+        print()
+        return
+    print("Changes since the baseline")
+    for key in ("flash", "ram", "stack_bound"):
+        if current[key] != baseline[key]:
+            print("  %-12s %6d -> %6d (%+d)" % (key, baseline[key], current[key], current[key] - baseline[key]))
+    for table in ("objects", "functions"):
+        before, after = baseline[table], current[table]
+        for name in sorted(set(before) | set(after)):
+            old, new = before.get(name, 0), after.get(name, 0)
+            if old != new:
+                print("  %-40s %6d -> %6d (%+d)" % (name, old, new, new - old))
+    print()
+
+
+def check_budget(project, result, budget):
+    """Returns the broken limits"""
+    failures = []
+    for key, value in (("flash", result["flash"]), ("ram", result["ram"]), ("stack", result["stack_bound"])):
+        limit = budget.get(key)
+        if limit is not None and value > limit:
+            failures.append("%s: %s %d bytes over the budget of %d" % (project, key, value, limit))
+    if result["stack_size"] is not None and result["stack_bound"] > result["stack_size"]:
+        failures.append("%s: stack bound %d bytes over the %d reserved" %
+                        (project, result["stack_bound"], result["stack_size"]))
+    return failures
+
+
+def main(arguments):
+    update = "--update-baseline" in arguments
+    projects = [argument for argument in arguments if not argument.startswith("--")] or list(PROJECTS)
+    with open(SETTINGS_PATH) as settings_file:
+        settings = json.load(settings_file)
+    failures = []
+    stale = []
+    for project in projects:
+        result = collect(project)
+        staleness = find_staleness(project, result)
+        report(project, result, staleness)
+        current = summarize(result)
+        if staleness:
+            # A baseline of old outputs would hide the growth of the next build
+            stale.append(project)
+        elif update:
+            settings["baseline"][project] = current
+        if not update:
+            print_changes(settings["baseline"].get(project), current)
+        failures += check_budget(project, result, settings["budgets"].get(project, {}))
+    if update:
+        with open(SETTINGS_PATH, "w") as settings_file:
+            json.dump(settings, settings_file, indent=2, sort_keys=True)
+            settings_file.write("\n")
+    for failure in failures:
+        print("over budget: " + failure, file=sys.stderr)
+    for project in stale:
+        print("stale: %s build outputs don't match the sources, rebuild it in Keil%s" %
+              (project, ", baseline kept" if update else ""), file=sys.stderr)
+    return 1 if failures or stale else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))
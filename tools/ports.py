@@ -0,0 +1,109 @@
+#!/usr/bin/env python3
+"""Generates the Inc/ports.h pin lists of the firmwares from their .ioc files.
+
+The main.c files build their PortConfig tables from these lists, so the
+pinout set in CubeMX is the only place the outputs are written down. Run it
+from the repository root after changing a pinout:
+
+    python3 tools/ports.py            writes every ports.h
+    python3 tools/ports.py --check    fails if a ports.h is out of date
+"""
+
+import os
+import re
+import sys
+
+ROOT = os.path.dirname(os.path.dirname(os.path.abspath(__file__)))
+PROJECTS = ("counter", "leds", "lock")
+
+# "PA0-WKUP.Signal=GPIO_Output" -> port A, pin 0
+PIN_KEY = re.compile(r"^P([A-G])(\d+)(?:-[\w]+)?\.(\w+)=(.*)$")
+
+HEADER = """\
+/**
+  ******************************************************************************
+  * @file           : ports.h
+  * @brief          : Output pins of every port, generated by tools/ports.py
+  *                   from {ioc}. Do not edit, run the script again once
+  *                   the pinout is changed in CubeMX.
+  ******************************************************************************
+  */
+
+/* Define to prevent recursive inclusion -------------------------------------*/
+#ifndef __PORTS_H
+#define __PORTS_H
+
+#ifdef __cplusplus
+extern "C" {{
+#endif
+
+/* Includes ------------------------------------------------------------------*/
+#include "stm32f1xx_hal.h"
+
+/* Exported constants --------------------------------------------------------*/
+/* PORT_x_OUTPUT_PINS are the GPIO_Output pins, PORT_x_HIGH_PINS the ones of
+   them that start high */
+"""
+
+FOOTER = """
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* __PORTS_H */
+"""
+
+
+def read_pins(ioc_path):
+    """Returns {port: {pin: {parameter: value}}} for every pin of the .ioc"""
+    pins = {}
+    with open(ioc_path) as ioc:
+        for line in ioc:
+            match = PIN_KEY.match(line.strip())
+            if match:
+                port, pin, parameter, value = match.groups()
+                pins.setdefault(port, {}).setdefault(int(pin), {})[parameter] = value
+    return pins
+
+
+def format_pins(pins):
+    if not pins:
+        return "0"
+    return "(" + " | ".join("GPIO_PIN_%d" % pin for pin in sorted(pins)) + ")"
+
+
+def generate(project):
+    ioc_name = project + ".ioc"
+    pins = read_pins(os.path.join(ROOT, project, project, ioc_name))
+    text = HEADER.format(ioc=ioc_name)
+    for port in sorted(pins):
+        outputs = [pin for pin, parameters in pins[port].items()
+                   if parameters.get("Signal") == "GPIO_Output"]
+        high = [pin for pin in outputs if pins[port][pin].get("PinState") == "GPIO_PIN_SET"]
+        text += "#define PORT_%s_OUTPUT_PINS %s\n" % (port, format_pins(outputs))
+        text += "#define PORT_%s_HIGH_PINS %s\n" % (port, format_pins(high))
+    return text + FOOTER
+
+
+def main(arguments):
+    check = "--check" in arguments
+    stale = []
+    for project in PROJECTS:
+        path = os.path.join(ROOT, project, project, "Inc", "ports.h")
+        text = generate(project)
+        current = open(path).read() if os.path.exists(path) else None
+        if current == text:
+            continue
+        if check:
+            stale.append(path)
+        else:
+            with open(path, "w") as header:
+                header.write(text)
+            print("wrote " + os.path.relpath(path, ROOT))
+    for path in stale:
+        print("out of date: " + os.path.relpath(path, ROOT), file=sys.stderr)
+    return 1 if stale else 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv[1:]))